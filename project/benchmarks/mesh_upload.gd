@@ -0,0 +1,72 @@
+extends SceneTree
+
+# Builds the same terrain in RENDER_MODE_CPU and RENDER_MODE_CPU_COMPACT, then repeats a brush sized edit on each
+# Run from the repository root with: godot --headless --path project --script res://benchmarks/mesh_upload.gd
+# Results are printed and written to bench_output.txt next to the project folder
+
+const IMAGE_SIZE := 512
+const CHUNK_SIZE := 64
+const MESH_SIZE := 256.0
+const EDIT_SIZE := 16
+const EDIT_COUNT := 200
+
+func _initialize() -> void:
+	var lines := PackedStringArray()
+	lines.append("image_size %d, chunk_size %d, %d edits of %dx%d pixels" % [IMAGE_SIZE, CHUNK_SIZE, EDIT_COUNT, EDIT_SIZE, EDIT_SIZE])
+	lines.append("mode, vertex_count, vertex_bytes, bytes_per_vertex, build_upload_bytes, upload_bytes_per_edit, usec_per_edit")
+	for mode in [SimpleHeightmap.RENDER_MODE_CPU, SimpleHeightmap.RENDER_MODE_CPU_COMPACT]:
+		lines.append(run(mode))
+
+	var output := "\n".join(lines) + "\n"
+	print(output)
+	var path := ProjectSettings.globalize_path("res://").path_join("../bench_output.txt")
+	var file := FileAccess.open(path, FileAccess.WRITE)
+	if file == null:
+		push_error("Could not write %s: %s" % [path, error_string(FileAccess.get_open_error())])
+	else:
+		file.store_string(output)
+	quit()
+
+
+func run(mode: int) -> String:
+	var heightmap := SimpleHeightmap.new()
+	heightmap.mesh_size = MESH_SIZE
+	heightmap.image_size = IMAGE_SIZE
+	heightmap.chunk_size = CHUNK_SIZE
+	heightmap.render_mode = mode
+	heightmap.heightmap_image = create_heights()
+	heightmap.splatmap_image = Image.create_empty(IMAGE_SIZE, IMAGE_SIZE, false, Image.FORMAT_RGBA8)
+	root.add_child(heightmap)
+	heightmap.flush_rebuild()
+	var built: Dictionary = heightmap.get_mesh_stats()
+
+	# The same edits for every mode, walking across chunk borders
+	var image: Image = heightmap.heightmap_image
+	var rng := RandomNumberGenerator.new()
+	rng.seed = 1
+	var upload_bytes := 0
+	var start := Time.get_ticks_usec()
+	for i in EDIT_COUNT:
+		var region := Rect2i(rng.randi_range(0, IMAGE_SIZE - EDIT_SIZE), rng.randi_range(0, IMAGE_SIZE - EDIT_SIZE), EDIT_SIZE, EDIT_SIZE)
+		for y in range(region.position.y, region.end.y):
+			for x in range(region.position.x, region.end.x):
+				image.set_pixel(x, y, Color(image.get_pixel(x, y).r + 0.25, 0.0, 0.0))
+		heightmap.rebuild_region(region, SimpleHeightmap.REBUILD_HEIGHTMAP)
+		heightmap.flush_rebuild()
+		upload_bytes += heightmap.get_mesh_stats()["upload_bytes"]
+	var elapsed := Time.get_ticks_usec() - start
+
+	heightmap.free()
+	return "%s, %d, %d, %.1f, %d, %d, %d" % [
+		"CPU" if mode == SimpleHeightmap.RENDER_MODE_CPU else "CPU_COMPACT",
+		built["vertex_count"], built["vertex_bytes"], built["bytes_per_vertex"], built["upload_bytes"],
+		upload_bytes / EDIT_COUNT, elapsed / EDIT_COUNT]
+
+
+func create_heights() -> Image:
+	var image := Image.create_empty(IMAGE_SIZE, IMAGE_SIZE, false, Image.FORMAT_RF)
+	var noise := FastNoiseLite.new()
+	for y in IMAGE_SIZE:
+		for x in IMAGE_SIZE:
+			image.set_pixel(x, y, Color(noise.get_noise_2d(x, y) * 32.0, 0.0, 0.0))
+	return image
@@ -1,29 +1,48 @@
 #include "register_types.h"
 
 #include "simple_heightmap.h"
+#include "simple_heightmap_data.h"
 
 #ifdef TOOLS_ENABLED
 #include "simple_heightmap_editor_plugin.h"
 #include "simple_heightmap_gizmo_plugin.h"
+#include "simple_heightmap_image_delta.h"
 #endif // TOOLS_ENABLED
 
 #include <gdextension_interface.h>
 #include <godot_cpp/core/defs.hpp>
+#include <godot_cpp/classes/resource_loader.hpp>
+#include <godot_cpp/classes/resource_saver.hpp>
 #include <godot_cpp/godot.hpp>
 
 using namespace godot;
 
+namespace
+{
+	Ref<SimpleHeightmapDataSaver> data_saver;
+	Ref<SimpleHeightmapDataLoader> data_loader;
+}
+
 void initialize_simple_heightmap_module(ModuleInitializationLevel p_level)
 {
 	if (p_level == MODULE_INITIALIZATION_LEVEL_SCENE)
 	{
+		GDREGISTER_CLASS(SimpleHeightmapData);
+		GDREGISTER_INTERNAL_CLASS(SimpleHeightmapDataSaver);
+		GDREGISTER_INTERNAL_CLASS(SimpleHeightmapDataLoader);
 		GDREGISTER_CLASS(SimpleHeightmap);
+
+		data_saver.instantiate();
+		data_loader.instantiate();
+		ResourceSaver::get_singleton()->add_resource_format_saver(data_saver);
+		ResourceLoader::get_singleton()->add_resource_format_loader(data_loader);
 	}
 
 #ifdef TOOLS_ENABLED
 	if (p_level == MODULE_INITIALIZATION_LEVEL_EDITOR)
 	{
 		GDREGISTER_INTERNAL_CLASS(SimpleHeightmapGizmoPlugin);
+		GDREGISTER_INTERNAL_CLASS(SimpleHeightmapImageDelta);
 		GDREGISTER_INTERNAL_CLASS(SimpleHeightmapEditorPlugin);
 		EditorPlugins::add_by_type<SimpleHeightmapEditorPlugin>();
 	}
@@ -31,7 +50,17 @@ void initialize_simple_heightmap_module(ModuleInitializationLevel p_level)
 }
 
 void uninitialize_simple_heightmap_module(ModuleInitializationLevel p_level)
-{ }
+{
+	if (p_level == MODULE_INITIALIZATION_LEVEL_SCENE)
+	{
+		ResourceSaver::get_singleton()->remove_resource_format_saver(data_saver);
+		ResourceLoader::get_singleton()->remove_resource_format_loader(data_loader);
+		data_saver.unref();
+		data_loader.unref();
+
+		SimpleHeightmap::free_pooled_resources();
+	}
+}
 
 extern "C"
 {
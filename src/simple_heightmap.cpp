@@ -1,46 +1,109 @@
 #include "simple_heightmap.h"
+#include "simple_heightmap_normals.h"
+#include "simple_heightmap_splat.h"
+#include <godot_cpp/classes/camera3d.hpp>
+#include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/classes/mesh.hpp>
 #include <godot_cpp/classes/physics_server3d.hpp>
 #include <godot_cpp/classes/rendering_server.hpp>
 #include <godot_cpp/classes/shader.hpp>
 #include <godot_cpp/classes/shader_material.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/classes/viewport.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 #include <godot_cpp/variant/variant.hpp>
 #include <godot_cpp/classes/world3d.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/core/math.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
+#include <godot_cpp/variant/typed_array.hpp>
+
+#ifdef TOOLS_ENABLED
+#include <godot_cpp/classes/editor_interface.hpp>
+#include <godot_cpp/classes/sub_viewport.hpp>
+#endif
 
 constexpr const char* default_texture_1_param = "texture_map_1";
 constexpr const char* default_texture_2_param = "texture_map_2";
 constexpr const char* default_texture_3_param = "texture_map_3";
 constexpr const char* default_texture_4_param = "texture_map_4";
+constexpr const char* texture_layers_param = "texture_layers";
+constexpr const char* height_map_param = "height_map";
+constexpr const char* splat_map_param = "splat_map";
+constexpr const char* quad_size_param = "quad_size";
+constexpr const char* uv_scale_param = "uv_scale";
+constexpr const char* chunk_layer_param = "chunk_layer";
+constexpr const char* chunk_origin_param = "chunk_origin";
+constexpr const char* chunk_columns_param = "chunk_columns";
+constexpr const char* splat_tiles_param = "splat_tiles";
+constexpr const char* splat_tile_counts_param = "splat_tile_counts";
+constexpr const char* splat_pixel_limit_param = "splat_pixel_limit";
+constexpr const char* splat_pixel_scale_param = "splat_pixel_scale";
+constexpr int32_t splat_tile_size = 64; // Pixels per side, each layer also repeats the first row and column of the next tiles
 
 void SimpleHeightmap::_bind_methods()
 {
 	godot::ClassDB::bind_method(godot::D_METHOD("get_mesh_size"), &SimpleHeightmap::get_mesh_size);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_image_size"), &SimpleHeightmap::get_image_size);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_height_precision"), &SimpleHeightmap::get_height_precision);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_height_range"), &SimpleHeightmap::get_height_range);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_chunk_size"), &SimpleHeightmap::get_chunk_size);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_render_mode"), &SimpleHeightmap::get_render_mode);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_splatmap_texture"), &SimpleHeightmap::get_splatmap_texture);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_splat_encoding"), &SimpleHeightmap::get_splat_encoding);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_lod_levels"), &SimpleHeightmap::get_lod_levels);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_lod_distance"), &SimpleHeightmap::get_lod_distance);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_rebuild_band_rows"), &SimpleHeightmap::get_rebuild_band_rows);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_rebuild_thread_limit"), &SimpleHeightmap::get_rebuild_thread_limit);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_async_rebuild"), &SimpleHeightmap::get_async_rebuild);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_texture_size"), &SimpleHeightmap::get_texture_size);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_data"), &SimpleHeightmap::get_data);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_heightmap_image"), &SimpleHeightmap::get_heightmap_image);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_splatmap_image"), &SimpleHeightmap::get_splatmap_image);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_texture_1"), &SimpleHeightmap::get_texture_1);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_texture_2"), &SimpleHeightmap::get_texture_2);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_texture_3"), &SimpleHeightmap::get_texture_3);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_texture_4"), &SimpleHeightmap::get_texture_4);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_texture_layers"), &SimpleHeightmap::get_texture_layers);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_collider_layer"), &SimpleHeightmap::get_collider_layer);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_collider_mask"), &SimpleHeightmap::get_collider_mask);
 	godot::ClassDB::bind_method(godot::D_METHOD("get_collider_priority"), &SimpleHeightmap::get_collider_priority);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_collider_downsample"), &SimpleHeightmap::get_collider_downsample);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_stream_path"), &SimpleHeightmap::get_stream_path);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_stream_distance"), &SimpleHeightmap::get_stream_distance);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_stream_memory_budget"), &SimpleHeightmap::get_stream_memory_budget);
+	godot::ClassDB::bind_method(godot::D_METHOD("is_streaming"), &SimpleHeightmap::is_streaming);
 
 	godot::ClassDB::bind_method(godot::D_METHOD("set_mesh_size", "value"), &SimpleHeightmap::set_mesh_size);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_image_size", "value"), &SimpleHeightmap::set_image_size);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_height_precision", "value"), &SimpleHeightmap::set_height_precision);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_height_range", "value"), &SimpleHeightmap::set_height_range);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_chunk_size", "value"), &SimpleHeightmap::set_chunk_size);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_render_mode", "value"), &SimpleHeightmap::set_render_mode);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_splatmap_texture", "value"), &SimpleHeightmap::set_splatmap_texture);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_splat_encoding", "value"), &SimpleHeightmap::set_splat_encoding);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_lod_levels", "value"), &SimpleHeightmap::set_lod_levels);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_lod_distance", "value"), &SimpleHeightmap::set_lod_distance);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_rebuild_band_rows", "value"), &SimpleHeightmap::set_rebuild_band_rows);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_rebuild_thread_limit", "value"), &SimpleHeightmap::set_rebuild_thread_limit);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_async_rebuild", "value"), &SimpleHeightmap::set_async_rebuild);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_texture_size", "value"), &SimpleHeightmap::set_texture_size);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_data"), &SimpleHeightmap::set_data);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_heightmap_image"), &SimpleHeightmap::set_heightmap_image);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_splatmap_image"), &SimpleHeightmap::set_splatmap_image);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_texture_1", "new_texture"), &SimpleHeightmap::set_texture_1);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_texture_2", "new_texture"), &SimpleHeightmap::set_texture_2);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_texture_3", "new_texture"), &SimpleHeightmap::set_texture_3);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_texture_4", "new_texture"), &SimpleHeightmap::set_texture_4);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_texture_layers", "value"), &SimpleHeightmap::set_texture_layers);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_collider_layer", "layer"), &SimpleHeightmap::set_collider_layer);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_collider_mask", "mask"), &SimpleHeightmap::set_collider_mask);
 	godot::ClassDB::bind_method(godot::D_METHOD("set_collider_priority", "priority"), &SimpleHeightmap::set_collider_priority);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_collider_downsample", "value"), &SimpleHeightmap::set_collider_downsample);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_stream_path", "value"), &SimpleHeightmap::set_stream_path);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_stream_distance", "value"), &SimpleHeightmap::set_stream_distance);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_stream_memory_budget", "value"), &SimpleHeightmap::set_stream_memory_budget);
 
 	BIND_ENUM_CONSTANT(REBUILD_NONE);
 	BIND_ENUM_CONSTANT(REBUILD_ALL);
@@ -48,7 +111,25 @@ void SimpleHeightmap::_bind_methods()
 	BIND_ENUM_CONSTANT(REBUILD_SPLATMAP);
 	BIND_ENUM_CONSTANT(REBUILD_UV);
 
+	BIND_ENUM_CONSTANT(RENDER_MODE_CPU);
+	BIND_ENUM_CONSTANT(RENDER_MODE_GPU_DISPLACEMENT);
+	BIND_ENUM_CONSTANT(RENDER_MODE_CPU_COMPACT);
+
+	BIND_ENUM_CONSTANT(HEIGHT_PRECISION_FLOAT);
+	BIND_ENUM_CONSTANT(HEIGHT_PRECISION_HALF);
+	BIND_ENUM_CONSTANT(HEIGHT_PRECISION_QUANTIZED);
+
+	BIND_ENUM_CONSTANT(SPLAT_ENCODING_WEIGHTS);
+	BIND_ENUM_CONSTANT(SPLAT_ENCODING_LAYERS);
+
 	godot::ClassDB::bind_method(godot::D_METHOD("rebuild", "change_type"), &SimpleHeightmap::rebuild);
+	godot::ClassDB::bind_method(godot::D_METHOD("rebuild_region", "region", "change_type"), &SimpleHeightmap::rebuild_region);
+	godot::ClassDB::bind_method(godot::D_METHOD("flush_rebuild"), &SimpleHeightmap::flush_rebuild);
+	godot::ClassDB::bind_method(godot::D_METHOD("is_rebuild_pending"), &SimpleHeightmap::is_rebuild_pending);
+	godot::ClassDB::bind_method(godot::D_METHOD("intersect_ray", "from", "direction"), &SimpleHeightmap::intersect_ray);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_heights_at", "global_points"), &SimpleHeightmap::get_heights_at);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_normals_at", "global_points"), &SimpleHeightmap::get_normals_at);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_mesh_stats"), &SimpleHeightmap::get_mesh_stats);
 	
 	const auto image_usage_flags =
 		godot::PROPERTY_USAGE_STORAGE | // Heightmap and splatmap will be saved
@@ -57,453 +138,2723 @@ void SimpleHeightmap::_bind_methods()
 
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::FLOAT, "mesh_size"), "set_mesh_size", "get_mesh_size");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "image_size"), "set_image_size", "get_image_size");
+	// Before the images, so a stored heightmap is read with the precision and range it was saved with
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "height_precision", godot::PROPERTY_HINT_ENUM, "Float,Half,Quantized 16-bit"), "set_height_precision", "get_height_precision");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::VECTOR2, "height_range", godot::PROPERTY_HINT_NONE, "suffix:m"), "set_height_range", "get_height_range");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "chunk_size", godot::PROPERTY_HINT_RANGE, "0,1024,1,or_greater"), "set_chunk_size", "get_chunk_size");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "render_mode", godot::PROPERTY_HINT_ENUM, "CPU,GPU Displacement,CPU Compact"), "set_render_mode", "get_render_mode");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::BOOL, "splatmap_texture"), "set_splatmap_texture", "get_splatmap_texture");
+	// Before the images too, a stored splatmap is already in this encoding
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "splat_encoding", godot::PROPERTY_HINT_ENUM, "Weights,Layers"), "set_splat_encoding", "get_splat_encoding");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "lod_levels", godot::PROPERTY_HINT_RANGE, "0,8,1"), "set_lod_levels", "get_lod_levels");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::FLOAT, "lod_distance", godot::PROPERTY_HINT_RANGE, "0.01,1024,0.01,or_greater,suffix:m"), "set_lod_distance", "get_lod_distance");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "rebuild_band_rows", godot::PROPERTY_HINT_RANGE, "1,1024,1,or_greater"), "set_rebuild_band_rows", "get_rebuild_band_rows");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "rebuild_thread_limit", godot::PROPERTY_HINT_RANGE, "0,64,1,or_greater"), "set_rebuild_thread_limit", "get_rebuild_thread_limit");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::BOOL, "async_rebuild"), "set_async_rebuild", "get_async_rebuild");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::FLOAT, "texture_size"), "set_texture_size", "get_texture_size");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "data", godot::PROPERTY_HINT_RESOURCE_TYPE, "SimpleHeightmapData"), "set_data", "get_data");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "heightmap_image", godot::PROPERTY_HINT_RESOURCE_TYPE, "Image", image_usage_flags), "set_heightmap_image", "get_heightmap_image");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "splatmap_image", godot::PROPERTY_HINT_RESOURCE_TYPE, "Image", image_usage_flags), "set_splatmap_image", "get_splatmap_image");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "texture_1", godot::PROPERTY_HINT_RESOURCE_TYPE, "Texture2D"), "set_texture_1", "get_texture_1");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "texture_2", godot::PROPERTY_HINT_RESOURCE_TYPE, "Texture2D"), "set_texture_2", "get_texture_2");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "texture_3", godot::PROPERTY_HINT_RESOURCE_TYPE, "Texture2D"), "set_texture_3", "get_texture_3");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "texture_4", godot::PROPERTY_HINT_RESOURCE_TYPE, "Texture2D"), "set_texture_4", "get_texture_4");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::ARRAY, "texture_layers", godot::PROPERTY_HINT_ARRAY_TYPE, "Texture2D"), "set_texture_layers", "get_texture_layers");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "collider_layer", godot::PROPERTY_HINT_LAYERS_3D_PHYSICS), "set_collider_layer", "get_collider_layer");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "collider_mask", godot::PROPERTY_HINT_LAYERS_3D_PHYSICS), "set_collider_mask", "get_collider_mask");
 	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::FLOAT, "collider_priority"), "set_collider_priority", "get_collider_priority");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "collider_downsample", godot::PROPERTY_HINT_RANGE, "1,64,1,or_greater"), "set_collider_downsample", "get_collider_downsample");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::STRING, "stream_path", godot::PROPERTY_HINT_FILE, "*.shmap"), "set_stream_path", "get_stream_path");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::FLOAT, "stream_distance", godot::PROPERTY_HINT_RANGE, "1,4096,1,or_greater,suffix:m"), "set_stream_distance", "get_stream_distance");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "stream_memory_budget", godot::PROPERTY_HINT_RANGE, "16,8192,1,or_greater,suffix:MiB"), "set_stream_memory_budget", "get_stream_memory_budget");
 
+	ADD_SIGNAL(godot::MethodInfo("rebuild_completed"));
 	ADD_SIGNAL(godot::MethodInfo("texture_1_changed", godot::PropertyInfo(godot::Variant::OBJECT, "new_texture")));
 	ADD_SIGNAL(godot::MethodInfo("texture_2_changed", godot::PropertyInfo(godot::Variant::OBJECT, "new_texture")));
 	ADD_SIGNAL(godot::MethodInfo("texture_3_changed", godot::PropertyInfo(godot::Variant::OBJECT, "new_texture")));
 	ADD_SIGNAL(godot::MethodInfo("texture_4_changed", godot::PropertyInfo(godot::Variant::OBJECT, "new_texture")));
 }
 
-SimpleHeightmap::SimpleHeightmap()
+namespace
 {
-	const auto rserver = godot::RenderingServer::get_singleton();
-	if (rserver != nullptr)
+	// texture_mask has a bit for each of texture_1 to texture_4 that is set, layer_count is 0 unless the splatmap names texture layers
+	godot::String get_shader_code(SimpleHeightmap::RenderMode render_mode, bool splat_texture, uint8_t texture_mask, int32_t layer_count)
 	{
-		shader_id = rserver->shader_create();
-		rserver->shader_set_code(shader_id, godot::vformat(R"(
+		// Displacement reads the chunk's layer, which has a one texel border around the chunk's vertices
+		const auto displacement_code = render_mode != SimpleHeightmap::RENDER_MODE_GPU_DISPLACEMENT ? godot::String() : godot::vformat(R"(
+			uniform sampler2DArray %s : filter_nearest, repeat_disable;
+			uniform sampler2DArray %s : filter_nearest, repeat_disable;
+			uniform float %s = 1.0;
+			uniform float %s = 1.0;
+			instance uniform int %s;
+			instance uniform vec2 %s;
+
+			void vertex()
+			{
+				ivec2 cell = ivec2(round(VERTEX.xz));
+				ivec3 texel = ivec3(cell + ivec2(1), %s);
+				float height = texelFetch(%s, texel, 0).r;
+				float left = texelFetch(%s, texel + ivec3(-1, 0, 0), 0).r;
+				float right = texelFetch(%s, texel + ivec3(1, 0, 0), 0).r;
+				float up = texelFetch(%s, texel + ivec3(0, -1, 0), 0).r;
+				float down = texelFetch(%s, texel + ivec3(0, 1, 0), 0).r;
+
+				VERTEX = vec3(float(cell.x) * %s, height, float(cell.y) * %s);
+				NORMAL = normalize(vec3(left - right, 2.0 * %s, up - down));
+				TANGENT = normalize(vec3(2.0 * %s, right - left, 0.0));
+				BINORMAL = normalize(cross(NORMAL, TANGENT));
+				UV = (vec2(cell) + %s) * %s;
+				COLOR = texelFetch(%s, texel, 0);
+			}
+			)",
+			height_map_param, splat_map_param, quad_size_param, uv_scale_param, chunk_layer_param, chunk_origin_param,
+			chunk_layer_param,
+			height_map_param, height_map_param, height_map_param, height_map_param, height_map_param,
+			quad_size_param, quad_size_param, quad_size_param, quad_size_param,
+			chunk_origin_param, uv_scale_param,
+			splat_map_param);
+
+		// Compact vertices hold the height and a packed normal, the vertex's place in the grid comes from its index
+		const auto compact_code = render_mode != SimpleHeightmap::RENDER_MODE_CPU_COMPACT ? godot::String() : godot::vformat(R"(
+			uniform float %s = 1.0;
+			uniform float %s = 1.0;
+			instance uniform vec2 %s;
+			instance uniform int %s = 1;
+
+			void vertex()
+			{
+				ivec2 cell = ivec2(VERTEX_ID %% %s, VERTEX_ID / %s);
+				uint packed_normal = uint(VERTEX.y);
+				vec2 octahedral = vec2(float(packed_normal & 4095u), float(packed_normal >> 12u)) / 4095.0 * 2.0 - 1.0;
+				vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+				float fold = max(-normal.z, 0.0);
+				normal.x += normal.x >= 0.0 ? -fold : fold;
+				normal.y += normal.y >= 0.0 ? -fold : fold;
+
+				VERTEX = vec3(float(cell.x) * %s, VERTEX.x, float(cell.y) * %s);
+				NORMAL = normalize(normal);
+				TANGENT = normalize(vec3(NORMAL.y, -NORMAL.x, 0.0));
+				BINORMAL = normalize(cross(NORMAL, TANGENT));
+				UV = (vec2(cell) + %s) * %s;
+			}
+			)",
+			quad_size_param, uv_scale_param, chunk_origin_param, chunk_columns_param,
+			chunk_columns_param, chunk_columns_param,
+			quad_size_param, quad_size_param,
+			chunk_origin_param, uv_scale_param);
+
+		// Splat tiles are sampled at the splatmap pixel under each fragment, UVs are vertex positions in pixels times the UV scale
+		// Each layer has one more row and column than its tile, so filtering never reaches into another layer
+		const auto splat_code = !splat_texture ? godot::String() : godot::vformat(R"(
+			uniform sampler2DArray %s : filter_linear, repeat_disable;
+			uniform vec2 %s = vec2(1.0);
+			uniform vec2 %s = vec2(0.0);
+			uniform float %s = 1.0;
+
+			vec4 sample_splat(vec2 uv)
+			{
+				vec2 pixel = clamp(uv * %s, vec2(0.0), %s);
+				vec2 tile = min(floor(pixel / %d.0), %s - 1.0);
+				vec2 texel = pixel - tile * %d.0 + 0.5;
+				return textureLod(%s, vec3(texel / %d.0, tile.x + tile.y * %s.x), 0.0);
+			}
+			)",
+			splat_tiles_param, splat_tile_counts_param, splat_pixel_limit_param, splat_pixel_scale_param,
+			splat_pixel_scale_param, splat_pixel_limit_param,
+			splat_tile_size, splat_tile_counts_param,
+			splat_tile_size,
+			splat_tiles_param, splat_tile_size + 1, splat_tile_counts_param);
+
+		if (layer_count > 0)
+		{
+			// Weights of every layer are blended from the four nearest splatmap pixels, since layer indices can't be filtered
+			// Only the strongest few layers are sampled, the loop may stop early so texture gradients are taken before it
+			const auto sampled_layers = godot::Math::min(layer_count, SimpleHeightmapSplat::LAYERS_PER_PIXEL);
+			return godot::vformat(R"(
+			shader_type spatial;
+
+			uniform sampler2DArray %s : source_color, filter_linear_mipmap, repeat_enable;
+			%s
+			void fragment()
+			{
+				float weights[%d];
+				for (int i = 0; i < %d; i++)
+				{
+					weights[i] = 0.0;
+				}
+				vec2 pixel = clamp(UV * %s, vec2(0.0), %s);
+				vec2 base = floor(pixel);
+				vec2 blend = pixel - base;
+				for (int corner = 0; corner < 4; corner++)
+				{
+					ivec2 offset = ivec2(corner & 1, corner >> 1);
+					vec2 corner_blend = mix(1.0 - blend, blend, vec2(offset));
+					ivec2 corner_pixel = min(ivec2(base) + offset, ivec2(%s));
+					ivec2 tile = min(corner_pixel / %d, ivec2(%s) - 1);
+					uvec4 texel = uvec4(round(texelFetch(%s, ivec3(corner_pixel - tile * %d, tile.x + tile.y * int(%s.x)), 0) * 255.0));
+					float amount = corner_blend.x * corner_blend.y;
+					float second = float(texel.b) / 255.0;
+					float third = float(texel.a) / 255.0;
+					weights[min(int(texel.r & 15u), %d)] += amount * max(1.0 - second - third, 0.0);
+					weights[min(int(texel.r >> 4u), %d)] += amount * second;
+					weights[min(int(texel.g & 15u), %d)] += amount * third;
+				}
+
+				vec2 uv_dx = dFdx(UV);
+				vec2 uv_dy = dFdy(UV);
+				vec3 albedo = vec3(0.0);
+				float total = 0.0;
+				for (int k = 0; k < %d; k++)
+				{
+					int strongest = 0;
+					for (int i = 1; i < %d; i++)
+					{
+						if (weights[i] > weights[strongest])
+						{
+							strongest = i;
+						}
+					}
+					if (weights[strongest] <= 0.0)
+					{
+						break;
+					}
+					albedo += textureGrad(%s, vec3(UV, float(strongest)), uv_dx, uv_dy).rgb * weights[strongest];
+					total += weights[strongest];
+					weights[strongest] = -1.0;
+				}
+				ALBEDO = albedo / max(total, 0.0001);
+			})",
+				texture_layers_param,
+				displacement_code + compact_code + splat_code,
+				layer_count, layer_count,
+				splat_pixel_scale_param, splat_pixel_limit_param,
+				splat_pixel_limit_param,
+				splat_tile_size, splat_tile_counts_param,
+				splat_tiles_param, splat_tile_size, splat_tile_counts_param,
+				layer_count - 1, layer_count - 1, layer_count - 1,
+				sampled_layers, layer_count,
+				texture_layers_param);
+		}
+
+		// Textures that aren't set are the same plain white as an unset sampler, without sampling anything
+		const auto sample_texture = [texture_mask](int32_t index, const char* parameter_name)
+		{
+			return (texture_mask & (1 << index)) ? godot::vformat("texture(%s, UV)", parameter_name) : godot::String("vec4(1.0)");
+		};
+		return godot::vformat(R"(
 			shader_type spatial;
 
 			uniform sampler2D %s : source_color;
 			uniform sampler2D %s : source_color;
 			uniform sampler2D %s : source_color;
 			uniform sampler2D %s : source_color;
-
+			%s
 			void fragment()
 			{
-				vec4 texture_1 = texture(%s, UV);
-				vec4 texture_2 = texture(%s, UV);
-				vec4 texture_3 = texture(%s, UV);
-				vec4 texture_4 = texture(%s, UV);
-				vec4 output = normalize((texture_1 * COLOR.r) + (texture_2 * COLOR.g) + (texture_3 * COLOR.b) + (texture_4 * COLOR.a));
+				vec4 weights = %s;
+				vec4 texture_1 = %s;
+				vec4 texture_2 = %s;
+				vec4 texture_3 = %s;
+				vec4 texture_4 = %s;
+				vec4 output = normalize((texture_1 * weights.r) + (texture_2 * weights.g) + (texture_3 * weights.b) + (texture_4 * weights.a));
 				ALBEDO = output.rgb;
 			})",
 			default_texture_1_param, default_texture_2_param, default_texture_3_param, default_texture_4_param,
-			default_texture_1_param, default_texture_2_param, default_texture_3_param, default_texture_4_param));
-
-		material_id = rserver->material_create();
-		rserver->material_set_shader(material_id, shader_id);
-
-		mesh_id = rserver->mesh_create();
-		set_base(mesh_id);
+			displacement_code + compact_code + splat_code,
+			splat_texture ? "sample_splat(UV)" : "COLOR",
+			sample_texture(0, default_texture_1_param), sample_texture(1, default_texture_2_param),
+			sample_texture(2, default_texture_3_param), sample_texture(3, default_texture_4_param));
 	}
-	const auto pserver = godot::PhysicsServer3D::get_singleton();
-	if (pserver)
-	{
-		auto id = get_instance_id();
 
-		collider_body_id = pserver->body_create();
-		pserver->body_set_mode(collider_body_id, godot::PhysicsServer3D::BODY_MODE_STATIC);
-		pserver->body_set_ray_pickable(collider_body_id, true);
-		pserver->body_attach_object_instance_id(collider_body_id, get_instance_id());
-		pserver->body_set_collision_layer(collider_body_id, collider_layer);
-		pserver->body_set_collision_mask(collider_body_id, collider_mask);
-		pserver->body_set_collision_priority(collider_body_id, collider_priority);
+	// Sides of a chunk whose neighbour is one level of detail coarser
+	enum StitchMask : uint8_t
+	{
+		STITCH_NEGATIVE_X = 1 << 0,
+		STITCH_POSITIVE_X = 1 << 1,
+		STITCH_NEGATIVE_Z = 1 << 2,
+		STITCH_POSITIVE_Z = 1 << 3,
+	};
 
-		collider_shape_id = pserver->heightmap_shape_create();
-		pserver->body_add_shape(collider_body_id, collider_shape_id);
+	uint32_t get_index_element_size(uint32_t vertex_count)
+	{
+		return vertex_count <= std::numeric_limits<uint16_t>::max() ? sizeof(uint16_t) : sizeof(uint32_t);
 	}
-}
 
-void SimpleHeightmap::_notification(int what)
-{
-	switch (what)
+	// Indices of a grid of quads, using every 2^lod vertices
+	// Stitched sides snap the vertices their coarser neighbour doesn't have onto the ones it does, so no cracks open up
+	godot::PackedByteArray generate_grid_indices(uint32_t quads_x, uint32_t quads_z, uint8_t lod = 0, uint8_t stitch_mask = 0)
 	{
-		case NOTIFICATION_READY:
-		{
-			rebuild(REBUILD_ALL);
-		}
-		break;
+		const auto vertices_per_row = quads_x + 1;
+		const auto vertex_count = vertices_per_row * (quads_z + 1);
+		const auto index_element_size = get_index_element_size(vertex_count);
+		const auto step = 1u << lod;
+		const auto coarse_step = step << 1;
 
-		case NOTIFICATION_ENTER_WORLD: // Physics World
+		const auto get_index = [&](uint32_t x, uint32_t z) -> uint32_t
 		{
-			const auto pserver = godot::PhysicsServer3D::get_singleton();
-			if (pserver && collider_body_id.is_valid())
+			const auto snap_z = ((stitch_mask & STITCH_NEGATIVE_X) && x == 0) || ((stitch_mask & STITCH_POSITIVE_X) && x == quads_x);
+			const auto snap_x = ((stitch_mask & STITCH_NEGATIVE_Z) && z == 0) || ((stitch_mask & STITCH_POSITIVE_Z) && z == quads_z);
+			if (snap_z)
+				z -= z % coarse_step;
+			if (snap_x)
+				x -= x % coarse_step;
+			return x + z * vertices_per_row;
+		};
+
+		godot::LocalVector<uint32_t> triangles;
+		triangles.reserve((quads_x / step) * (quads_z / step) * 6);
+		const auto add_triangle = [&](uint32_t a, uint32_t b, uint32_t c)
+		{
+			// Snapping collapses some triangles along stitched sides
+			if (a != b && b != c && a != c)
 			{
-				const auto world = get_world_3d();
-				const auto space = world->get_space();
-				pserver->body_set_space(collider_body_id, space);
-				pserver->body_set_state(collider_body_id, godot::PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+				triangles.push_back(a);
+				triangles.push_back(b);
+				triangles.push_back(c);
 			}
-		}
-		break;
-
-		case NOTIFICATION_TRANSFORM_CHANGED:
+		};
+		for (uint32_t z = 0; z < quads_z; z += step)
 		{
-			const auto pserver = godot::PhysicsServer3D::get_singleton();
-			if (pserver && collider_body_id.is_valid())
+			for (uint32_t x = 0; x < quads_x; x += step)
 			{
-				pserver->body_set_state(collider_body_id, godot::PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+				const auto i1 = get_index(x + step, z);
+				const auto i2 = get_index(x, z + step);
+				const auto i3 = get_index(x, z);
+				const auto i4 = get_index(x + step, z + step);
+				add_triangle(i1, i2, i3);
+				add_triangle(i4, i2, i1);
 			}
 		}
-		break;
 
-		case NOTIFICATION_EXIT_WORLD: // Physics World
+		godot::PackedByteArray indices;
+		indices.resize(triangles.size() * index_element_size);
+		const auto indices_p = indices.ptrw();
+		if (index_element_size == sizeof(uint32_t))
 		{
-			const auto pserver = godot::PhysicsServer3D::get_singleton();
-			if (pserver && collider_body_id.is_valid())
+			memcpy(indices_p, triangles.ptr(), triangles.size() * sizeof(uint32_t));
+		}
+		else
+		{
+			for (uint32_t i = 0; i < triangles.size(); ++i)
 			{
-				pserver->body_set_space(collider_body_id, godot::RID());
+				const auto index = static_cast<uint16_t>(triangles[i]);
+				memcpy(&indices_p[i * sizeof(uint16_t)], &index, sizeof(uint16_t));
 			}
 		}
-		break;
+		return indices;
 	}
-}
 
-SimpleHeightmap::~SimpleHeightmap()
-{
-	const auto pserver = godot::PhysicsServer3D::get_singleton();
-	if (pserver)
-	{
-		pserver->free_rid(collider_shape_id);
-		pserver->free_rid(collider_body_id);
-	}
-	const auto rserver = godot::RenderingServer::get_singleton();
-	if (rserver != nullptr)
+	uint64_t get_grid_key(const godot::Vector2i& quads, uint8_t lod, uint8_t stitch_mask)
 	{
-		rserver->free_rid(mesh_id);
-		rserver->free_rid(material_id);
-		rserver->free_rid(shader_id);
+		return (static_cast<uint64_t>(quads.x) << 40) | (static_cast<uint64_t>(quads.y) << 16) | (static_cast<uint64_t>(lod) << 8) | stitch_mask;
 	}
-}
 
-namespace
-{
-	constexpr int32_t MAX_UINT_16 = std::numeric_limits<uint16_t>::max();
-	
-	struct CompressedNormalTangent
+	// Index data shared by every chunk of the same size and level of detail, across all heightmaps
+	// Packed arrays are reference counted, so handing one to the RenderingServer doesn't copy it
+	struct SharedIndices
 	{
-		uint16_t na;
-		uint16_t nb;
-		uint16_t ta;
-		uint16_t tb;
+		godot::PackedByteArray data;
+		uint32_t count = 0;
+		uint32_t users = 0;
 	};
+	godot::HashMap<uint64_t, SharedIndices> shared_indices;
 
-	godot::Vector3 generate_tangent_from_normal(const godot::Vector3& normal)
+	const SharedIndices& acquire_shared_indices(const godot::Vector2i& quads, uint8_t lod, uint8_t stitch_mask)
 	{
-		return godot::Vector3(normal.z, -normal.x, normal.y).cross(normal.normalized()).normalized();
+		auto& indices = shared_indices[get_grid_key(quads, lod, stitch_mask)];
+		if (indices.users++ == 0)
+		{
+			const auto vertex_count = static_cast<uint32_t>((quads.x + 1) * (quads.y + 1));
+			indices.data = generate_grid_indices(quads.x, quads.y, lod, stitch_mask);
+			indices.count = static_cast<uint32_t>(indices.data.size() / get_index_element_size(vertex_count));
+		}
+		return indices;
 	}
 
-	CompressedNormalTangent compress_normal(const godot::Vector3& normal)
+	void release_shared_indices(uint64_t key)
 	{
-		CompressedNormalTangent output;
-
-		auto normal_encoded = normal.octahedron_encode();
-		output.na = static_cast<uint16_t>(godot::Math::clamp(static_cast<int32_t>(normal_encoded.x * MAX_UINT_16), 0, MAX_UINT_16));
-		output.nb =	static_cast<uint16_t>(godot::Math::clamp(static_cast<int32_t>(normal_encoded.y * MAX_UINT_16), 0, MAX_UINT_16));
-
-		auto tangent_encoded = generate_tangent_from_normal(normal).octahedron_tangent_encode(1.f);
-		output.ta = static_cast<uint16_t>(godot::Math::clamp(static_cast<int32_t>(tangent_encoded.x * MAX_UINT_16), 0, MAX_UINT_16));
-		output.tb = static_cast<uint16_t>(godot::Math::clamp(static_cast<int32_t>(tangent_encoded.y * MAX_UINT_16), 0, MAX_UINT_16));
-		if (output.ta == 0 && output.tb == MAX_UINT_16)
+		auto indices = shared_indices.getptr(key);
+		if (indices != nullptr && --indices->users == 0)
 		{
-			output.ta = MAX_UINT_16;
+			shared_indices.erase(key);
 		}
-		return output;
 	}
-}
-
-void SimpleHeightmap::rebuild(RebuildFlags flags)
-{
-	constexpr auto ELEMENT_SIZE_POSITION = sizeof(godot::Vector3);
-	constexpr auto ELEMENT_SIZE_NORMAL_TANGENT = sizeof(CompressedNormalTangent);
-	constexpr auto ELEMENT_SIZE_UV = sizeof(godot::Vector2);
-	constexpr auto ELEMENT_SIZE_COLOR = sizeof(int32_t);
 
-	constexpr auto VERTEX_ELEMENT_SIZE = ELEMENT_SIZE_POSITION + ELEMENT_SIZE_NORMAL_TANGENT;
-	constexpr auto ATTRIB_ELEMENT_SIZE = ELEMENT_SIZE_UV + ELEMENT_SIZE_COLOR;
+	// Flat grids for RENDER_MODE_GPU_DISPLACEMENT, shared by every chunk of the same size and level of detail
+	// Vertices are in quad units, the shader scales them and applies the height
+	struct SharedGrid
+	{
+		godot::RID mesh_id;
+		uint32_t users = 0;
+	};
+	godot::HashMap<uint64_t, SharedGrid> shared_grids;
 
-	const auto rserver = godot::RenderingServer::get_singleton();
-	const auto pserver = godot::PhysicsServer3D::get_singleton();
-	if (rserver != nullptr && is_inside_tree() && mesh_id.is_valid() && heightmap.is_valid() && splatmap.is_valid() && mesh_size > CMP_EPSILON)
-	{
-		const auto vertex_count = get_vertex_count();
-		const auto index_count = get_index_count();
-		if (vertex_count != cached_vertex_count || index_count != cached_index_count)
-		{
-			cached_vertex_count = vertex_count;
-			cached_index_count = index_count;
-			
-			// Calculate indices
-			const auto quads_per_side = get_quads_per_side();
-			const auto index_element_size = vertex_count <= std::numeric_limits<uint16_t>::max() ? sizeof(uint16_t) : sizeof(uint32_t);
-			godot::PackedByteArray indices;
-			indices.resize(index_count * index_element_size);
-			const auto indices_p = indices.ptrw();
-			uint32_t ti = 0;
-			uint32_t vi = 0;
-			for (uint32_t z = 0; z < quads_per_side; ++z)
-			{
-				for (uint32_t x = 0; x < quads_per_side; ++x)
+	godot::RID acquire_shared_grid(const godot::Vector2i& quads, uint8_t lod, uint8_t stitch_mask)
+	{
+		auto& grid = shared_grids[get_grid_key(quads, lod, stitch_mask)];
+		if (grid.users++ == 0)
+		{
+			const auto rserver = godot::RenderingServer::get_singleton();
+			const auto vertex_count = static_cast<uint32_t>((quads.x + 1) * (quads.y + 1));
+			const auto& indices = acquire_shared_indices(quads, lod, stitch_mask);
+
+			godot::PackedByteArray vertices;
+			vertices.resize(vertex_count * sizeof(godot::Vector3));
+			auto vertices_p = reinterpret_cast<godot::Vector3*>(vertices.ptrw());
+			for (int32_t z = 0; z <= quads.y; ++z)
+			{
+				for (int32_t x = 0; x <= quads.x; ++x)
 				{
-					uint32_t i1 = vi + 1;
-					uint32_t i2 = vi + quads_per_side + 1;
-					uint32_t i3 = vi;
-					uint32_t i4 = vi + quads_per_side + 2;
-
-					memcpy(&indices_p[ti * index_element_size + (index_element_size * 0)], &i1, index_element_size);
-					memcpy(&indices_p[ti * index_element_size + (index_element_size * 1)], &i2, index_element_size);
-					memcpy(&indices_p[ti * index_element_size + (index_element_size * 2)], &i3, index_element_size);
-					
-					memcpy(&indices_p[ti * index_element_size + (index_element_size * 3)], &i4, index_element_size);
-					memcpy(&indices_p[ti * index_element_size + (index_element_size * 4)], &i2, index_element_size);
-					memcpy(&indices_p[ti * index_element_size + (index_element_size * 5)], &i1, index_element_size);
-					ti += 6;
-					vi += 1;
+					vertices_p[x + z * (quads.x + 1)] = godot::Vector3(x, 0.0, z);
 				}
-				vi += 1;
 			}
 
-			// GDExtension provides only one interface for creating a surface
-			// It must be done through mesh_add_surface_from_arrays or mesh_add_surface
-			// Both of these require "raw" data - it is then converted to GL data
 			constexpr uint64_t surface_format =
 				godot::RenderingServer::ARRAY_FORMAT_VERTEX |
-				godot::RenderingServer::ARRAY_FORMAT_NORMAL |
-				godot::RenderingServer::ARRAY_FORMAT_TANGENT |
-				godot::RenderingServer::ARRAY_FORMAT_COLOR |
-				godot::RenderingServer::ARRAY_FORMAT_TEX_UV |
 				godot::RenderingServer::ARRAY_FORMAT_INDEX |
 				godot::RenderingServer::ARRAY_FLAG_FORMAT_CURRENT_VERSION;
 
-			godot::PackedByteArray temp_vertex_data;
-			temp_vertex_data.resize(VERTEX_ELEMENT_SIZE * vertex_count);
-
-			godot::PackedByteArray temp_attrib_data;
-			temp_attrib_data.resize(ATTRIB_ELEMENT_SIZE * vertex_count);
-			
-			// Required fields to create a surface
 			godot::Dictionary surface_dict;
 			surface_dict["primitive"] = godot::RenderingServer::PrimitiveType::PRIMITIVE_TRIANGLES;
 			surface_dict["format"] = surface_format;
-			surface_dict["vertex_data"] = temp_vertex_data;
+			surface_dict["vertex_data"] = vertices;
 			surface_dict["vertex_count"] = vertex_count;
-			surface_dict["attribute_data"] = temp_attrib_data;
-			surface_dict["index_data"] = indices;
-			surface_dict["index_count"] = index_count;
-			surface_dict["aabb"] = godot::AABB();
-
-			rserver->mesh_clear(mesh_id);
-			rserver->mesh_add_surface(mesh_id, surface_dict);
-			rserver->mesh_surface_set_material(mesh_id, 0, material_id);
-
-			// Cache information to use when updating the mesh
-			const auto surface = rserver->mesh_get_surface(mesh_id, 0);
-			const auto format = static_cast<godot::RenderingServer::ArrayFormat>(static_cast<int64_t>(surface["format"]));
-			surface_offsets.resize(godot::Mesh::ARRAY_MAX);
-			surface_offsets.set(godot::Mesh::ARRAY_VERTEX, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_VERTEX));
-			surface_offsets.set(godot::Mesh::ARRAY_TEX_UV, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_TEX_UV));
-			surface_offsets.set(godot::Mesh::ARRAY_NORMAL, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_NORMAL));
-			surface_offsets.set(godot::Mesh::ARRAY_TANGENT, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_TANGENT));
-			surface_offsets.set(godot::Mesh::ARRAY_COLOR, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_COLOR));
-			surface_vertex_buffer = surface["vertex_data"];
-			surface_attribute_buffer = surface["attribute_data"];
-			surface_vertex_stride = rserver->mesh_surface_get_format_vertex_stride(format, vertex_count);
-			surface_normal_tangent_stride = rserver->mesh_surface_get_format_normal_tangent_stride(format, vertex_count);
-			surface_attribute_stride = rserver->mesh_surface_get_format_attribute_stride(format, vertex_count);
+			surface_dict["index_data"] = indices.data;
+			surface_dict["index_count"] = indices.count;
+			surface_dict["aabb"] = godot::AABB(godot::Vector3(), godot::Vector3(quads.x, 0.0, quads.y));
 
-			if (pserver != nullptr)
+			grid.mesh_id = rserver->mesh_create();
+			rserver->mesh_add_surface(grid.mesh_id, surface_dict);
+		}
+		return grid.mesh_id;
+	}
+
+	void release_shared_grid(const godot::Vector2i& quads, uint8_t lod, uint8_t stitch_mask)
+	{
+		const auto key = get_grid_key(quads, lod, stitch_mask);
+		auto grid = shared_grids.getptr(key);
+		if (grid != nullptr && --grid->users == 0)
+		{
+			const auto rserver = godot::RenderingServer::get_singleton();
+			if (rserver != nullptr)
 			{
-				collider_shape_data.resize(vertex_count);
+				rserver->free_rid(grid->mesh_id);
 			}
+			shared_grids.erase(key);
+			release_shared_indices(key);
 		}
+	}
 
-		const auto vertices_per_side = get_vertices_per_side();
-		const auto quad_size = get_quad_size();
-		const auto uv_scale = quad_size / texture_size;
-
-		auto surface_vertex_buffer_p = surface_vertex_buffer.ptrw();
-		auto surface_attribute_buffer_p = surface_attribute_buffer.ptrw();
-
-		collider_shape_min_height = std::numeric_limits<godot::real_t>::max();
-		collider_shape_max_height = std::numeric_limits<godot::real_t>::min();
+	// Shaders keyed by their code, so each variant is compiled once however many heightmaps draw it
+	// Heightmaps are constructed on loader threads too, the lock covers these and the shared materials
+	struct SharedShader
+	{
+		godot::RID shader_id;
+		uint32_t users = 0;
+	};
+	godot::HashMap<godot::String, SharedShader> shared_shaders;
+	std::mutex shared_shaders_mutex;
 
-		// The first point will always be at 0,0,0
-		auto aabb = godot::AABB(godot::Vector3(), godot::Vector3());
+	godot::RID acquire_shared_shader(const godot::String& code)
+	{
+		const std::lock_guard<std::mutex> lock(shared_shaders_mutex);
+		auto& shader = shared_shaders[code];
+		if (shader.users++ == 0)
+		{
+			const auto rserver = godot::RenderingServer::get_singleton();
+			shader.shader_id = rserver->shader_create();
+			rserver->shader_set_code(shader.shader_id, code);
+		}
+		return shader.shader_id;
+	}
 
-		for (int64_t z = 0; z < vertices_per_side; ++z)
+	void release_shared_shader(const godot::String& code)
+	{
+		const std::lock_guard<std::mutex> lock(shared_shaders_mutex);
+		auto shader = shared_shaders.getptr(code);
+		if (shader != nullptr && --shader->users == 0)
 		{
-			for (int64_t x = 0; x < vertices_per_side; ++x)
+			const auto rserver = godot::RenderingServer::get_singleton();
+			if (rserver != nullptr)
 			{
-				const auto i = (x % vertices_per_side) + (z * vertices_per_side);
-				const auto px = x * quad_size;
-				const auto pz = z * quad_size;
-				if (flags & REBUILD_HEIGHTMAP)
-				{
-					auto position = godot::Vector3(px, bilinear_sample(heightmap, local_position_to_image_position(godot::Vector3(px, 0.0, pz))).r, pz);
-					auto normal = compress_normal(godot::Vector3(0.0, 1.0, 0.0));
-					memcpy(&surface_vertex_buffer_p[i * surface_vertex_stride + surface_offsets[godot::Mesh::ARRAY_VERTEX]], &position, ELEMENT_SIZE_POSITION);
-					memcpy(&surface_vertex_buffer_p[i * surface_normal_tangent_stride + surface_offsets[godot::Mesh::ARRAY_NORMAL]], &normal, ELEMENT_SIZE_NORMAL_TANGENT);
-					aabb.expand_to(position);
-					if (pserver != nullptr)
-					{
-						collider_shape_data.set(i, position.y);
-						collider_shape_min_height = godot::Math::min(position.y, collider_shape_min_height);
-						collider_shape_max_height = godot::Math::max(position.y, collider_shape_max_height);
-					}
-				}
-				if (flags & REBUILD_UV)
-				{
-					auto uv = godot::Vector2(x, z) * uv_scale;
-					memcpy(&surface_attribute_buffer_p[i * surface_attribute_stride + surface_offsets[godot::Mesh::ARRAY_TEX_UV]], &uv, ELEMENT_SIZE_UV);
-				}
-				if (flags & REBUILD_SPLATMAP)
-				{
-					auto color = bilinear_sample(splatmap, local_position_to_image_position(godot::Vector3(px, 0.0, pz))).to_abgr32();
-					memcpy(&surface_attribute_buffer_p[i * surface_attribute_stride + surface_offsets[godot::Mesh::ARRAY_COLOR]], &color, ELEMENT_SIZE_COLOR);
-				}
+				rserver->free_rid(shader->shader_id);
 			}
+			shared_shaders.erase(code);
 		}
-		
-		if (flags & REBUILD_HEIGHTMAP)
+	}
+
+	// Materials keyed by their shader, textures and parameters, the first user fills in the parameters
+	struct SharedMaterial
+	{
+		godot::RID material_id;
+		uint32_t users = 0;
+	};
+	godot::HashMap<godot::String, SharedMaterial> shared_materials;
+
+	godot::RID acquire_shared_material(const godot::String& key, bool& created)
+	{
+		const std::lock_guard<std::mutex> lock(shared_shaders_mutex);
+		auto& material = shared_materials[key];
+		created = material.users++ == 0;
+		if (created)
 		{
-			rserver->mesh_surface_update_vertex_region(mesh_id, 0, 0, surface_vertex_buffer);
-			rserver->mesh_set_custom_aabb(mesh_id, aabb);
+			material.material_id = godot::RenderingServer::get_singleton()->material_create();
+		}
+		return material.material_id;
+	}
 
-			if (pserver != nullptr)
+	void release_shared_material(const godot::String& key)
+	{
+		const std::lock_guard<std::mutex> lock(shared_shaders_mutex);
+		auto material = shared_materials.getptr(key);
+		if (material != nullptr && --material->users == 0)
+		{
+			const auto rserver = godot::RenderingServer::get_singleton();
+			if (rserver != nullptr)
 			{
-				godot::Dictionary collider_dict;
-				collider_dict["width"] = vertices_per_side;
-				collider_dict["depth"] = vertices_per_side;
-				collider_dict["heights"] = collider_shape_data;
-				collider_dict["min_height"] = collider_shape_min_height;
-				collider_dict["max_height"] = collider_shape_max_height;
-				pserver->shape_set_data(collider_shape_id, collider_dict);
-
-				// Update transform/scale of collider shape
-				constexpr godot::real_t COLLIDER_QUAD_SIZE = 1.0;
-				const auto collider_size = COLLIDER_QUAD_SIZE * get_quads_per_side();
-				const auto scale = mesh_size / collider_size;
-				auto collider_shape_transform = godot::Transform3D(
-					godot::Basis::from_scale(godot::Vector3(scale, 1.0, scale)),
-					godot::Vector3(get_half_mesh_size(), 0.0, get_half_mesh_size()));
-				pserver->body_set_shape_transform(collider_body_id, 0, collider_shape_transform);
+				rserver->free_rid(material->material_id);
 			}
+			shared_materials.erase(key);
+		}
+	}
 
-			update_gizmos();
+	// Server objects of heightmaps that left the tree, handed to the next ones instead of freeing and creating them again
+	// Each is reset before it is pooled, so it holds no data and isn't drawn or simulated
+	constexpr uint32_t max_pooled_rids = 1024;
+	struct RIDPool
+	{
+		godot::LocalVector<godot::RID> meshes;
+		godot::LocalVector<godot::RID> instances;
+		godot::LocalVector<godot::RID> shapes;
+		godot::LocalVector<godot::RID> bodies;
+	};
+	RIDPool rid_pool;
+
+	godot::RID take_pooled_rid(godot::LocalVector<godot::RID>& pool)
+	{
+		if (pool.is_empty())
+		{
+			return godot::RID();
 		}
-		if ((flags & REBUILD_UV) || (flags & REBUILD_SPLATMAP))
+		const auto rid = pool[pool.size() - 1];
+		pool.resize(pool.size() - 1);
+		return rid;
+	}
+
+	// Returns false if the pool is full and the caller should free the RID
+	bool pool_rid(godot::LocalVector<godot::RID>& pool, const godot::RID& rid)
+	{
+		if (pool.size() >= max_pooled_rids)
 		{
-			rserver->mesh_surface_update_attribute_region(mesh_id, 0, 0, surface_attribute_buffer);
+			return false;
 		}
+		pool.push_back(rid);
+		return true;
 	}
-}
 
-godot::Vector2 SimpleHeightmap::local_position_to_image_position(const godot::Vector3& local_position) const
-{
-	return godot::Vector2(
-		godot::Math::clamp((local_position.x / mesh_size) * image_size, (godot::real_t)0.0, static_cast<godot::real_t>(image_size)),
-		godot::Math::clamp((local_position.z / mesh_size) * image_size, (godot::real_t)0.0, static_cast<godot::real_t>(image_size))
-	);
-}
+	godot::RID create_mesh(godot::RenderingServer* rserver)
+	{
+		const auto mesh_id = take_pooled_rid(rid_pool.meshes);
+		return mesh_id.is_valid() ? mesh_id : rserver->mesh_create();
+	}
 
-godot::Vector2 SimpleHeightmap::global_position_to_image_position(const godot::Vector3& global_position) const
-{
-	return local_position_to_image_position(to_local(global_position));
-}
+	void free_mesh(godot::RenderingServer* rserver, const godot::RID& mesh_id)
+	{
+		rserver->mesh_clear(mesh_id);
+		if (!pool_rid(rid_pool.meshes, mesh_id))
+		{
+			rserver->free_rid(mesh_id);
+		}
+	}
 
-godot::Vector3 SimpleHeightmap::image_position_to_local_position(const godot::Vector2& image_position) const
-{
-	return godot::Vector3(
-		image_position.x / static_cast<godot::real_t>(image_size) * mesh_size,
-		bilinear_sample(heightmap, image_position).r,
-		image_position.y / static_cast<godot::real_t>(image_size) * mesh_size
-	);
-}
+	godot::RID create_instance(godot::RenderingServer* rserver)
+	{
+		const auto instance_id = take_pooled_rid(rid_pool.instances);
+		return instance_id.is_valid() ? instance_id : rserver->instance_create();
+	}
 
-godot::Vector3 SimpleHeightmap::image_position_to_global_position(const godot::Vector2& image_position) const
-{
-	return to_global(image_position_to_local_position(image_position));
-}
+	void free_instance(godot::RenderingServer* rserver, const godot::RID& instance_id)
+	{
+		rserver->instance_set_base(instance_id, godot::RID());
+		rserver->instance_set_scenario(instance_id, godot::RID());
+		rserver->instance_geometry_set_material_override(instance_id, godot::RID());
+		if (!pool_rid(rid_pool.instances, instance_id))
+		{
+			rserver->free_rid(instance_id);
+		}
+	}
 
-void SimpleHeightmap::set_mesh_size(const godot::real_t value)
-{
-	mesh_size = value;
-	rebuild(REBUILD_ALL);
+	godot::RID create_heightmap_shape(godot::PhysicsServer3D* pserver)
+	{
+		const auto shape_id = take_pooled_rid(rid_pool.shapes);
+		return shape_id.is_valid() ? shape_id : pserver->heightmap_shape_create();
+	}
+
+	void free_heightmap_shape(godot::PhysicsServer3D* pserver, const godot::RID& shape_id)
+	{
+		if (pool_rid(rid_pool.shapes, shape_id))
+		{
+			// The smallest heightmap a shape takes, so a pooled shape doesn't keep a chunk of heights
+			godot::PackedRealArray heights;
+			heights.resize(4);
+			heights.fill(0.0);
+			godot::Dictionary data;
+			data["width"] = 2;
+			data["depth"] = 2;
+			data["heights"] = heights;
+			data["min_height"] = 0.0;
+			data["max_height"] = 0.0;
+			pserver->shape_set_data(shape_id, data);
+		}
+		else
+		{
+			pserver->free_rid(shape_id);
+		}
+	}
 }
 
-void SimpleHeightmap::set_image_size(int value)
+void SimpleHeightmap::free_pooled_resources()
 {
-	image_size = godot::Math::max(value, 1);
-	if (heightmap.is_valid())
-		heightmap->resize(image_size, image_size);
-	if (splatmap.is_valid())
-		splatmap->resize(image_size, image_size);
-	rebuild(REBUILD_ALL);
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver != nullptr)
+	{
+		for (const auto& rid : rid_pool.meshes)
+		{
+			rserver->free_rid(rid);
+		}
+		for (const auto& rid : rid_pool.instances)
+		{
+			rserver->free_rid(rid);
+		}
+	}
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (pserver != nullptr)
+	{
+		for (const auto& rid : rid_pool.shapes)
+		{
+			pserver->free_rid(rid);
+		}
+		for (const auto& rid : rid_pool.bodies)
+		{
+			pserver->free_rid(rid);
+		}
+	}
+	rid_pool = RIDPool();
 }
 
-void SimpleHeightmap::set_texture_size(const godot::real_t value)
+SimpleHeightmap::SimpleHeightmap()
 {
-	texture_size = godot::Math::max(value, static_cast<godot::real_t>(0.01));
-	rebuild(REBUILD_UV);
+	// Nothing is created on the servers until the heightmap enters the tree
+	// ClassDB defaults, duplicates and previews are often freed before they get there
 }
 
-void SimpleHeightmap::set_heightmap_image(const godot::Ref<godot::Image>& new_heightmap)
+void SimpleHeightmap::create_server_resources()
 {
-	heightmap = new_heightmap;
-	initialize_image(heightmap, godot::Image::FORMAT_RF, image_size);
-	rebuild(REBUILD_ALL);
+	if (server_resources)
+	{
+		return;
+	}
+	server_resources = true;
+
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (pserver)
+	{
+		// Pooled bodies keep their mode and pickability
+		collider_body_id = take_pooled_rid(rid_pool.bodies);
+		if (!collider_body_id.is_valid())
+		{
+			collider_body_id = pserver->body_create();
+			pserver->body_set_mode(collider_body_id, godot::PhysicsServer3D::BODY_MODE_STATIC);
+			pserver->body_set_ray_pickable(collider_body_id, true);
+		}
+		pserver->body_attach_object_instance_id(collider_body_id, get_instance_id());
+		pserver->body_set_collision_layer(collider_body_id, collider_layer);
+		pserver->body_set_collision_mask(collider_body_id, collider_mask);
+		pserver->body_set_collision_priority(collider_body_id, collider_priority);
+	}
+	update_layer_texture();
+	update_shader_code();
 }
 
-void SimpleHeightmap::set_splatmap_image(const godot::Ref<godot::Image>& new_splatmap)
+void SimpleHeightmap::release_server_resources()
 {
-	splatmap = new_splatmap;
-	initialize_image(splatmap, godot::Image::FORMAT_RGBA8, image_size, godot::Color(1.0, 0.0, 0.0, 0.0));
-	rebuild(REBUILD_ALL);
+	if (!server_resources)
+	{
+		return;
+	}
+
+	clear_chunks();
+	clear_splat_tiles();
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver != nullptr && layer_texture_id.is_valid())
+	{
+		rserver->free_rid(layer_texture_id);
+	}
+	layer_texture_id = godot::RID();
+	release_material();
+	if (shader_id.is_valid())
+	{
+		release_shared_shader(shader_code);
+	}
+	shader_id = godot::RID();
+	shader_code = godot::String();
+
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (pserver && collider_body_id.is_valid())
+	{
+		pserver->body_set_space(collider_body_id, godot::RID());
+		pserver->body_attach_object_instance_id(collider_body_id, 0);
+		if (!pool_rid(rid_pool.bodies, collider_body_id))
+		{
+			pserver->free_rid(collider_body_id);
+		}
+	}
+	collider_body_id = godot::RID();
+	server_resources = false;
+}
+
+void SimpleHeightmap::_notification(int what)
+{
+	switch (what)
+	{
+		case NOTIFICATION_ENTER_TREE:
+		{
+			create_server_resources();
+
+			// Everything built was released when the heightmap last left the tree, READY only comes the first time
+			if (is_node_ready())
+			{
+				rebuild(REBUILD_ALL);
+			}
+		}
+		break;
+
+		case NOTIFICATION_EXIT_TREE:
+		{
+			release_server_resources();
+		}
+		break;
+
+		case NOTIFICATION_READY:
+		{
+			rebuild(REBUILD_ALL);
+			update_internal_processing();
+		}
+		break;
+
+		case NOTIFICATION_INTERNAL_PROCESS:
+		{
+			flush_rebuild();
+			update_rebuild_task();
+			update_stream();
+			update_lod();
+#ifdef TOOLS_ENABLED
+			if (gizmo_update_queued)
+			{
+				queue_gizmo_update();
+			}
+#endif // TOOLS_ENABLED
+		}
+		break;
+
+		case NOTIFICATION_ENTER_WORLD: // Physics World
+		{
+			// Node3D sends this from its own ENTER_TREE, before ours
+			create_server_resources();
+
+			const auto pserver = godot::PhysicsServer3D::get_singleton();
+			if (pserver && collider_body_id.is_valid())
+			{
+				const auto world = get_world_3d();
+				const auto space = world->get_space();
+				pserver->body_set_space(collider_body_id, space);
+				pserver->body_set_state(collider_body_id, godot::PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+			}
+			update_chunk_instances();
+			update_query_state();
+		}
+		break;
+
+		case NOTIFICATION_TRANSFORM_CHANGED:
+		{
+			const auto pserver = godot::PhysicsServer3D::get_singleton();
+			if (pserver && collider_body_id.is_valid())
+			{
+				pserver->body_set_state(collider_body_id, godot::PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+			}
+			update_chunk_instances();
+			update_query_state();
+		}
+		break;
+
+		case NOTIFICATION_VISIBILITY_CHANGED:
+		{
+			update_chunk_instances();
+		}
+		break;
+
+		case NOTIFICATION_EXIT_WORLD: // Physics World
+		{
+			const auto pserver = godot::PhysicsServer3D::get_singleton();
+			if (pserver && collider_body_id.is_valid())
+			{
+				pserver->body_set_space(collider_body_id, godot::RID());
+			}
+			update_chunk_instances();
+
+			// The copy of the heights would go stale outside the tree
+			clear_query_state();
+		}
+		break;
+	}
+}
+
+SimpleHeightmap::~SimpleHeightmap()
+{
+	release_server_resources();
+}
+
+namespace
+{
+	// Both return the number of bytes uploaded
+	int64_t update_vertex_rows(godot::RenderingServer* rserver, const godot::RID& mesh_id, const godot::PackedByteArray& buffer, uint32_t offset, uint32_t stride, int64_t first_vertex, int64_t end_vertex)
+	{
+		const auto begin = offset + first_vertex * stride;
+		const auto end = offset + end_vertex * stride;
+		rserver->mesh_surface_update_vertex_region(mesh_id, 0, begin, buffer.slice(begin, end));
+		return end - begin;
+	}
+
+	int64_t update_attribute_rows(godot::RenderingServer* rserver, const godot::RID& mesh_id, const godot::PackedByteArray& buffer, uint32_t stride, int64_t first_vertex, int64_t end_vertex)
+	{
+		const auto begin = first_vertex * stride;
+		const auto end = end_vertex * stride;
+		rserver->mesh_surface_update_attribute_region(mesh_id, 0, begin, buffer.slice(begin, end));
+		return end - begin;
+	}
+}
+
+void SimpleHeightmap::rebuild(RebuildFlags flags)
+{
+	rebuild_region(godot::Rect2i(0, 0, image_size, image_size), flags);
+}
+
+void SimpleHeightmap::rebuild_region(const godot::Rect2i& region, RebuildFlags flags)
+{
+	if (!region.has_area())
+	{
+		return;
+	}
+
+	// Picking reads the current image, so this is never deferred
+	if ((flags & REBUILD_HEIGHTMAP) && is_inside_tree() && !is_streaming() && heightmap.is_valid())
+	{
+		height_pyramid.update(get_height_sampler(), region);
+		update_query_state(region);
+	}
+
+	// Setting several properties in a row, or both images on undo, costs a single rebuild
+	queued_rebuild_region = rebuild_queued ? queued_rebuild_region.merge(region) : region;
+	queued_rebuild_flags = static_cast<RebuildFlags>(queued_rebuild_flags | flags);
+	if (!rebuild_queued)
+	{
+		rebuild_queued = true;
+		update_internal_processing();
+	}
+}
+
+void SimpleHeightmap::flush_rebuild()
+{
+	if (!rebuild_queued)
+	{
+		return;
+	}
+
+	const auto region = queued_rebuild_region;
+	const auto flags = queued_rebuild_flags;
+	rebuild_queued = false;
+	queued_rebuild_flags = REBUILD_NONE;
+	run_rebuild(region, flags);
+	update_internal_processing();
+}
+
+void SimpleHeightmap::run_rebuild(const godot::Rect2i& region, RebuildFlags flags)
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (is_streaming())
+	{
+		// Streamed chunks are built by update_stream once the camera is near them, here the ones touched are just marked stale
+		if (rserver != nullptr && is_inside_tree() && mesh_size > CMP_EPSILON && region.has_area())
+		{
+			if (update_chunk_layout())
+			{
+				update_chunk_instances();
+			}
+			const auto vertex_region = godot::Rect2i(region.position - godot::Vector2i(2, 2), region.size + godot::Vector2i(3, 3));
+			for (auto& chunk : chunks)
+			{
+				if (godot::Rect2i(chunk.region.position, chunk.region.size + godot::Vector2i(1, 1)).intersects(vertex_region))
+				{
+					chunk.streamed = false;
+				}
+			}
+		}
+		return;
+	}
+
+	if (rserver != nullptr && is_inside_tree() && heightmap.is_valid() && splatmap.is_valid() && mesh_size > CMP_EPSILON)
+	{
+		// Requests made while an asynchronous rebuild is running are merged into the one that follows it
+		if (rebuild_task_id >= 0)
+		{
+			pending_rebuild_region = pending_rebuild_flags != REBUILD_NONE ? pending_rebuild_region.merge(region) : region;
+			pending_rebuild_flags = static_cast<RebuildFlags>(pending_rebuild_flags | flags);
+			return;
+		}
+
+		// Both images are read directly for the whole rebuild
+		// The samplers keep the image data they started with, even if the images are edited in the meantime
+		const auto height_sampler = get_height_sampler();
+		const SimpleHeightmapSampler splat_sampler(splatmap);
+		ERR_FAIL_COND_MSG(!height_sampler.is_height_format(), "SimpleHeightmap heightmap image must be FORMAT_RF, FORMAT_RH or FORMAT_RG8.");
+		ERR_FAIL_COND_MSG(!splat_sampler.is_color_format(), "SimpleHeightmap splatmap image must be FORMAT_RGBA8.");
+
+		const auto layout_changed = update_chunk_layout();
+		rebuild_upload_bytes = 0;
+
+		// Splat tiles are uploaded right away, only the ones under the region
+		if (uses_splat_texture() && ((flags & REBUILD_SPLATMAP) || !splat_tiles_texture_id.is_valid()))
+		{
+			update_splat_tiles(region);
+			flags = static_cast<RebuildFlags>(flags & ~REBUILD_SPLATMAP);
+			if (flags == REBUILD_NONE && !layout_changed)
+			{
+				emit_signal("rebuild_completed");
+				return;
+			}
+		}
+
+		rebuild_job.height_sampler = height_sampler;
+		rebuild_job.splat_sampler = splat_sampler;
+		rebuild_job.flags = flags;
+		rebuild_job.layout_changed = layout_changed;
+		rebuild_job.quad_size = get_quad_size();
+		rebuild_job.uv_scale = rebuild_job.quad_size / texture_size;
+		rebuild_job.image_step = static_cast<float>(image_size) / static_cast<float>(get_quads_per_side());
+		if (rebuild_job.layout_changed || region.encloses(godot::Rect2i(0, 0, image_size, image_size)))
+		{
+			update_chunk_instances();
+		}
+
+		// Convert the image region into an inclusive range of vertices
+		// A texel affects the vertex on top of it and, through bilinear sampling, the vertex before it
+		// Height changes also affect the normals of the vertices around those
+		const auto border = (flags & REBUILD_HEIGHTMAP) ? 2 : 1;
+		const auto vertex_region = godot::Rect2i(region.position - godot::Vector2i(border, border), region.size + godot::Vector2i(border * 2 - 1, border * 2 - 1));
+		if (get_chunk_render_mode() == RENDER_MODE_GPU_DISPLACEMENT)
+		{
+			for (uint32_t chunk_index = 0; chunk_index < chunks.size(); ++chunk_index)
+			{
+				rebuild_chunk_displacement(chunks[chunk_index], chunk_index, vertex_region, rebuild_job.layout_changed ? REBUILD_ALL : flags, rebuild_job.height_sampler, rebuild_job.splat_sampler);
+			}
+		}
+		else
+		{
+			for (uint32_t chunk_index = 0; chunk_index < chunks.size(); ++chunk_index)
+			{
+				add_chunk_rebuild(chunk_index, vertex_region, flags);
+			}
+		}
+
+		// Colliders are sampled from the heightmap on their own grid, independent of the render mode
+		if ((flags & REBUILD_HEIGHTMAP) || rebuild_job.layout_changed)
+		{
+			for (uint32_t chunk_index = 0; chunk_index < chunks.size(); ++chunk_index)
+			{
+				add_collider_rebuild(chunk_index, vertex_region);
+			}
+		}
+
+		const auto pool = godot::WorkerThreadPool::get_singleton();
+		if (async_rebuild && pool != nullptr && rebuild_job.get_item_count() > 0)
+		{
+			// Picked up by update_rebuild_task once it's done
+			rebuild_task_id = pool->add_task(callable_mp(this, &SimpleHeightmap::run_rebuild_job), false, "SimpleHeightmap async rebuild");
+			update_internal_processing();
+			return;
+		}
+
+		run_rebuild_job();
+		finish_rebuild();
+	}
+}
+
+void SimpleHeightmap::add_chunk_rebuild(uint32_t chunk_index, const godot::Rect2i& vertex_region, RebuildFlags flags)
+{
+	// Surfaces are prepared here, the rows are written in bands on the worker threads and uploaded once they're all done
+	ChunkRebuild chunk_rebuild;
+	if (begin_chunk_rebuild(chunks[chunk_index], chunk_index, vertex_region, flags, chunk_rebuild))
+	{
+		const auto band_rows = static_cast<int32_t>(rebuild_band_rows);
+		chunk_rebuild.first_band = rebuild_job.bands.size();
+		for (int32_t row = chunk_rebuild.first.y; row <= chunk_rebuild.last.y; row += band_rows)
+		{
+			RebuildBand band;
+			band.chunk_rebuild = rebuild_job.chunks.size();
+			band.first_row = row;
+			band.last_row = godot::Math::min(row + band_rows - 1, chunk_rebuild.last.y);
+			rebuild_job.bands.push_back(band);
+		}
+		chunk_rebuild.band_count = rebuild_job.bands.size() - chunk_rebuild.first_band;
+		rebuild_job.chunks.push_back(chunk_rebuild);
+	}
+}
+
+void SimpleHeightmap::add_collider_rebuild(uint32_t chunk_index, const godot::Rect2i& vertex_region)
+{
+	ColliderRebuild collider_rebuild;
+	if (begin_collider_rebuild(chunks[chunk_index], chunk_index, vertex_region, collider_rebuild))
+	{
+		rebuild_job.colliders.push_back(collider_rebuild);
+	}
+}
+
+void SimpleHeightmap::finish_rebuild()
+{
+	for (const auto& chunk_rebuild : rebuild_job.chunks)
+	{
+		end_chunk_rebuild(chunk_rebuild);
+	}
+	for (const auto& collider_rebuild : rebuild_job.colliders)
+	{
+		end_collider_rebuild(collider_rebuild);
+	}
+
+	const auto flags = rebuild_job.flags;
+	if (rebuild_job.layout_changed || (flags & (REBUILD_HEIGHTMAP | REBUILD_UV)))
+	{
+		update_material();
+	}
+	rebuild_job = RebuildJob();
+
+	if (flags & REBUILD_HEIGHTMAP)
+	{
+		queue_gizmo_update();
+	}
+	emit_signal("rebuild_completed");
+}
+
+void SimpleHeightmap::update_rebuild_task()
+{
+	const auto pool = godot::WorkerThreadPool::get_singleton();
+	if (rebuild_task_id < 0 || pool == nullptr || !pool->is_task_completed(rebuild_task_id))
+	{
+		return;
+	}
+
+	pool->wait_for_task_completion(rebuild_task_id);
+	rebuild_task_id = -1;
+	finish_rebuild();
+
+	if (pending_rebuild_flags != REBUILD_NONE)
+	{
+		const auto region = pending_rebuild_region;
+		const auto flags = pending_rebuild_flags;
+		pending_rebuild_flags = REBUILD_NONE;
+		run_rebuild(region, flags);
+	}
+	update_internal_processing();
+}
+
+void SimpleHeightmap::update_internal_processing()
+{
+	auto needed = lod_levels > 0 || rebuild_queued || rebuild_task_id >= 0 || is_streaming();
+#ifdef TOOLS_ENABLED
+	needed = needed || gizmo_update_queued;
+#endif // TOOLS_ENABLED
+	set_process_internal(needed);
+}
+
+void SimpleHeightmap::queue_gizmo_update()
+{
+#ifdef TOOLS_ENABLED
+	// Sculpting rebuilds every frame, the collider gizmo only needs to keep up at a much lower rate
+	constexpr uint64_t gizmo_update_interval_msec = 100;
+	const auto now = godot::Time::get_singleton()->get_ticks_msec();
+	const auto was_queued = gizmo_update_queued;
+	gizmo_update_queued = now - last_gizmo_update_msec < gizmo_update_interval_msec;
+	if (!gizmo_update_queued)
+	{
+		last_gizmo_update_msec = now;
+		update_gizmos();
+	}
+	if (was_queued != gizmo_update_queued)
+	{
+		update_internal_processing();
+	}
+#endif // TOOLS_ENABLED
+}
+
+void SimpleHeightmap::cancel_rebuild_task()
+{
+	const auto pool = godot::WorkerThreadPool::get_singleton();
+	if (rebuild_task_id >= 0 && pool != nullptr)
+	{
+		// Workers write into the job's own buffers, so its results can simply be dropped
+		pool->wait_for_task_completion(rebuild_task_id);
+		rebuild_task_id = -1;
+		rebuild_job = RebuildJob();
+	}
+}
+
+uint32_t SimpleHeightmap::get_quads_per_chunk() const
+{
+	const auto quads_per_chunk = chunk_size > 0 && chunk_size < image_size ? static_cast<uint32_t>(chunk_size) : static_cast<uint32_t>(image_size);
+	if (get_chunk_render_mode() == RENDER_MODE_GPU_DISPLACEMENT)
+	{
+		// Keeps the layer a brush stroke re-uploads small, rather than the whole heightmap
+		return godot::Math::min(quads_per_chunk, max_displacement_chunk_size);
+	}
+	return quads_per_chunk;
+}
+
+bool SimpleHeightmap::update_chunk_layout()
+{
+	const auto quads_per_chunk = get_quads_per_chunk();
+	if (!chunks.is_empty() && cached_quads_per_chunk == quads_per_chunk && cached_chunk_image_size == static_cast<uint32_t>(image_size))
+	{
+		return false;
+	}
+
+	clear_chunks();
+	cached_quads_per_chunk = quads_per_chunk;
+	cached_chunk_image_size = image_size;
+
+	const auto rserver = godot::RenderingServer::get_singleton();
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	const auto chunks_per_side = (static_cast<uint32_t>(image_size) + quads_per_chunk - 1) / quads_per_chunk;
+	const auto shared_meshes = get_chunk_render_mode() == RENDER_MODE_GPU_DISPLACEMENT;
+	const auto compact_vertices = get_chunk_render_mode() == RENDER_MODE_CPU_COMPACT;
+	const auto use_instances = chunks_per_side > 1 || shared_meshes;
+
+	chunks.resize(chunks_per_side * chunks_per_side);
+	for (uint32_t cz = 0; cz < chunks_per_side; ++cz)
+	{
+		for (uint32_t cx = 0; cx < chunks_per_side; ++cx)
+		{
+			auto& chunk = chunks[cx + cz * chunks_per_side];
+
+			// Chunks on the far edges are smaller when the image size is not a multiple of the chunk size
+			const auto position = godot::Vector2i(cx * quads_per_chunk, cz * quads_per_chunk);
+			chunk.region = godot::Rect2i(position, godot::Vector2i(
+				godot::Math::min(static_cast<int32_t>(quads_per_chunk), image_size - position.x),
+				godot::Math::min(static_cast<int32_t>(quads_per_chunk), image_size - position.y)));
+
+			if (rserver != nullptr)
+			{
+				chunk.shared_mesh = shared_meshes;
+				chunk.compact_vertices = compact_vertices;
+				chunk.vertex_colors = !uses_splat_texture();
+				chunk.mesh_id = shared_meshes ? acquire_shared_grid(chunk.region.size, chunk.lod, chunk.stitch_mask) : create_mesh(rserver);
+				if (use_instances)
+				{
+					chunk.instance_id = create_instance(rserver);
+					rserver->instance_set_base(chunk.instance_id, chunk.mesh_id);
+				}
+			}
+			if (pserver != nullptr)
+			{
+				chunk.collider_shape_id = create_heightmap_shape(pserver);
+				pserver->body_add_shape(collider_body_id, chunk.collider_shape_id, godot::Transform3D(), is_streaming());
+			}
+		}
+	}
+
+	// A single chunk is drawn by this node, so it keeps all GeometryInstance3D settings
+	// Shared meshes can't carry this heightmap's material, so those are always drawn by their own instances
+	set_base(use_instances ? godot::RID() : chunks[0].mesh_id);
+
+	if (rserver != nullptr && shared_meshes)
+	{
+		// Placeholder layers, the first rebuild of each chunk fills its own layer
+		const auto layer_size = static_cast<int32_t>(get_displacement_layer_size());
+		godot::TypedArray<godot::Image> height_layers;
+		godot::TypedArray<godot::Image> splat_layers;
+		for (uint32_t i = 0; i < chunks.size(); ++i)
+		{
+			height_layers.push_back(godot::Image::create_empty(layer_size, layer_size, false, godot::Image::FORMAT_RF));
+			splat_layers.push_back(godot::Image::create_empty(layer_size, layer_size, false, godot::Image::FORMAT_RGBA8));
+		}
+		height_texture_id = rserver->texture_2d_layered_create(height_layers, godot::RenderingServer::TEXTURE_LAYERED_2D_ARRAY);
+		rserver->material_set_param(material_id, height_map_param, height_texture_id);
+		if (!uses_splat_texture())
+		{
+			splat_texture_id = rserver->texture_2d_layered_create(splat_layers, godot::RenderingServer::TEXTURE_LAYERED_2D_ARRAY);
+			rserver->material_set_param(material_id, splat_map_param, splat_texture_id);
+		}
+	}
+	return true;
+}
+
+void SimpleHeightmap::clear_chunks()
+{
+	cancel_rebuild_task();
+
+	const auto rserver = godot::RenderingServer::get_singleton();
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (rserver != nullptr && !chunks.is_empty())
+	{
+		set_base(godot::RID());
+	}
+	if (pserver != nullptr && collider_body_id.is_valid())
+	{
+		pserver->body_clear_shapes(collider_body_id);
+	}
+	for (auto& chunk : chunks)
+	{
+		if (rserver != nullptr)
+		{
+			if (chunk.instance_id.is_valid())
+				free_instance(rserver, chunk.instance_id);
+			if (chunk.shared_mesh)
+				release_shared_grid(chunk.region.size, chunk.lod, chunk.stitch_mask);
+			else
+				free_mesh(rserver, chunk.mesh_id);
+		}
+		if (chunk.indices_key != 0)
+		{
+			release_shared_indices(chunk.indices_key);
+		}
+		if (pserver != nullptr && chunk.collider_shape_id.is_valid())
+		{
+			free_heightmap_shape(pserver, chunk.collider_shape_id);
+		}
+	}
+	chunks.clear();
+	cached_quads_per_chunk = 0;
+	cached_chunk_image_size = 0;
+
+	if (rserver != nullptr)
+	{
+		if (height_texture_id.is_valid())
+			rserver->free_rid(height_texture_id);
+		if (splat_texture_id.is_valid())
+			rserver->free_rid(splat_texture_id);
+	}
+	height_texture_id = godot::RID();
+	splat_texture_id = godot::RID();
+}
+
+void SimpleHeightmap::update_chunk_instances()
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver == nullptr)
+	{
+		return;
+	}
+
+	const auto world = is_inside_tree() ? get_world_3d() : godot::Ref<godot::World3D>();
+	const auto scenario = world.is_valid() ? world->get_scenario() : godot::RID();
+	const auto visible = is_inside_tree() && is_visible_in_tree();
+	const auto transform = is_inside_tree() ? get_global_transform() : godot::Transform3D();
+	const auto quad_size = get_quad_size();
+	for (uint32_t chunk_index = 0; chunk_index < chunks.size(); ++chunk_index)
+	{
+		const auto& chunk = chunks[chunk_index];
+		if (chunk.instance_id.is_valid())
+		{
+			const auto origin = godot::Vector3(chunk.region.position.x * quad_size, 0.0, chunk.region.position.y * quad_size);
+			rserver->instance_set_scenario(chunk.instance_id, scenario);
+			rserver->instance_set_transform(chunk.instance_id, transform * godot::Transform3D(godot::Basis(), origin));
+			rserver->instance_set_visible(chunk.instance_id, visible);
+			rserver->instance_set_layer_mask(chunk.instance_id, get_layer_mask());
+			rserver->instance_geometry_set_cast_shadows_setting(chunk.instance_id, static_cast<godot::RenderingServer::ShadowCastingSetting>(get_cast_shadows_setting()));
+			if (chunk.shared_mesh)
+			{
+				rserver->instance_geometry_set_material_override(chunk.instance_id, material_id);
+				rserver->instance_geometry_set_shader_parameter(chunk.instance_id, chunk_layer_param, chunk_index);
+				rserver->instance_geometry_set_shader_parameter(chunk.instance_id, chunk_origin_param, godot::Vector2(chunk.region.position));
+			}
+			else if (chunk.compact_vertices)
+			{
+				rserver->instance_geometry_set_shader_parameter(chunk.instance_id, chunk_origin_param, godot::Vector2(chunk.region.position));
+				rserver->instance_geometry_set_shader_parameter(chunk.instance_id, chunk_columns_param, chunk.get_vertices_per_row());
+			}
+		}
+		else if (chunk.compact_vertices)
+		{
+			// A single chunk is drawn by this node, so it carries the parameters itself
+			set_instance_shader_parameter(chunk_origin_param, godot::Vector2(chunk.region.position));
+			set_instance_shader_parameter(chunk_columns_param, chunk.get_vertices_per_row());
+		}
+	}
+}
+
+namespace
+{
+	constexpr auto ELEMENT_SIZE_POSITION = sizeof(godot::Vector3);
+	constexpr auto ELEMENT_SIZE_NORMAL_TANGENT = sizeof(CompressedNormalTangent);
+	constexpr auto ELEMENT_SIZE_UV = sizeof(godot::Vector2);
+	constexpr auto ELEMENT_SIZE_COLOR = sizeof(int32_t);
+
+	constexpr auto VERTEX_ELEMENT_SIZE = ELEMENT_SIZE_POSITION + ELEMENT_SIZE_NORMAL_TANGENT;
+	constexpr auto ATTRIB_ELEMENT_SIZE = ELEMENT_SIZE_UV + ELEMENT_SIZE_COLOR;
+
+	// RENDER_MODE_CPU_COMPACT stores a 2D vertex of height and packed normal, and the splat weights
+	constexpr auto ELEMENT_SIZE_COMPACT_VERTEX = sizeof(float) * 2;
+	constexpr auto COMPACT_VERTEX_ELEMENT_SIZE = ELEMENT_SIZE_COMPACT_VERTEX;
+	constexpr auto COMPACT_ATTRIB_ELEMENT_SIZE = ELEMENT_SIZE_COLOR;
+}
+
+bool SimpleHeightmap::begin_chunk_rebuild(Chunk& chunk, uint32_t chunk_index, const godot::Rect2i& vertex_region, RebuildFlags flags, ChunkRebuild& chunk_rebuild)
+{
+	// Vertices of this chunk, inclusive of the edge shared with the next chunk
+	const auto chunk_vertices = godot::Rect2i(chunk.region.position, chunk.region.size + godot::Vector2i(1, 1));
+	const auto affected = chunk_vertices.intersection(vertex_region);
+	if (!affected.has_area() || !chunk.mesh_id.is_valid())
+	{
+		return false;
+	}
+
+	const auto rserver = godot::RenderingServer::get_singleton();
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+
+	bool full_rebuild = affected == chunk_vertices;
+	const auto vertex_count = chunk.get_vertex_count();
+	if (vertex_count != chunk.cached_vertex_count)
+	{
+		chunk.cached_vertex_count = vertex_count;
+
+		godot::PackedByteArray temp_vertex_data;
+		temp_vertex_data.resize((chunk.compact_vertices ? COMPACT_VERTEX_ELEMENT_SIZE : VERTEX_ELEMENT_SIZE) * vertex_count);
+
+		godot::PackedByteArray temp_attrib_data;
+		const auto attrib_element_size = (chunk.compact_vertices ? COMPACT_ATTRIB_ELEMENT_SIZE : ATTRIB_ELEMENT_SIZE) - (chunk.vertex_colors ? 0 : ELEMENT_SIZE_COLOR);
+		temp_attrib_data.resize(attrib_element_size * vertex_count);
+
+		add_chunk_surface(chunk, temp_vertex_data, temp_attrib_data);
+
+		// Cache information to use when updating the mesh
+		const auto surface = rserver->mesh_get_surface(chunk.mesh_id, 0);
+		const auto format = static_cast<godot::RenderingServer::ArrayFormat>(static_cast<int64_t>(surface["format"]));
+		chunk.surface_offsets.resize(godot::Mesh::ARRAY_MAX);
+		chunk.surface_offsets.set(godot::Mesh::ARRAY_VERTEX, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_VERTEX));
+		chunk.surface_offsets.set(godot::Mesh::ARRAY_TEX_UV, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_TEX_UV));
+		chunk.surface_offsets.set(godot::Mesh::ARRAY_NORMAL, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_NORMAL));
+		chunk.surface_offsets.set(godot::Mesh::ARRAY_TANGENT, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_TANGENT));
+		chunk.surface_offsets.set(godot::Mesh::ARRAY_COLOR, rserver->mesh_surface_get_format_offset(format, vertex_count, godot::Mesh::ARRAY_COLOR));
+		chunk.surface_vertex_buffer = surface["vertex_data"];
+		chunk.surface_attribute_buffer = surface["attribute_data"];
+		chunk.surface_vertex_stride = rserver->mesh_surface_get_format_vertex_stride(format, vertex_count);
+		chunk.surface_normal_tangent_stride = rserver->mesh_surface_get_format_normal_tangent_stride(format, vertex_count);
+		chunk.surface_attribute_stride = rserver->mesh_surface_get_format_attribute_stride(format, vertex_count);
+
+		// Nothing has been written into the new buffers yet
+		flags = REBUILD_ALL;
+		full_rebuild = true;
+	}
+
+	// A full rebuild recalculates bounds from scratch, a partial rebuild can only widen them
+	if (full_rebuild && (flags & REBUILD_HEIGHTMAP))
+	{
+		// The first point will always be at 0,0,0
+		chunk.aabb = godot::AABB(godot::Vector3(), godot::Vector3());
+	}
+
+	chunk_rebuild.chunk_index = chunk_index;
+	chunk_rebuild.flags = flags;
+	chunk_rebuild.full_rebuild = full_rebuild;
+
+	// Affected vertices in chunk space
+	chunk_rebuild.first = affected.position - chunk.region.position;
+	chunk_rebuild.last = affected.get_end() - chunk.region.position - godot::Vector2i(1, 1);
+
+	// Rows are written into back buffers, which replace the chunk's buffers once the rebuild is finished
+	chunk_rebuild.vertex_buffer = chunk.surface_vertex_buffer;
+	chunk_rebuild.attribute_buffer = chunk.surface_attribute_buffer;
+	if (!async_rebuild)
+	{
+		// Nothing reads the chunk's buffers before a synchronous rebuild finishes, so they are moved instead of copied
+		chunk.surface_vertex_buffer = godot::PackedByteArray();
+		chunk.surface_attribute_buffer = godot::PackedByteArray();
+	}
+
+	// Buffers may still be shared, so they are made unique here rather than on the worker threads
+	chunk_rebuild.vertex_p = chunk_rebuild.vertex_buffer.ptrw();
+	chunk_rebuild.attribute_p = chunk_rebuild.attribute_buffer.ptrw();
+	return true;
+}
+
+void SimpleHeightmap::rebuild_band(uint32_t band_index)
+{
+	auto& band = rebuild_job.bands[band_index];
+	const auto& chunk_rebuild = rebuild_job.chunks[band.chunk_rebuild];
+	const auto& chunk = chunks[chunk_rebuild.chunk_index];
+	const auto& height_sampler = rebuild_job.height_sampler;
+	const auto& splat_sampler = rebuild_job.splat_sampler;
+	const auto flags = chunk_rebuild.flags;
+	const auto first = chunk_rebuild.first;
+	const auto last = chunk_rebuild.last;
+
+	const auto vertices_per_row = chunk.get_vertices_per_row();
+	const auto quad_size = rebuild_job.quad_size;
+	const auto uv_scale = rebuild_job.uv_scale;
+
+	band.min_height = std::numeric_limits<godot::real_t>::max();
+	band.max_height = std::numeric_limits<godot::real_t>::lowest();
+
+	const auto image_step = rebuild_job.image_step;
+	const auto row_count = last.x - first.x + 1;
+	const auto image_origin = rebuild_job.image_origin;
+	const auto image_x = static_cast<float>(first.x + chunk.region.position.x) * image_step - static_cast<float>(image_origin.x);
+	const auto sample_heights = [&](int64_t z, float* out)
+	{
+		// One extra height on each side of the row for the normals
+		const auto image_y = static_cast<float>(z + chunk.region.position.y) * image_step - static_cast<float>(image_origin.y);
+		height_sampler.sample_height_row(image_x - image_step, image_step, image_y, row_count + 2, out);
+	};
+
+	// Rolling window of the rows above, on and below the current row
+	godot::LocalVector<float> height_rows[3];
+	godot::LocalVector<CompressedNormalTangent> row_normals;
+	godot::LocalVector<uint32_t> row_colors;
+	if (flags & REBUILD_HEIGHTMAP)
+	{
+		for (auto& row : height_rows)
+		{
+			row.resize(row_count + 2);
+		}
+		row_normals.resize(row_count);
+		sample_heights(band.first_row - 1, height_rows[0].ptr());
+		sample_heights(band.first_row, height_rows[1].ptr());
+	}
+	row_colors.resize(row_count);
+
+	float* above = height_rows[0].ptr();
+	float* center = height_rows[1].ptr();
+	float* below = height_rows[2].ptr();
+
+	for (int64_t z = band.first_row; z <= band.last_row; ++z)
+	{
+		const auto gz = z + chunk.region.position.y;
+		if (flags & REBUILD_HEIGHTMAP)
+		{
+			sample_heights(z + 1, below);
+			SimpleHeightmapNormals::compute_row(above, center, below, row_count, quad_size, row_normals.ptr());
+		}
+		if ((flags & REBUILD_SPLATMAP) && chunk.vertex_colors)
+		{
+			splat_sampler.sample_color_row(image_x, image_step, static_cast<float>(gz) * image_step - static_cast<float>(image_origin.y), row_count, row_colors.ptr());
+		}
+
+		for (int64_t x = first.x; x <= last.x; ++x)
+		{
+			const auto i = x + (z * vertices_per_row);
+			const auto j = x - first.x;
+			const auto gx = x + chunk.region.position.x;
+			const auto px = x * quad_size;
+			const auto pz = z * quad_size;
+			if ((flags & REBUILD_HEIGHTMAP) && chunk.compact_vertices)
+			{
+				const float vertex[2] = { center[j + 1], SimpleHeightmapNormals::pack_compact_normal(row_normals[j]) };
+				memcpy(&chunk_rebuild.vertex_p[i * chunk.surface_vertex_stride + chunk.surface_offsets[godot::Mesh::ARRAY_VERTEX]], vertex, ELEMENT_SIZE_COMPACT_VERTEX);
+				band.min_height = godot::Math::min(static_cast<godot::real_t>(vertex[0]), band.min_height);
+				band.max_height = godot::Math::max(static_cast<godot::real_t>(vertex[0]), band.max_height);
+			}
+			else if (flags & REBUILD_HEIGHTMAP)
+			{
+				auto position = godot::Vector3(px, center[j + 1], pz);
+				memcpy(&chunk_rebuild.vertex_p[i * chunk.surface_vertex_stride + chunk.surface_offsets[godot::Mesh::ARRAY_VERTEX]], &position, ELEMENT_SIZE_POSITION);
+				memcpy(&chunk_rebuild.vertex_p[i * chunk.surface_normal_tangent_stride + chunk.surface_offsets[godot::Mesh::ARRAY_NORMAL]], &row_normals[j], ELEMENT_SIZE_NORMAL_TANGENT);
+				band.min_height = godot::Math::min(position.y, band.min_height);
+				band.max_height = godot::Math::max(position.y, band.max_height);
+			}
+			if ((flags & REBUILD_UV) && !chunk.compact_vertices)
+			{
+				auto uv = godot::Vector2(gx, gz) * uv_scale;
+				memcpy(&chunk_rebuild.attribute_p[i * chunk.surface_attribute_stride + chunk.surface_offsets[godot::Mesh::ARRAY_TEX_UV]], &uv, ELEMENT_SIZE_UV);
+			}
+			if ((flags & REBUILD_SPLATMAP) && chunk.vertex_colors)
+			{
+				memcpy(&chunk_rebuild.attribute_p[i * chunk.surface_attribute_stride + chunk.surface_offsets[godot::Mesh::ARRAY_COLOR]], &row_colors[j], ELEMENT_SIZE_COLOR);
+			}
+		}
+
+		// Shift the window down a row
+		const auto recycled = above;
+		above = center;
+		center = below;
+		below = recycled;
+	}
+}
+
+void SimpleHeightmap::rebuild_job_item(uint32_t item_index)
+{
+	// Mesh bands come first, then the chunk colliders
+	if (item_index < rebuild_job.bands.size())
+	{
+		rebuild_band(item_index);
+	}
+	else
+	{
+		rebuild_collider(item_index - rebuild_job.bands.size());
+	}
+}
+
+void SimpleHeightmap::run_rebuild_job()
+{
+	const auto item_count = rebuild_job.get_item_count();
+	const auto pool = godot::WorkerThreadPool::get_singleton();
+	if (item_count > 1 && rebuild_thread_limit != 1 && pool != nullptr)
+	{
+		// The main thread waits for the result, so the items go ahead of other queued work
+		const auto task_id = pool->add_group_task(callable_mp(this, &SimpleHeightmap::rebuild_job_item), item_count, rebuild_thread_limit > 0 ? rebuild_thread_limit : -1, true, "SimpleHeightmap rebuild");
+		pool->wait_for_group_task_completion(task_id);
+	}
+	else
+	{
+		for (uint32_t item_index = 0; item_index < item_count; ++item_index)
+		{
+			rebuild_job_item(item_index);
+		}
+	}
+}
+
+void SimpleHeightmap::end_chunk_rebuild(const ChunkRebuild& chunk_rebuild)
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	auto& chunk = chunks[chunk_rebuild.chunk_index];
+	const auto flags = chunk_rebuild.flags;
+	const auto first = chunk_rebuild.first;
+	const auto last = chunk_rebuild.last;
+
+	chunk.surface_vertex_buffer = chunk_rebuild.vertex_buffer;
+	chunk.surface_attribute_buffer = chunk_rebuild.attribute_buffer;
+
+	// Rows are contiguous in every stream, so only the rows that were touched are uploaded
+	const auto vertices_per_row = chunk.get_vertices_per_row();
+	const auto first_vertex = static_cast<int64_t>(first.y) * vertices_per_row;
+	const auto end_vertex = static_cast<int64_t>(last.y + 1) * vertices_per_row;
+
+	if (flags & REBUILD_HEIGHTMAP)
+	{
+		// Each band only knows the height range of its own rows
+		const auto quad_size = rebuild_job.quad_size;
+		for (uint32_t band_index = chunk_rebuild.first_band; band_index < chunk_rebuild.first_band + chunk_rebuild.band_count; ++band_index)
+		{
+			const auto& band = rebuild_job.bands[band_index];
+			chunk.aabb.merge_with(godot::AABB(
+				godot::Vector3(first.x * quad_size, band.min_height, band.first_row * quad_size),
+				godot::Vector3((last.x - first.x) * quad_size, band.max_height - band.min_height, (band.last_row - band.first_row) * quad_size)));
+		}
+
+		if (chunk_rebuild.full_rebuild)
+		{
+			rserver->mesh_surface_update_vertex_region(chunk.mesh_id, 0, 0, chunk.surface_vertex_buffer);
+			rebuild_upload_bytes += chunk.surface_vertex_buffer.size();
+		}
+		else
+		{
+			rebuild_upload_bytes += update_vertex_rows(rserver, chunk.mesh_id, chunk.surface_vertex_buffer, chunk.surface_offsets[godot::Mesh::ARRAY_VERTEX], chunk.surface_vertex_stride, first_vertex, end_vertex);
+			if (!chunk.compact_vertices)
+			{
+				// Compact vertices carry their normal in the position stream
+				rebuild_upload_bytes += update_vertex_rows(rserver, chunk.mesh_id, chunk.surface_vertex_buffer, chunk.surface_offsets[godot::Mesh::ARRAY_NORMAL], chunk.surface_normal_tangent_stride, first_vertex, end_vertex);
+			}
+		}
+		rserver->mesh_set_custom_aabb(chunk.mesh_id, chunk.aabb);
+	}
+	// Compact vertices have no UVs, the shader derives them, and splat weights may come from the splat tiles instead
+	if (((flags & REBUILD_SPLATMAP) && chunk.vertex_colors) || ((flags & REBUILD_UV) && !chunk.compact_vertices))
+	{
+		if (chunk_rebuild.full_rebuild)
+		{
+			rserver->mesh_surface_update_attribute_region(chunk.mesh_id, 0, 0, chunk.surface_attribute_buffer);
+			rebuild_upload_bytes += chunk.surface_attribute_buffer.size();
+		}
+		else
+		{
+			rebuild_upload_bytes += update_attribute_rows(rserver, chunk.mesh_id, chunk.surface_attribute_buffer, chunk.surface_attribute_stride, first_vertex, end_vertex);
+		}
+	}
+}
+
+void SimpleHeightmap::add_chunk_surface(Chunk& chunk, const godot::PackedByteArray& vertex_data, const godot::PackedByteArray& attribute_data)
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	const auto vertex_count = chunk.get_vertex_count();
+
+	// Take the new indices before letting go of the old ones, they are often the same
+	const auto indices_key = get_grid_key(chunk.region.size, chunk.lod, chunk.stitch_mask);
+	const auto& indices = acquire_shared_indices(chunk.region.size, chunk.lod, chunk.stitch_mask);
+	if (chunk.indices_key != 0)
+	{
+		release_shared_indices(chunk.indices_key);
+	}
+	chunk.indices_key = indices_key;
+
+	// GDExtension provides only one interface for creating a surface
+	// It must be done through mesh_add_surface_from_arrays or mesh_add_surface
+	// Both of these require "raw" data - it is then converted to GL data
+	constexpr uint64_t full_surface_format =
+		godot::RenderingServer::ARRAY_FORMAT_VERTEX |
+		godot::RenderingServer::ARRAY_FORMAT_NORMAL |
+		godot::RenderingServer::ARRAY_FORMAT_TANGENT |
+		godot::RenderingServer::ARRAY_FORMAT_COLOR |
+		godot::RenderingServer::ARRAY_FORMAT_TEX_UV |
+		godot::RenderingServer::ARRAY_FORMAT_INDEX |
+		godot::RenderingServer::ARRAY_FLAG_FORMAT_CURRENT_VERSION;
+
+	// Compact vertices are 2D, x holds the height and y the packed normal
+	constexpr uint64_t compact_surface_format =
+		godot::RenderingServer::ARRAY_FORMAT_VERTEX |
+		godot::RenderingServer::ARRAY_FORMAT_COLOR |
+		godot::RenderingServer::ARRAY_FORMAT_INDEX |
+		godot::RenderingServer::ARRAY_FLAG_USE_2D_VERTICES |
+		godot::RenderingServer::ARRAY_FLAG_FORMAT_CURRENT_VERSION;
+	auto surface_format = chunk.compact_vertices ? compact_surface_format : full_surface_format;
+	if (!chunk.vertex_colors)
+	{
+		surface_format &= ~static_cast<uint64_t>(godot::RenderingServer::ARRAY_FORMAT_COLOR);
+	}
+
+	// Required fields to create a surface
+	godot::Dictionary surface_dict;
+	surface_dict["primitive"] = godot::RenderingServer::PrimitiveType::PRIMITIVE_TRIANGLES;
+	surface_dict["format"] = surface_format;
+	surface_dict["vertex_data"] = vertex_data;
+	surface_dict["vertex_count"] = vertex_count;
+	surface_dict["attribute_data"] = attribute_data;
+	surface_dict["index_data"] = indices.data;
+	surface_dict["index_count"] = indices.count;
+	surface_dict["aabb"] = chunk.aabb;
+
+	rserver->mesh_clear(chunk.mesh_id);
+	rserver->mesh_add_surface(chunk.mesh_id, surface_dict);
+	rserver->mesh_surface_set_material(chunk.mesh_id, 0, material_id);
+	rserver->mesh_set_custom_aabb(chunk.mesh_id, chunk.aabb);
+}
+
+void SimpleHeightmap::set_chunk_lod(Chunk& chunk, uint8_t lod, uint8_t stitch_mask)
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver == nullptr || (chunk.lod == lod && chunk.stitch_mask == stitch_mask))
+	{
+		return;
+	}
+
+	if (chunk.shared_mesh)
+	{
+		// Every variant is a separate shared grid, the instance just switches between them
+		const auto mesh_id = acquire_shared_grid(chunk.region.size, lod, stitch_mask);
+		release_shared_grid(chunk.region.size, chunk.lod, chunk.stitch_mask);
+		chunk.mesh_id = mesh_id;
+		chunk.lod = lod;
+		chunk.stitch_mask = stitch_mask;
+		rserver->instance_set_base(chunk.instance_id, chunk.mesh_id);
+		rserver->instance_set_custom_aabb(chunk.instance_id, chunk.aabb);
+	}
+	else
+	{
+		chunk.lod = lod;
+		chunk.stitch_mask = stitch_mask;
+
+		// Only the indices change, the surface is re-added with the vertices it already has
+		if (chunk.cached_vertex_count != 0)
+		{
+			add_chunk_surface(chunk, chunk.surface_vertex_buffer, chunk.surface_attribute_buffer);
+		}
+	}
+}
+
+godot::Camera3D* SimpleHeightmap::get_active_camera() const
+{
+#ifdef TOOLS_ENABLED
+	// The editor draws the scene through its own viewports
+	if (godot::Engine::get_singleton()->is_editor_hint())
+	{
+		const auto editor_viewport = godot::EditorInterface::get_singleton()->get_editor_viewport_3d(0);
+		return editor_viewport != nullptr ? editor_viewport->get_camera_3d() : nullptr;
+	}
+#endif
+	const auto viewport = get_viewport();
+	return viewport != nullptr ? viewport->get_camera_3d() : nullptr;
+}
+
+void SimpleHeightmap::update_lod()
+{
+	if (chunks.is_empty() || !is_inside_tree())
+	{
+		return;
+	}
+
+	const auto camera = get_active_camera();
+	if (camera == nullptr)
+	{
+		return;
+	}
+
+	const auto camera_position = to_local(camera->get_global_position());
+	const auto quad_size = get_quad_size();
+	const auto chunks_per_side = (cached_chunk_image_size + cached_quads_per_chunk - 1) / cached_quads_per_chunk;
+
+	// Each level halves the resolution and doubles the distance it is used from
+	godot::LocalVector<uint8_t> lods;
+	lods.resize(chunks.size());
+	for (uint32_t i = 0; i < chunks.size(); ++i)
+	{
+		const auto& chunk = chunks[i];
+		const auto origin = godot::Vector3(chunk.region.position.x * quad_size, 0.0, chunk.region.position.y * quad_size);
+		const auto nearest = camera_position.clamp(origin + chunk.aabb.position, origin + chunk.aabb.get_end());
+		const auto distance = camera_position.distance_to(nearest);
+		const auto max_lod = chunk.get_max_lod(lod_levels);
+
+		uint8_t lod = 0;
+		while (lod < max_lod && distance > lod_distance * static_cast<godot::real_t>(1 << lod))
+			++lod;
+		lods[i] = lod;
+	}
+
+	// Neighbours may only differ by one level, so each side needs just one stitching variant
+	auto changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (uint32_t i = 0; i < chunks.size(); ++i)
+		{
+			const auto cx = i % chunks_per_side;
+			const auto cz = i / chunks_per_side;
+			const auto limit = [&](uint32_t neighbour)
+			{
+				if (lods[i] > lods[neighbour] + 1)
+				{
+					lods[i] = lods[neighbour] + 1;
+					changed = true;
+				}
+			};
+			if (cx > 0) limit(i - 1);
+			if (cx + 1 < chunks_per_side) limit(i + 1);
+			if (cz > 0) limit(i - chunks_per_side);
+			if (cz + 1 < chunks_per_side) limit(i + chunks_per_side);
+		}
+	}
+
+	for (uint32_t i = 0; i < chunks.size(); ++i)
+	{
+		const auto cx = i % chunks_per_side;
+		const auto cz = i / chunks_per_side;
+		uint8_t stitch_mask = 0;
+		if (cx > 0 && lods[i - 1] > lods[i]) stitch_mask |= STITCH_NEGATIVE_X;
+		if (cx + 1 < chunks_per_side && lods[i + 1] > lods[i]) stitch_mask |= STITCH_POSITIVE_X;
+		if (cz > 0 && lods[i - chunks_per_side] > lods[i]) stitch_mask |= STITCH_NEGATIVE_Z;
+		if (cz + 1 < chunks_per_side && lods[i + chunks_per_side] > lods[i]) stitch_mask |= STITCH_POSITIVE_Z;
+		set_chunk_lod(chunks[i], lods[i], stitch_mask);
+	}
+}
+
+void SimpleHeightmap::update_stream()
+{
+	if (!is_streaming() || chunks.is_empty() || !is_inside_tree() || rebuild_task_id >= 0)
+	{
+		return;
+	}
+
+	const auto camera = get_active_camera();
+	if (camera == nullptr)
+	{
+		return;
+	}
+
+	// Distance over the ground, chunks that aren't built yet have no heights to measure from
+	const auto camera_position = to_local(camera->get_global_position());
+	const auto camera_point = godot::Vector2(camera_position.x, camera_position.z);
+	const auto quad_size = get_quad_size();
+	godot::LocalVector<godot::real_t> distances;
+	distances.resize(chunks.size());
+	for (uint32_t i = 0; i < chunks.size(); ++i)
+	{
+		const auto& region = chunks[i].region;
+		const auto position = godot::Vector2(region.position) * quad_size;
+		const auto nearest = camera_point.clamp(position, position + godot::Vector2(region.size) * quad_size);
+		distances[i] = camera_point.distance_to(nearest);
+	}
+
+	// Nearest chunks first, only a few each frame so loading is spread out rather than stalling one frame
+	constexpr uint32_t chunks_per_frame = 4;
+	for (uint32_t built = 0; built < chunks_per_frame; ++built)
+	{
+		auto nearest_index = chunks.size();
+		for (uint32_t i = 0; i < chunks.size(); ++i)
+		{
+			if (!chunks[i].streamed && distances[i] <= stream_distance && (nearest_index == chunks.size() || distances[i] < distances[nearest_index]))
+			{
+				nearest_index = i;
+			}
+		}
+		if (nearest_index == chunks.size() || !build_streamed_chunk(nearest_index))
+		{
+			break;
+		}
+	}
+
+	// Stale chunks out of range are never rebuilt, so they're dropped straight away
+	uint64_t resident_bytes = 0;
+	for (uint32_t i = 0; i < chunks.size(); ++i)
+	{
+		if (chunks[i].cached_vertex_count != 0 && !chunks[i].streamed && distances[i] > stream_distance)
+		{
+			release_streamed_chunk(i);
+		}
+		resident_bytes += chunks[i].get_resident_bytes();
+	}
+
+	// Built chunks come first, decoded tiles only save rereading the borders shared with chunks built later
+	const auto budget = static_cast<uint64_t>(stream_memory_budget) * 1024 * 1024;
+	stream.trim_cache(budget > resident_bytes ? budget - resident_bytes : 0);
+
+	// Past the budget the farthest chunks out of range are dropped, chunks in range stay whatever they cost
+	while (resident_bytes > budget)
+	{
+		auto farthest_index = chunks.size();
+		for (uint32_t i = 0; i < chunks.size(); ++i)
+		{
+			if (chunks[i].cached_vertex_count != 0 && distances[i] > stream_distance && (farthest_index == chunks.size() || distances[i] > distances[farthest_index]))
+			{
+				farthest_index = i;
+			}
+		}
+		if (farthest_index == chunks.size())
+		{
+			break;
+		}
+		resident_bytes -= chunks[farthest_index].get_resident_bytes();
+		release_streamed_chunk(farthest_index);
+	}
+}
+
+bool SimpleHeightmap::build_streamed_chunk(uint32_t chunk_index)
+{
+	auto& chunk = chunks[chunk_index];
+
+	// Only the pixels this chunk samples are read, its vertices plus the neighbours its normals and bilinear samples need
+	const auto window = godot::Rect2i(chunk.region.position - godot::Vector2i(1, 1), chunk.region.size + godot::Vector2i(4, 4));
+	const auto heights = stream.read_heights(window);
+	ERR_FAIL_COND_V(heights.is_null(), false);
+	auto splat = stream.get_splatmap_size() == stream.get_heightmap_size() ? stream.read_splat(window) : godot::Ref<godot::Image>();
+	if (splat.is_null())
+	{
+		splat = godot::Image::create_empty(window.size.x, window.size.y, false, godot::Image::FORMAT_RGBA8);
+		splat->fill(godot::Color(1.0, 0.0, 0.0, 0.0));
+	}
+
+	rebuild_job.height_sampler = SimpleHeightmapSampler(heights);
+	rebuild_job.splat_sampler = SimpleHeightmapSampler(splat);
+	rebuild_job.image_origin = window.position;
+	rebuild_job.flags = REBUILD_ALL;
+	rebuild_job.quad_size = get_quad_size();
+	rebuild_job.uv_scale = rebuild_job.quad_size / texture_size;
+	rebuild_job.image_step = static_cast<float>(image_size) / static_cast<float>(get_quads_per_side());
+
+	const auto vertex_region = godot::Rect2i(chunk.region.position, chunk.region.size + godot::Vector2i(1, 1));
+	rebuild_upload_bytes = 0;
+	add_chunk_rebuild(chunk_index, vertex_region, REBUILD_ALL);
+	add_collider_rebuild(chunk_index, vertex_region);
+	run_rebuild_job();
+	finish_rebuild();
+
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (pserver != nullptr && chunk.collider_shape_id.is_valid())
+	{
+		pserver->body_set_shape_disabled(collider_body_id, chunk_index, false);
+	}
+	chunk.streamed = true;
+	return true;
+}
+
+void SimpleHeightmap::release_streamed_chunk(uint32_t chunk_index)
+{
+	auto& chunk = chunks[chunk_index];
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver != nullptr && chunk.mesh_id.is_valid())
+	{
+		rserver->mesh_clear(chunk.mesh_id);
+	}
+	if (chunk.indices_key != 0)
+	{
+		release_shared_indices(chunk.indices_key);
+		chunk.indices_key = 0;
+	}
+	chunk.cached_vertex_count = 0;
+	chunk.surface_vertex_buffer = godot::PackedByteArray();
+	chunk.surface_attribute_buffer = godot::PackedByteArray();
+	chunk.aabb = godot::AABB();
+
+	// The shape keeps its place in the body so shape indices still match chunk indices, it just holds nothing
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (pserver != nullptr && chunk.collider_shape_id.is_valid())
+	{
+		pserver->body_set_shape_disabled(collider_body_id, chunk_index, true);
+		godot::PackedRealArray empty_heights;
+		empty_heights.resize(4);
+		empty_heights.fill(0.0);
+		chunk.collider_shape_dict = godot::Dictionary();
+		chunk.collider_shape_dict["width"] = 2;
+		chunk.collider_shape_dict["depth"] = 2;
+		chunk.collider_shape_dict["heights"] = empty_heights;
+		chunk.collider_shape_dict["min_height"] = 0.0;
+		chunk.collider_shape_dict["max_height"] = 0.0;
+		pserver->shape_set_data(chunk.collider_shape_id, chunk.collider_shape_dict);
+	}
+	chunk.collider_shape_data = godot::PackedRealArray();
+	chunk.collider_size = godot::Vector2i();
+	++chunk.collider_version;
+	chunk.streamed = false;
+	queue_gizmo_update();
+}
+
+void SimpleHeightmap::rebuild_chunk_displacement(Chunk& chunk, uint32_t chunk_index, const godot::Rect2i& vertex_region, RebuildFlags flags, const SimpleHeightmapSampler& height_sampler, const SimpleHeightmapSampler& splat_sampler)
+{
+	// Layers have a one vertex border, so changes just outside the chunk still reach its normals
+	const auto layer_vertices = godot::Rect2i(chunk.region.position - godot::Vector2i(1, 1), chunk.region.size + godot::Vector2i(3, 3));
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (!layer_vertices.intersects(vertex_region) || !height_texture_id.is_valid())
+	{
+		return;
+	}
+
+	// Only this chunk's layer is uploaded
+	if (flags & REBUILD_HEIGHTMAP)
+	{
+		const auto layer = create_height_layer(chunk, height_sampler);
+		rserver->texture_2d_update(height_texture_id, layer, chunk_index);
+		rserver->instance_set_custom_aabb(chunk.instance_id, chunk.aabb);
+		rebuild_upload_bytes += layer->get_data().size();
+	}
+	if ((flags & REBUILD_SPLATMAP) && splat_texture_id.is_valid())
+	{
+		const auto layer = create_splat_layer(chunk, splat_sampler);
+		rserver->texture_2d_update(splat_texture_id, layer, chunk_index);
+		rebuild_upload_bytes += layer->get_data().size();
+	}
+}
+
+godot::Ref<godot::Image> SimpleHeightmap::create_height_layer(Chunk& chunk, const SimpleHeightmapSampler& height_sampler)
+{
+	const auto layer_size = static_cast<int32_t>(get_displacement_layer_size());
+	const auto image_step = static_cast<float>(image_size) / static_cast<float>(get_quads_per_side());
+	const auto image_x = static_cast<float>(chunk.region.position.x - 1) * image_step;
+
+	godot::PackedByteArray data;
+	data.resize(layer_size * layer_size * sizeof(float));
+	const auto data_p = reinterpret_cast<float*>(data.ptrw());
+
+	auto min_height = std::numeric_limits<godot::real_t>::max();
+	auto max_height = std::numeric_limits<godot::real_t>::lowest();
+
+	for (int32_t row = 0; row < layer_size; ++row)
+	{
+		const auto row_p = &data_p[row * layer_size];
+		const auto image_y = static_cast<float>(chunk.region.position.y - 1 + row) * image_step;
+		height_sampler.sample_height_row(image_x, image_step, image_y, layer_size, row_p);
+
+		// Border rows and columns, and the unused part of smaller edge chunks, are only sampled for normals
+		const auto z = row - 1;
+		if (z < 0 || z > chunk.region.size.y)
+		{
+			continue;
+		}
+		for (int32_t x = 0; x <= chunk.region.size.x; ++x)
+		{
+			const auto height = static_cast<godot::real_t>(row_p[x + 1]);
+			min_height = godot::Math::min(height, min_height);
+			max_height = godot::Math::max(height, max_height);
+		}
+	}
+
+	const auto quad_size = get_quad_size();
+	chunk.aabb = godot::AABB(
+		godot::Vector3(0.0, min_height, 0.0),
+		godot::Vector3(chunk.region.size.x * quad_size, max_height - min_height, chunk.region.size.y * quad_size));
+
+	return godot::Image::create_from_data(layer_size, layer_size, false, godot::Image::FORMAT_RF, data);
+}
+
+godot::Ref<godot::Image> SimpleHeightmap::create_splat_layer(const Chunk& chunk, const SimpleHeightmapSampler& splat_sampler) const
+{
+	const auto layer_size = static_cast<int32_t>(get_displacement_layer_size());
+	const auto image_step = static_cast<float>(image_size) / static_cast<float>(get_quads_per_side());
+	const auto image_x = static_cast<float>(chunk.region.position.x - 1) * image_step;
+
+	godot::PackedByteArray data;
+	data.resize(layer_size * layer_size * sizeof(uint32_t));
+	const auto data_p = reinterpret_cast<uint32_t*>(data.ptrw());
+	for (int32_t row = 0; row < layer_size; ++row)
+	{
+		const auto image_y = static_cast<float>(chunk.region.position.y - 1 + row) * image_step;
+		splat_sampler.sample_color_row(image_x, image_step, image_y, layer_size, &data_p[row * layer_size]);
+	}
+
+	return godot::Image::create_from_data(layer_size, layer_size, false, godot::Image::FORMAT_RGBA8, data);
+}
+
+void SimpleHeightmap::update_splat_tiles(const godot::Rect2i& region)
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	ERR_FAIL_COND(rserver == nullptr || splatmap.is_null() || splatmap->is_empty() || splatmap->get_format() != godot::Image::FORMAT_RGBA8);
+
+	const auto size = splatmap->get_size();
+	const auto tile_counts = (size + godot::Vector2i(splat_tile_size - 1, splat_tile_size - 1)) / splat_tile_size;
+	const auto layer_size = splat_tile_size + 1;
+	const auto pixels = reinterpret_cast<const uint32_t*>(splatmap->ptr());
+	const auto create_tile = [&](int32_t tile_x, int32_t tile_y)
+	{
+		// Pixels past the edge of the splatmap repeat the last row or column
+		godot::PackedByteArray data;
+		data.resize(layer_size * layer_size * sizeof(uint32_t));
+		const auto data_p = reinterpret_cast<uint32_t*>(data.ptrw());
+		for (int32_t row = 0; row < layer_size; ++row)
+		{
+			const auto image_row = pixels + static_cast<int64_t>(godot::Math::min(tile_y * splat_tile_size + row, size.y - 1)) * size.x;
+			for (int32_t column = 0; column < layer_size; ++column)
+			{
+				data_p[column + row * layer_size] = image_row[godot::Math::min(tile_x * splat_tile_size + column, size.x - 1)];
+			}
+		}
+		return godot::Image::create_from_data(layer_size, layer_size, false, godot::Image::FORMAT_RGBA8, data);
+	};
+
+	if (!splat_tiles_texture_id.is_valid() || splat_tiles_image_size != size)
+	{
+		clear_splat_tiles();
+		godot::TypedArray<godot::Image> layers;
+		for (int32_t tile_y = 0; tile_y < tile_counts.y; ++tile_y)
+		{
+			for (int32_t tile_x = 0; tile_x < tile_counts.x; ++tile_x)
+			{
+				layers.push_back(create_tile(tile_x, tile_y));
+			}
+		}
+		splat_tiles_texture_id = rserver->texture_2d_layered_create(layers, godot::RenderingServer::TEXTURE_LAYERED_2D_ARRAY);
+		splat_tiles_image_size = size;
+		rebuild_upload_bytes += static_cast<uint64_t>(layers.size()) * layer_size * layer_size * sizeof(uint32_t);
+
+		rserver->material_set_param(material_id, splat_tiles_param, splat_tiles_texture_id);
+		rserver->material_set_param(material_id, splat_tile_counts_param, godot::Vector2(tile_counts));
+		rserver->material_set_param(material_id, splat_pixel_limit_param, godot::Vector2(size - godot::Vector2i(1, 1)));
+		return;
+	}
+
+	// A pixel on the first row or column of a tile is also the border of the tiles before it
+	const auto clipped = region.intersection(godot::Rect2i(godot::Vector2i(), size));
+	if (!clipped.has_area())
+	{
+		return;
+	}
+	const auto first = (clipped.position - godot::Vector2i(1, 1)).max(godot::Vector2i()) / splat_tile_size;
+	const auto last = (clipped.get_end() - godot::Vector2i(1, 1)) / splat_tile_size;
+	for (int32_t tile_y = first.y; tile_y <= last.y; ++tile_y)
+	{
+		for (int32_t tile_x = first.x; tile_x <= last.x; ++tile_x)
+		{
+			rserver->texture_2d_update(splat_tiles_texture_id, create_tile(tile_x, tile_y), tile_x + tile_y * tile_counts.x);
+			rebuild_upload_bytes += layer_size * layer_size * sizeof(uint32_t);
+		}
+	}
+}
+
+void SimpleHeightmap::clear_splat_tiles()
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver != nullptr && splat_tiles_texture_id.is_valid())
+	{
+		rserver->free_rid(splat_tiles_texture_id);
+	}
+	splat_tiles_texture_id = godot::RID();
+	splat_tiles_image_size = godot::Vector2i();
+}
+
+bool SimpleHeightmap::begin_collider_rebuild(Chunk& chunk, uint32_t chunk_index, const godot::Rect2i& vertex_region, ColliderRebuild& collider_rebuild)
+{
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	if (pserver == nullptr || !chunk.collider_shape_id.is_valid())
+	{
+		return false;
+	}
+
+	// Samples are spread evenly over the chunk, at most collider_downsample quads apart
+	const auto size = godot::Vector2i(
+		(chunk.region.size.x + collider_downsample - 1) / collider_downsample + 1,
+		(chunk.region.size.y + collider_downsample - 1) / collider_downsample + 1);
+	auto full_rebuild = false;
+	if (size != chunk.collider_size)
+	{
+		chunk.collider_size = size;
+		chunk.collider_step = godot::Vector2(chunk.region.size) / godot::Vector2(size - godot::Vector2i(1, 1));
+		chunk.collider_shape_data.resize(size.x * size.y);
+		chunk.collider_shape_dict = godot::Dictionary();
+		chunk.collider_shape_dict["width"] = size.x;
+		chunk.collider_shape_dict["depth"] = size.y;
+		full_rebuild = true;
+	}
+
+	collider_rebuild.chunk_index = chunk_index;
+	collider_rebuild.full_rebuild = full_rebuild;
+	if (full_rebuild)
+	{
+		collider_rebuild.first = godot::Vector2i();
+		collider_rebuild.last = size - godot::Vector2i(1, 1);
+	}
+	else
+	{
+		// A sample interpolates the vertices on either side of it
+		const auto first_vertex = godot::Vector2(vertex_region.position - chunk.region.position - godot::Vector2i(1, 1));
+		const auto last_vertex = godot::Vector2(vertex_region.get_end() - chunk.region.position);
+		collider_rebuild.first = godot::Vector2i(
+			godot::Math::max(static_cast<int32_t>(godot::Math::floor(first_vertex.x / chunk.collider_step.x)), 0),
+			godot::Math::max(static_cast<int32_t>(godot::Math::floor(first_vertex.y / chunk.collider_step.y)), 0));
+		collider_rebuild.last = godot::Vector2i(
+			godot::Math::min(static_cast<int32_t>(godot::Math::ceil(last_vertex.x / chunk.collider_step.x)), size.x - 1),
+			godot::Math::min(static_cast<int32_t>(godot::Math::ceil(last_vertex.y / chunk.collider_step.y)), size.y - 1));
+		if (collider_rebuild.first.x > collider_rebuild.last.x || collider_rebuild.first.y > collider_rebuild.last.y)
+		{
+			return false;
+		}
+	}
+
+	// The physics server may still share the heights, so the back buffer is made unique here
+	collider_rebuild.data = chunk.collider_shape_data;
+	if (!async_rebuild)
+	{
+		chunk.collider_shape_data = godot::PackedRealArray();
+	}
+	collider_rebuild.data_p = collider_rebuild.data.ptrw();
+	return true;
+}
+
+void SimpleHeightmap::rebuild_collider(uint32_t collider_index)
+{
+	auto& collider_rebuild = rebuild_job.colliders[collider_index];
+	const auto& chunk = chunks[collider_rebuild.chunk_index];
+	const auto image_step = rebuild_job.image_step;
+	const auto first = collider_rebuild.first;
+	const auto last = collider_rebuild.last;
+	const auto count = last.x - first.x + 1;
+	const auto image_origin = rebuild_job.image_origin;
+	const auto image_x = (static_cast<float>(chunk.region.position.x) + static_cast<float>(first.x) * chunk.collider_step.x) * image_step - static_cast<float>(image_origin.x);
+
+	godot::LocalVector<float> row;
+	row.resize(count);
+	collider_rebuild.min_height = std::numeric_limits<godot::real_t>::max();
+	collider_rebuild.max_height = std::numeric_limits<godot::real_t>::lowest();
+	for (int32_t z = first.y; z <= last.y; ++z)
+	{
+		const auto image_y = (static_cast<float>(chunk.region.position.y) + static_cast<float>(z) * chunk.collider_step.y) * image_step - static_cast<float>(image_origin.y);
+		rebuild_job.height_sampler.sample_height_row(image_x, chunk.collider_step.x * image_step, image_y, count, row.ptr());
+
+		const auto row_p = &collider_rebuild.data_p[first.x + z * chunk.collider_size.x];
+		for (int32_t j = 0; j < count; ++j)
+		{
+			const auto height = static_cast<godot::real_t>(row[j]);
+			if (collider_rebuild.full_rebuild || row_p[j] != height)
+			{
+				row_p[j] = height;
+				collider_rebuild.changed = true;
+			}
+			collider_rebuild.min_height = godot::Math::min(height, collider_rebuild.min_height);
+			collider_rebuild.max_height = godot::Math::max(height, collider_rebuild.max_height);
+		}
+	}
+}
+
+void SimpleHeightmap::end_collider_rebuild(const ColliderRebuild& collider_rebuild)
+{
+	const auto pserver = godot::PhysicsServer3D::get_singleton();
+	auto& chunk = chunks[collider_rebuild.chunk_index];
+	chunk.collider_shape_data = collider_rebuild.data;
+	if (collider_rebuild.changed)
+	{
+
+		// A full rebuild recalculates the range from scratch, a partial rebuild can only widen it
+		if (collider_rebuild.full_rebuild)
+		{
+			chunk.collider_shape_min_height = collider_rebuild.min_height;
+			chunk.collider_shape_max_height = collider_rebuild.max_height;
+		}
+		else
+		{
+			chunk.collider_shape_min_height = godot::Math::min(collider_rebuild.min_height, chunk.collider_shape_min_height);
+			chunk.collider_shape_max_height = godot::Math::max(collider_rebuild.max_height, chunk.collider_shape_max_height);
+		}
+
+		// Heightmap shapes can only be replaced as a whole
+		chunk.collider_shape_dict["heights"] = chunk.collider_shape_data;
+		chunk.collider_shape_dict["min_height"] = chunk.collider_shape_min_height;
+		chunk.collider_shape_dict["max_height"] = chunk.collider_shape_max_height;
+		pserver->shape_set_data(chunk.collider_shape_id, chunk.collider_shape_dict);
+		++chunk.collider_version;
+	}
+
+	// Update transform/scale of collider shape, heightmap shapes are centered on their origin
+	const auto quad_size = rebuild_job.quad_size;
+	const auto spacing = chunk.collider_step * quad_size;
+	const auto center = (godot::Vector2(chunk.region.position) + godot::Vector2(chunk.region.size) * 0.5) * quad_size;
+	auto collider_shape_transform = godot::Transform3D(
+		godot::Basis::from_scale(godot::Vector3(spacing.x, 1.0, spacing.y)),
+		godot::Vector3(center.x, 0.0, center.y));
+	pserver->body_set_shape_transform(collider_body_id, collider_rebuild.chunk_index, collider_shape_transform);
+}
+
+godot::Vector2 SimpleHeightmap::local_position_to_image_position(const godot::Vector3& local_position) const
+{
+	return godot::Vector2(
+		godot::Math::clamp((local_position.x / mesh_size) * image_size, (godot::real_t)0.0, static_cast<godot::real_t>(image_size)),
+		godot::Math::clamp((local_position.z / mesh_size) * image_size, (godot::real_t)0.0, static_cast<godot::real_t>(image_size))
+	);
+}
+
+godot::Vector2 SimpleHeightmap::global_position_to_image_position(const godot::Vector3& global_position) const
+{
+	return local_position_to_image_position(to_local(global_position));
+}
+
+godot::Vector3 SimpleHeightmap::image_position_to_local_position(const godot::Vector2& image_position) const
+{
+	return godot::Vector3(
+		image_position.x / static_cast<godot::real_t>(image_size) * mesh_size,
+		get_height_sampler().sample_height(image_position),
+		image_position.y / static_cast<godot::real_t>(image_size) * mesh_size
+	);
+}
+
+godot::Vector3 SimpleHeightmap::image_position_to_global_position(const godot::Vector2& image_position) const
+{
+	return to_global(image_position_to_local_position(image_position));
+}
+
+godot::Variant SimpleHeightmap::intersect_ray(const godot::Vector3& from, const godot::Vector3& direction) const
+{
+	godot::Vector3 position;
+	return get_ray_intersection(from, direction, position) ? godot::Variant(position) : godot::Variant();
+}
+
+bool SimpleHeightmap::get_ray_intersection(const godot::Vector3& from, const godot::Vector3& direction, godot::Vector3& out_position) const
+{
+	if (height_pyramid.is_empty() || mesh_size <= CMP_EPSILON)
+	{
+		return false;
+	}
+
+	// Affine transforms keep distances along the ray, so the hit can be found in image space and mapped back with the same t
+	const auto to_image = static_cast<godot::real_t>(image_size) / mesh_size;
+	const auto inverse = get_global_transform().affine_inverse();
+	const auto local_from = inverse.xform(from);
+	const auto local_direction = inverse.basis.xform(direction);
+	const auto image_from = godot::Vector3(local_from.x * to_image, local_from.y, local_from.z * to_image);
+	const auto image_direction = godot::Vector3(local_direction.x * to_image, local_direction.y, local_direction.z * to_image);
+
+	godot::real_t distance;
+	if (height_pyramid.intersect_ray(get_height_sampler(), image_from, image_direction, distance))
+	{
+		out_position = from + direction * distance;
+		return true;
+	}
+	return false;
+}
+
+void SimpleHeightmap::update_query_state(const godot::Rect2i& changed_region)
+{
+	if (!(mesh_size > CMP_EPSILON && is_inside_tree() && !is_streaming() && heightmap.is_valid() && !heightmap->is_empty()))
+	{
+		clear_query_state();
+		return;
+	}
+
+	QueryState state;
+	state.transform = get_global_transform();
+	state.inverse_transform = state.transform.affine_inverse();
+	state.normal_basis = state.transform.basis.inverse().transposed();
+	state.image_scale = static_cast<godot::real_t>(image_size) / mesh_size;
+	state.image_size = static_cast<godot::real_t>(image_size);
+
+	const auto format = heightmap->get_format();
+	const auto size = heightmap->get_size();
+	const auto pixel_size = SimpleHeightmapHeightCodec::get_pixel_size(format);
+	const auto source = heightmap->ptr();
+
+	const std::lock_guard<std::mutex> lock(query_mutex);
+
+	// Dropping the old sampler first leaves the copy with a single owner, so it is written in place
+	// A query still running on another thread keeps its own reference, and the write copies around it
+	query_state = QueryState();
+	if (format != query_heights_format || size != query_heights_size)
+	{
+		query_heights.resize(static_cast<int64_t>(size.x) * size.y * pixel_size);
+		memcpy(query_heights.ptrw(), source, query_heights.size());
+		query_heights_format = format;
+		query_heights_size = size;
+	}
+	else
+	{
+		// Only the pixels that changed, so an edit costs the size of the edit
+		const auto clipped = changed_region.intersection(godot::Rect2i(godot::Vector2i(), size));
+		if (clipped.has_area())
+		{
+			const auto out = query_heights.ptrw();
+			const auto row_bytes = static_cast<size_t>(clipped.size.x) * pixel_size;
+			for (int32_t y = clipped.position.y; y < clipped.get_end().y; ++y)
+			{
+				const auto offset = (static_cast<int64_t>(y) * size.x + clipped.position.x) * pixel_size;
+				memcpy(out + offset, source + offset, row_bytes);
+			}
+		}
+	}
+	state.heights = SimpleHeightmapSampler(query_heights, format, size.x, size.y, height_range);
+	query_state = state;
+}
+
+void SimpleHeightmap::clear_query_state()
+{
+	const std::lock_guard<std::mutex> lock(query_mutex);
+	query_state = QueryState();
+	query_heights = godot::PackedByteArray();
+	query_heights_format = godot::Image::FORMAT_MAX;
+	query_heights_size = godot::Vector2i();
+}
+
+SimpleHeightmap::QueryState SimpleHeightmap::get_query_state() const
+{
+	// The sampler shares the query copy of the heights, so the copy only bumps a reference count
+	const std::lock_guard<std::mutex> lock(query_mutex);
+	return query_state;
+}
+
+void SimpleHeightmap::transform_query_points(const QueryState& state, const godot::PackedVector3Array& global_points, godot::LocalVector<float>& xs, godot::LocalVector<float>& zs) const
+{
+	// Clamped like local_position_to_image_position, points off the heightmap get the height of its edge
+	const auto count = global_points.size();
+	const auto points = global_points.ptr();
+	xs.resize(count);
+	zs.resize(count);
+	for (int64_t i = 0; i < count; ++i)
+	{
+		const auto local = state.inverse_transform.xform(points[i]);
+		xs[i] = static_cast<float>(godot::Math::clamp(local.x * state.image_scale, static_cast<godot::real_t>(0.0), state.image_size));
+		zs[i] = static_cast<float>(godot::Math::clamp(local.z * state.image_scale, static_cast<godot::real_t>(0.0), state.image_size));
+	}
+}
+
+godot::PackedFloat32Array SimpleHeightmap::get_heights_at(const godot::PackedVector3Array& global_points) const
+{
+	const auto state = get_query_state();
+	ERR_FAIL_COND_V_MSG(!state.heights.is_valid() || !state.heights.is_height_format(), godot::PackedFloat32Array(), "SimpleHeightmap has no heights to query, it must be inside the tree with a heightmap image.");
+
+	godot::LocalVector<float> xs;
+	godot::LocalVector<float> zs;
+	transform_query_points(state, global_points, xs, zs);
+
+	godot::PackedFloat32Array heights;
+	heights.resize(global_points.size());
+	const auto out = heights.ptrw();
+	state.heights.sample_height_points(xs.ptr(), zs.ptr(), xs.size(), out);
+
+	// Back to global space, through the point on the surface
+	const auto& basis = state.transform.basis;
+	const auto to_local = static_cast<godot::real_t>(1.0) / state.image_scale;
+	for (uint32_t i = 0; i < xs.size(); ++i)
+	{
+		out[i] = static_cast<float>(basis.rows[1].dot(godot::Vector3(xs[i] * to_local, out[i], zs[i] * to_local)) + state.transform.origin.y);
+	}
+	return heights;
+}
+
+godot::PackedVector3Array SimpleHeightmap::get_normals_at(const godot::PackedVector3Array& global_points) const
+{
+	const auto state = get_query_state();
+	ERR_FAIL_COND_V_MSG(!state.heights.is_valid() || !state.heights.is_height_format(), godot::PackedVector3Array(), "SimpleHeightmap has no heights to query, it must be inside the tree with a heightmap image.");
+
+	godot::LocalVector<float> xs;
+	godot::LocalVector<float> zs;
+	transform_query_points(state, global_points, xs, zs);
+
+	// Central differences one pixel either side of each point, sampled as four batches
+	const auto count = xs.size();
+	godot::LocalVector<float> shifted_xs;
+	godot::LocalVector<float> shifted_zs;
+	godot::LocalVector<float> samples;
+	shifted_xs.resize(count);
+	shifted_zs.resize(count);
+	samples.resize(count * 4);
+	const auto sample_shifted = [&](float offset_x, float offset_z, uint32_t batch)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			shifted_xs[i] = xs[i] + offset_x;
+			shifted_zs[i] = zs[i] + offset_z;
+		}
+		state.heights.sample_height_points(shifted_xs.ptr(), shifted_zs.ptr(), count, samples.ptr() + count * batch);
+	};
+	sample_shifted(-1.0f, 0.0f, 0);
+	sample_shifted(1.0f, 0.0f, 1);
+	sample_shifted(0.0f, -1.0f, 2);
+	sample_shifted(0.0f, 1.0f, 3);
+
+	godot::PackedVector3Array normals;
+	normals.resize(count);
+	const auto out = normals.ptrw();
+	const auto spacing = static_cast<godot::real_t>(2.0) / state.image_scale; // Local distance between the two samples
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const auto dx = (samples[count + i] - samples[i]) / spacing;
+		const auto dz = (samples[count * 3 + i] - samples[count * 2 + i]) / spacing;
+		out[i] = state.normal_basis.xform(godot::Vector3(-dx, 1.0, -dz)).normalized();
+	}
+	return normals;
+}
+
+godot::Dictionary SimpleHeightmap::get_mesh_stats() const
+{
+	// Chunks keep a copy of the buffers they hand to the RenderingServer, so their sizes match what the GPU holds
+	uint64_t vertex_count = 0;
+	uint64_t vertex_bytes = 0;
+	for (const auto& chunk : chunks)
+	{
+		vertex_count += chunk.cached_vertex_count;
+		vertex_bytes += chunk.surface_vertex_buffer.size() + chunk.surface_attribute_buffer.size();
+	}
+
+	godot::Dictionary stats;
+	stats["vertex_count"] = static_cast<int64_t>(vertex_count);
+	stats["vertex_bytes"] = static_cast<int64_t>(vertex_bytes);
+	stats["bytes_per_vertex"] = vertex_count > 0 ? static_cast<double>(vertex_bytes) / static_cast<double>(vertex_count) : 0.0;
+	stats["upload_bytes"] = static_cast<int64_t>(rebuild_upload_bytes); // Includes displacement layers in RENDER_MODE_GPU_DISPLACEMENT
+
+	// Across all heightmaps
+	const std::lock_guard<std::mutex> lock(shared_shaders_mutex);
+	stats["shared_shaders"] = static_cast<int64_t>(shared_shaders.size());
+	stats["shared_materials"] = static_cast<int64_t>(shared_materials.size());
+	return stats;
+}
+
+void SimpleHeightmap::set_mesh_size(const godot::real_t value)
+{
+	mesh_size = value;
+	rebuild(REBUILD_ALL);
+}
+
+void SimpleHeightmap::set_image_size(int value)
+{
+	ERR_FAIL_COND_MSG(is_streaming(), "SimpleHeightmap image_size is set by the streamed file while stream_path is set.");
+	image_size = godot::Math::max(value, 1);
+	if (heightmap.is_valid())
+		resize_heightmap();
+	if (splatmap.is_valid())
+		splatmap->resize(image_size, image_size, uses_texture_layers() ? godot::Image::INTERPOLATE_NEAREST : godot::Image::INTERPOLATE_BILINEAR);
+	rebuild(REBUILD_ALL);
+}
+
+godot::Image::Format SimpleHeightmap::get_height_format() const
+{
+	switch (height_precision)
+	{
+		case HEIGHT_PRECISION_HALF: return godot::Image::FORMAT_RH;
+		case HEIGHT_PRECISION_QUANTIZED: return godot::Image::FORMAT_RG8;
+		default: return godot::Image::FORMAT_RF;
+	}
+}
+
+void SimpleHeightmap::set_height_precision(HeightPrecision value)
+{
+	if (height_precision != value)
+	{
+		height_precision = value;
+		initialize_heightmap();
+		rebuild(REBUILD_HEIGHTMAP);
+	}
+}
+
+void SimpleHeightmap::set_height_range(const godot::Vector2& value)
+{
+	const auto new_range = godot::Vector2(value.x, godot::Math::max(value.y, value.x + static_cast<godot::real_t>(0.01)));
+	if (height_range == new_range)
+	{
+		return;
+	}
+
+	// Quantized heights are relative to the range, so they're re-encoded to keep the surface where it was
+	if (heightmap.is_valid() && !heightmap->is_empty() && heightmap->get_format() == godot::Image::FORMAT_RG8)
+	{
+		const auto from = SimpleHeightmapHeightCodec(godot::Image::FORMAT_RG8, height_range);
+		const auto to = SimpleHeightmapHeightCodec(godot::Image::FORMAT_RG8, new_range);
+		heightmap->set_data(heightmap->get_width(), heightmap->get_height(), false, godot::Image::FORMAT_RG8, SimpleHeightmapHeightCodec::convert(heightmap->get_data(), heightmap->get_width(), heightmap->get_height(), from, to));
+	}
+	height_range = new_range;
+	if (heightmap_data.is_valid())
+	{
+		heightmap_data->set_height_range(height_range);
+	}
+	rebuild(REBUILD_HEIGHTMAP);
+}
+
+void SimpleHeightmap::set_chunk_size(int value)
+{
+	chunk_size = godot::Math::max(value, 0);
+	rebuild(REBUILD_ALL);
+}
+
+void SimpleHeightmap::set_render_mode(RenderMode value)
+{
+	if (render_mode != value)
+	{
+		// Chunks are built differently in each mode
+		clear_chunks();
+		render_mode = value;
+
+		update_shader_code();
+		rebuild(REBUILD_ALL);
+	}
+}
+
+void SimpleHeightmap::set_splatmap_texture(bool value)
+{
+	if (splatmap_texture != value)
+	{
+		// Chunk surfaces only carry splat weights without the splat tiles
+		clear_chunks();
+		clear_splat_tiles();
+		splatmap_texture = value;
+
+		update_shader_code();
+		rebuild(REBUILD_ALL);
+	}
+}
+
+void SimpleHeightmap::set_splat_encoding(SplatEncoding value)
+{
+	if (splat_encoding == value)
+	{
+		return;
+	}
+
+	// The painted splatmap is re-encoded in place, going back to weights keeps only the first four layers
+	if (splatmap.is_valid() && !splatmap->is_empty() && splatmap->get_format() == godot::Image::FORMAT_RGBA8)
+	{
+		if (value == SPLAT_ENCODING_LAYERS)
+		{
+			SimpleHeightmapSplat::convert_weights_to_layers(splatmap);
+		}
+		else
+		{
+			SimpleHeightmapSplat::convert_layers_to_weights(splatmap);
+		}
+	}
+
+	// Layer indices only reach the shader through the splat tiles
+	clear_chunks();
+	clear_splat_tiles();
+	splat_encoding = value;
+
+	update_shader_code();
+	rebuild(REBUILD_ALL);
+}
+
+void SimpleHeightmap::set_lod_levels(int value)
+{
+	lod_levels = godot::Math::clamp(value, 0, 8);
+	if (is_inside_tree())
+	{
+		update_internal_processing();
+	}
+	if (lod_levels == 0)
+	{
+		for (auto& chunk : chunks)
+		{
+			set_chunk_lod(chunk, 0, 0);
+		}
+	}
+}
+
+void SimpleHeightmap::set_lod_distance(const godot::real_t value)
+{
+	lod_distance = godot::Math::max(value, static_cast<godot::real_t>(0.01));
+}
+
+void SimpleHeightmap::set_rebuild_band_rows(int value)
+{
+	rebuild_band_rows = godot::Math::max(value, 1);
+}
+
+void SimpleHeightmap::set_rebuild_thread_limit(int value)
+{
+	rebuild_thread_limit = godot::Math::max(value, 0);
+}
+
+void SimpleHeightmap::set_async_rebuild(bool value)
+{
+	async_rebuild = value;
+}
+
+void SimpleHeightmap::set_texture_size(const godot::real_t value)
+{
+	texture_size = godot::Math::max(value, static_cast<godot::real_t>(0.01));
+	rebuild(REBUILD_UV);
+}
+
+void SimpleHeightmap::_validate_property(godot::PropertyInfo& p_property) const
+{
+	// Images held by a data resource are saved with it rather than inside the scene
+	const auto is_image = p_property.name == godot::StringName("heightmap_image") || p_property.name == godot::StringName("splatmap_image");
+	if (heightmap_data.is_valid() && is_image)
+	{
+		p_property.usage &= ~godot::PROPERTY_USAGE_STORAGE;
+	}
+
+	// While streaming the images go unused and the size comes from the file
+	if (is_streaming() && (is_image || p_property.name == godot::StringName("image_size")))
+	{
+		p_property.usage &= ~godot::PROPERTY_USAGE_STORAGE;
+		p_property.usage |= godot::PROPERTY_USAGE_READ_ONLY;
+	}
+}
+
+void SimpleHeightmap::set_data(const godot::Ref<SimpleHeightmapData>& new_data)
+{
+	heightmap_data = new_data;
+	if (heightmap_data.is_valid())
+	{
+		// Adopt the resource's images, or hand it the current ones if it has none yet
+		if (heightmap_data->get_heightmap_image().is_valid() && !heightmap_data->get_heightmap_image()->is_empty())
+		{
+			heightmap = heightmap_data->get_heightmap_image();
+			image_size = heightmap->get_width();
+		}
+		if (heightmap_data->get_splatmap_image().is_valid() && !heightmap_data->get_splatmap_image()->is_empty())
+		{
+			splatmap = heightmap_data->get_splatmap_image();
+		}
+		initialize_heightmap();
+		initialize_splatmap();
+		heightmap_data->set_height_range(height_range);
+		heightmap_data->set_heightmap_image(heightmap);
+		heightmap_data->set_splatmap_image(splatmap);
+	}
+	notify_property_list_changed();
+	rebuild(REBUILD_ALL);
+}
+
+void SimpleHeightmap::set_heightmap_image(const godot::Ref<godot::Image>& new_heightmap)
+{
+	heightmap = new_heightmap;
+	initialize_heightmap();
+	if (heightmap_data.is_valid())
+	{
+		heightmap_data->set_heightmap_image(heightmap);
+	}
+	rebuild(REBUILD_ALL);
+}
+
+void SimpleHeightmap::set_splatmap_image(const godot::Ref<godot::Image>& new_splatmap)
+{
+	splatmap = new_splatmap;
+	initialize_splatmap();
+	if (heightmap_data.is_valid())
+	{
+		heightmap_data->set_splatmap_image(splatmap);
+	}
+	rebuild(REBUILD_ALL);
+}
+
+void SimpleHeightmap::set_stream_path(const godot::String& value)
+{
+	if (stream_path == value)
+	{
+		return;
+	}
+
+	// Everything built so far came from the previous source
+	clear_chunks();
+	clear_splat_tiles();
+	stream.close();
+	stream_path = value;
+	if (!stream_path.is_empty())
+	{
+		const auto error = stream.open(stream_path);
+		const auto size = stream.get_heightmap_size();
+		if (error == godot::OK && (size.x != size.y || size.x == 0))
+		{
+			ERR_PRINT(godot::vformat("SimpleHeightmap can only stream square heightmaps, '%s' is %dx%d.", stream_path, size.x, size.y));
+			stream.close();
+		}
+		if (stream.is_open())
+		{
+			image_size = size.x;
+		}
+	}
+
+	// Picking and the height queries read the heightmap image, there is none to read while streaming
+	height_pyramid.clear();
+	update_query_state();
+
+	update_shader_code();
+	notify_property_list_changed();
+	rebuild(REBUILD_ALL);
+	update_internal_processing();
+}
+
+void SimpleHeightmap::set_stream_distance(const godot::real_t value)
+{
+	stream_distance = godot::Math::max(value, static_cast<godot::real_t>(1.0));
+}
+
+void SimpleHeightmap::set_stream_memory_budget(int value)
+{
+	stream_memory_budget = godot::Math::max(value, 16);
 }
 
 void SimpleHeightmap::set_texture_1(const godot::Ref<godot::Texture2D>& new_texture)
 {
 	texture_1 = new_texture;
-	update_material_texture_parameter(default_texture_1_param, texture_1);
+	update_shader_code();
 	emit_signal("texture_1_changed", texture_1);
 }
 
 void SimpleHeightmap::set_texture_2(const godot::Ref<godot::Texture2D>& new_texture)
 {
 	texture_2 = new_texture;
-	update_material_texture_parameter(default_texture_2_param, texture_2);
+	update_shader_code();
 	emit_signal("texture_2_changed", texture_2);
 }
 
 void SimpleHeightmap::set_texture_3(const godot::Ref<godot::Texture2D>& new_texture)
 {
 	texture_3 = new_texture;
-	update_material_texture_parameter(default_texture_3_param, texture_3);
+	update_shader_code();
 	emit_signal("texture_3_changed", texture_3);
 }
 
 void SimpleHeightmap::set_texture_4(const godot::Ref<godot::Texture2D>& new_texture)
 {
 	texture_4 = new_texture;
-	update_material_texture_parameter(default_texture_4_param, texture_4);
+	update_shader_code();
 	emit_signal("texture_4_changed", texture_4);
 }
 
+void SimpleHeightmap::set_texture_layers(const godot::TypedArray<godot::Texture2D>& value)
+{
+	texture_layers = value;
+	if (texture_layers.size() > SimpleHeightmapSplat::MAX_LAYERS)
+	{
+		WARN_PRINT(godot::vformat("SimpleHeightmap only uses the first %d texture_layers.", SimpleHeightmapSplat::MAX_LAYERS));
+		texture_layers.resize(SimpleHeightmapSplat::MAX_LAYERS);
+	}
+	update_layer_texture();
+	update_shader_code();
+}
+
 void SimpleHeightmap::set_collider_layer(uint32_t layer)
 {
 	collider_layer = layer;
 	const auto pserver = godot::PhysicsServer3D::get_singleton();
-	if (pserver)
+	if (pserver && collider_body_id.is_valid())
 	{
 		pserver->body_set_collision_layer(collider_body_id, collider_layer);
 	}
@@ -513,7 +2864,7 @@ void SimpleHeightmap::set_collider_mask(uint32_t mask)
 {
 	collider_mask = mask;
 	const auto pserver = godot::PhysicsServer3D::get_singleton();
-	if (pserver)
+	if (pserver && collider_body_id.is_valid())
 	{
 		pserver->body_set_collision_mask(collider_body_id, collider_mask);
 	}
@@ -523,22 +2874,80 @@ void SimpleHeightmap::set_collider_priority(float priority)
 {
 	collider_priority = priority;
 	const auto pserver = godot::PhysicsServer3D::get_singleton();
-	if (pserver)
+	if (pserver && collider_body_id.is_valid())
 	{
 		pserver->body_set_collision_priority(collider_body_id, collider_priority);
 	}
 }
 
-void SimpleHeightmap::update_material_texture_parameter(const char* parameter_name, const godot::Ref<godot::Texture2D>& texture)
+void SimpleHeightmap::set_collider_downsample(int value)
 {
-	const auto rserver = godot::RenderingServer::get_singleton();
-	if (rserver != nullptr && material_id.is_valid())
+	collider_downsample = godot::Math::max(value, 1);
+	rebuild(REBUILD_HEIGHTMAP);
+}
+
+void SimpleHeightmap::initialize_heightmap()
+{
+	if (heightmap.is_null())
 	{
-		rserver->material_set_param(material_id, parameter_name, texture.is_valid() ? texture->get_rid() : godot::RID());
+		return;
+	}
+
+	const auto format = get_height_format();
+	const auto codec = SimpleHeightmapHeightCodec(format, height_range);
+	if (heightmap->is_empty())
+	{
+		// Flat at height 0, which a quantized range doesn't necessarily store as 0
+		godot::PackedByteArray data;
+		data.resize(static_cast<int64_t>(image_size) * image_size * SimpleHeightmapHeightCodec::get_pixel_size(format));
+		godot::LocalVector<float> row;
+		row.resize(image_size);
+		for (auto& height : row)
+		{
+			height = 0.0f;
+		}
+		for (int32_t y = 0; y < image_size; ++y)
+		{
+			codec.encode_row(row.ptr(), image_size, data.ptrw(), static_cast<int64_t>(y) * image_size);
+		}
+		heightmap->set_data(image_size, image_size, false, format, data);
+		return;
+	}
+
+	// Any other format is taken as plain heights in its first channel
+	if (!SimpleHeightmapHeightCodec::is_supported(heightmap->get_format()))
+	{
+		heightmap->convert(godot::Image::FORMAT_RF);
+	}
+	if (heightmap->get_format() != format)
+	{
+		const auto from = SimpleHeightmapHeightCodec(heightmap->get_format(), height_range);
+		heightmap->set_data(heightmap->get_width(), heightmap->get_height(), false, format, SimpleHeightmapHeightCodec::convert(heightmap->get_data(), heightmap->get_width(), heightmap->get_height(), from, codec));
+	}
+	if (heightmap->get_width() != image_size || heightmap->get_height() != image_size)
+	{
+		resize_heightmap();
+	}
+}
+
+void SimpleHeightmap::resize_heightmap()
+{
+	const auto format = heightmap->get_format();
+	if (format != godot::Image::FORMAT_RG8)
+	{
+		heightmap->resize(image_size, image_size);
+		return;
 	}
+
+	// Interpolating the low and high bytes of quantized heights separately would scramble them, so they're resized as floats
+	const auto codec = SimpleHeightmapHeightCodec(format, height_range);
+	const auto floats = SimpleHeightmapHeightCodec(godot::Image::FORMAT_RF, height_range);
+	heightmap->set_data(heightmap->get_width(), heightmap->get_height(), false, godot::Image::FORMAT_RF, SimpleHeightmapHeightCodec::convert(heightmap->get_data(), heightmap->get_width(), heightmap->get_height(), codec, floats));
+	heightmap->resize(image_size, image_size);
+	heightmap->set_data(image_size, image_size, false, format, SimpleHeightmapHeightCodec::convert(heightmap->get_data(), image_size, image_size, floats, codec));
 }
 
-void SimpleHeightmap::initialize_image(const godot::Ref<godot::Image>& image, godot::Image::Format format, int32_t size, godot::Color default_color)
+void SimpleHeightmap::initialize_image(const godot::Ref<godot::Image>& image, godot::Image::Format format, int32_t size, godot::Color default_color, godot::Image::Interpolation interpolation)
 {
 	if (image.is_valid())
 	{
@@ -555,41 +2964,238 @@ void SimpleHeightmap::initialize_image(const godot::Ref<godot::Image>& image, go
 		}
 		if (image->get_width() != size || image->get_height() != size)
 		{
-			image->resize(size, size);
+			image->resize(size, size, interpolation);
 		}
 	}
 }
 
-namespace
+void SimpleHeightmap::initialize_splatmap()
+{
+	// Blending layer indices would make up layers nobody painted
+	if (splat_encoding == SPLAT_ENCODING_LAYERS)
+	{
+		initialize_image(splatmap, godot::Image::FORMAT_RGBA8, image_size, godot::Color(0.0, 0.0, 0.0, 0.0), godot::Image::INTERPOLATE_NEAREST);
+	}
+	else
+	{
+		initialize_image(splatmap, godot::Image::FORMAT_RGBA8, image_size, godot::Color(1.0, 0.0, 0.0, 0.0));
+	}
+}
+
+void SimpleHeightmap::update_shader_code()
 {
-	godot::Vector2i get_offset_coordinate(const godot::Vector2i& origin, int32_t offset_x, int32_t offset_y, godot::Ref<godot::Image> image)
+	if (godot::RenderingServer::get_singleton() == nullptr || !server_resources)
+	{
+		return;
+	}
+
+	uint8_t texture_mask = 0;
+	const godot::Ref<godot::Texture2D>* textures[] = { &texture_1, &texture_2, &texture_3, &texture_4 };
+	for (int32_t i = 0; i < 4; ++i)
 	{
-		return godot::Vector2i(
-			godot::Math::clamp(origin.x + offset_x, 0, image->get_width() - 1),
-			godot::Math::clamp(origin.y + offset_y, 0, image->get_height() - 1)
-		);
+		if (textures[i]->is_valid())
+		{
+			texture_mask |= 1 << i;
+		}
+	}
+	const auto layer_count = uses_texture_layers() ? godot::Math::max(static_cast<int32_t>(texture_layers.size()), 1) : 0;
+
+	// The previous variant is released only once the material has moved off it
+	const auto code = get_shader_code(get_chunk_render_mode(), uses_splat_texture(), texture_mask, layer_count);
+	const auto previous_code = shader_id.is_valid() ? shader_code : godot::String();
+	if (code != shader_code || !shader_id.is_valid())
+	{
+		shader_id = acquire_shared_shader(code);
+		shader_code = code;
+	}
+	update_material();
+	if (!previous_code.is_empty() && previous_code != shader_code)
+	{
+		release_shared_shader(previous_code);
 	}
 }
 
-godot::Color SimpleHeightmap::bilinear_sample(const godot::Ref<godot::Image>& image, const godot::Vector2& point)
+void SimpleHeightmap::update_material()
 {
-	const auto w = image->get_width();
-	const auto h = image->get_height();
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver == nullptr || !shader_id.is_valid())
+	{
+		return;
+	}
 
-	const auto pi = godot::Vector2i(
-		godot::Math::clamp(static_cast<int>(point.x), 0, w - 1),
-		godot::Math::clamp(static_cast<int>(point.y), 0, h - 1)
-	);
+	// Displacement layers and splat tiles are this heightmap's own, the rest is the same for every heightmap with the same key
+	const auto shareable = get_chunk_render_mode() != RENDER_MODE_GPU_DISPLACEMENT && !uses_splat_texture();
+	const auto texture_id = [](const godot::Ref<godot::Texture2D>& texture)
+	{
+		return static_cast<int64_t>(texture.is_valid() ? texture->get_rid().get_id() : 0);
+	};
+	const auto key = !shareable ? godot::String() : godot::vformat("%d %d %d %d %d %s %s",
+		static_cast<int64_t>(shader_id.get_id()), texture_id(texture_1), texture_id(texture_2), texture_id(texture_3), texture_id(texture_4),
+		get_quad_size(), texture_size);
+	if (material_id.is_valid() && key == material_key)
+	{
+		if (key.is_empty())
+		{
+			rserver->material_set_shader(material_id, shader_id);
+			set_material_parameters();
+		}
+		return;
+	}
+
+	release_material();
+	material_key = key;
+	auto created = true;
+	if (material_key.is_empty())
+	{
+		material_id = rserver->material_create();
+	}
+	else
+	{
+		material_id = acquire_shared_material(material_key, created);
+	}
+	if (created)
+	{
+		rserver->material_set_shader(material_id, shader_id);
+		set_material_parameters();
+	}
+	apply_material_to_chunks();
+}
+
+void SimpleHeightmap::release_material()
+{
+	if (!material_id.is_valid())
+	{
+		return;
+	}
+	if (material_key.is_empty())
+	{
+		const auto rserver = godot::RenderingServer::get_singleton();
+		if (rserver != nullptr)
+		{
+			rserver->free_rid(material_id);
+		}
+	}
+	else
+	{
+		release_shared_material(material_key);
+	}
+	material_id = godot::RID();
+	material_key = godot::String();
+}
+
+void SimpleHeightmap::set_material_parameters() const
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	const auto set_texture = [&](const char* parameter_name, const godot::Ref<godot::Texture2D>& texture)
+	{
+		rserver->material_set_param(material_id, parameter_name, texture.is_valid() ? texture->get_rid() : godot::RID());
+	};
+	set_texture(default_texture_1_param, texture_1);
+	set_texture(default_texture_2_param, texture_2);
+	set_texture(default_texture_3_param, texture_3);
+	set_texture(default_texture_4_param, texture_4);
+	rserver->material_set_param(material_id, quad_size_param, get_quad_size());
+	rserver->material_set_param(material_id, uv_scale_param, get_quad_size() / texture_size);
+	rserver->material_set_param(material_id, splat_pixel_scale_param, texture_size / get_quad_size());
+
+	// The rest is only ever set on a material of this heightmap alone
+	rserver->material_set_param(material_id, texture_layers_param, layer_texture_id);
+	if (height_texture_id.is_valid())
+	{
+		rserver->material_set_param(material_id, height_map_param, height_texture_id);
+	}
+	if (splat_texture_id.is_valid())
+	{
+		rserver->material_set_param(material_id, splat_map_param, splat_texture_id);
+	}
+	if (splat_tiles_texture_id.is_valid())
+	{
+		const auto tile_counts = (splat_tiles_image_size + godot::Vector2i(splat_tile_size - 1, splat_tile_size - 1)) / splat_tile_size;
+		rserver->material_set_param(material_id, splat_tiles_param, splat_tiles_texture_id);
+		rserver->material_set_param(material_id, splat_tile_counts_param, godot::Vector2(tile_counts));
+		rserver->material_set_param(material_id, splat_pixel_limit_param, godot::Vector2(splat_tiles_image_size - godot::Vector2i(1, 1)));
+	}
+}
+
+void SimpleHeightmap::apply_material_to_chunks()
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	for (const auto& chunk : chunks)
+	{
+		if (chunk.shared_mesh)
+		{
+			if (chunk.instance_id.is_valid())
+			{
+				rserver->instance_geometry_set_material_override(chunk.instance_id, material_id);
+			}
+		}
+		else if (chunk.mesh_id.is_valid() && rserver->mesh_get_surface_count(chunk.mesh_id) > 0)
+		{
+			rserver->mesh_surface_set_material(chunk.mesh_id, 0, material_id);
+		}
+	}
+}
 
-	const auto v1 = image->get_pixelv(get_offset_coordinate(pi, 0, 0, image));
-	const auto v2 = image->get_pixelv(get_offset_coordinate(pi, 1, 0, image));
-	const auto v3 = image->get_pixelv(get_offset_coordinate(pi, 0, 1, image));
-	const auto v4 = image->get_pixelv(get_offset_coordinate(pi, 1, 1, image));
+void SimpleHeightmap::update_layer_texture()
+{
+	const auto rserver = godot::RenderingServer::get_singleton();
+	if (rserver == nullptr || !server_resources)
+	{
+		return;
+	}
+	if (layer_texture_id.is_valid())
+	{
+		rserver->free_rid(layer_texture_id);
+		layer_texture_id = godot::RID();
+	}
 
-	const auto tx = (point.x - godot::Math::floor(point.x));
-	const auto ty = (point.y - godot::Math::floor(point.y));
+	// Every layer of a texture array shares one size and format, each takes the size of the first texture
+	godot::TypedArray<godot::Image> layers;
+	godot::Vector2i size;
+	for (int64_t i = 0; i < texture_layers.size(); ++i)
+	{
+		const godot::Ref<godot::Texture2D> texture = texture_layers[i];
+		godot::Ref<godot::Image> image = texture.is_valid() ? texture->get_image() : godot::Ref<godot::Image>();
+		if (image.is_valid() && !image->is_empty())
+		{
+			image = image->duplicate();
+			if (image->is_compressed())
+			{
+				image->decompress();
+			}
+			image->clear_mipmaps();
+			image->convert(godot::Image::FORMAT_RGBA8);
+			if (size == godot::Vector2i())
+			{
+				size = image->get_size();
+			}
+			else if (image->get_size() != size)
+			{
+				image->resize(size.x, size.y);
+			}
+		}
+		else
+		{
+			image.unref();
+		}
+		layers.push_back(image);
+	}
+	if (size == godot::Vector2i())
+	{
+		return;
+	}
 
-	const auto a = v1.lerp(v2, tx);
-	const auto b = v3.lerp(v4, tx);
-	return a.lerp(b, ty);
-}
\ No newline at end of file
+	// Unset layers are plain white, like an unset texture
+	for (int64_t i = 0; i < layers.size(); ++i)
+	{
+		godot::Ref<godot::Image> image = layers[i];
+		if (image.is_null())
+		{
+			image = godot::Image::create_empty(size.x, size.y, false, godot::Image::FORMAT_RGBA8);
+			image->fill(godot::Color(1.0, 1.0, 1.0, 1.0));
+		}
+		image->generate_mipmaps();
+		layers[i] = image;
+	}
+	layer_texture_id = rserver->texture_2d_layered_create(layers, godot::RenderingServer::TEXTURE_LAYERED_2D_ARRAY);
+}
@@ -1,8 +1,17 @@
 #pragma once
 
+#include <godot_cpp/classes/camera3d.hpp>
 #include <godot_cpp/classes/geometry_instance3d.hpp>
 #include <godot_cpp/classes/image.hpp>
 #include <godot_cpp/classes/texture2d.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/typed_array.hpp>
+
+#include "simple_heightmap_data.h"
+#include "simple_heightmap_pyramid.h"
+#include "simple_heightmap_sampler.h"
+
+#include <mutex>
 
 class SimpleHeightmap : public godot::GeometryInstance3D
 {
@@ -10,10 +19,12 @@ class SimpleHeightmap : public godot::GeometryInstance3D
 
 protected:
 	static void _bind_methods();
+	void _validate_property(godot::PropertyInfo& p_property) const;
 
 public:
 	SimpleHeightmap();
 	~SimpleHeightmap();
+	static void free_pooled_resources(); // Frees the server objects kept for reuse, once no heightmap is left
 	
 	void _notification(int32_t what);
 
@@ -26,34 +37,95 @@ public:
 		REBUILD_ALL = REBUILD_HEIGHTMAP | REBUILD_SPLATMAP | REBUILD_UV
 	};
 
+	enum RenderMode : uint8_t
+	{
+		RENDER_MODE_CPU, // Heights are written into the vertices of each chunk mesh
+		RENDER_MODE_GPU_DISPLACEMENT, // A shared flat grid is displaced by a height texture in the vertex shader
+		RENDER_MODE_CPU_COMPACT, // Only heights, packed normals and splat weights are written into the chunk meshes, the vertex shader rebuilds the rest
+	};
+
+	enum HeightPrecision : uint8_t
+	{
+		HEIGHT_PRECISION_FLOAT, // FORMAT_RF, 32 bit floats
+		HEIGHT_PRECISION_HALF, // FORMAT_RH, 16 bit floats
+		HEIGHT_PRECISION_QUANTIZED, // FORMAT_RG8 holding 16 bit steps spread evenly over height_range
+	};
+
+	enum SplatEncoding : uint8_t
+	{
+		SPLAT_ENCODING_WEIGHTS, // RGBA weigh texture_1 to texture_4
+		SPLAT_ENCODING_LAYERS, // Each pixel names its three strongest of up to 16 texture_layers, see SimpleHeightmapSplat
+	};
+
+	// Requests are merged and run once per frame, flush_rebuild runs them right away
 	void rebuild(RebuildFlags flags);
+	void rebuild_region(const godot::Rect2i& region, RebuildFlags flags); // Region is in image coordinates
+	void flush_rebuild();
+	[[nodiscard]] bool is_rebuild_pending() const { return rebuild_queued || rebuild_task_id >= 0 || pending_rebuild_flags != REBUILD_NONE; }
 
 	void set_mesh_size(const godot::real_t value);
 	void set_image_size(int value);
+	void set_height_precision(HeightPrecision value);
+	void set_height_range(const godot::Vector2& value);
+	void set_chunk_size(int value);
+	void set_render_mode(RenderMode value);
+	void set_splatmap_texture(bool value);
+	void set_splat_encoding(SplatEncoding value);
+	void set_lod_levels(int value);
+	void set_lod_distance(const godot::real_t value);
+	void set_rebuild_band_rows(int value);
+	void set_rebuild_thread_limit(int value);
+	void set_async_rebuild(bool value);
 	void set_texture_size(const godot::real_t value);
+	void set_data(const godot::Ref<SimpleHeightmapData>& new_data);
 	void set_heightmap_image(const godot::Ref<godot::Image>& new_heightmap);
 	void set_splatmap_image(const godot::Ref<godot::Image>& new_splatmap);
 	void set_texture_1(const godot::Ref<godot::Texture2D>& new_texture);
 	void set_texture_2(const godot::Ref<godot::Texture2D>& new_texture);
 	void set_texture_3(const godot::Ref<godot::Texture2D>& new_texture);
 	void set_texture_4(const godot::Ref<godot::Texture2D>& new_texture);
+	void set_texture_layers(const godot::TypedArray<godot::Texture2D>& value);
 	void set_collider_layer(uint32_t layer);
 	void set_collider_mask(uint32_t mask);
 	void set_collider_priority(float priority);
+	void set_collider_downsample(int value);
+	void set_stream_path(const godot::String& value);
+	void set_stream_distance(const godot::real_t value);
+	void set_stream_memory_budget(int value);
 
 	[[nodiscard]] godot::real_t get_mesh_size() const { return mesh_size; }
 	[[nodiscard]] godot::real_t get_half_mesh_size() const { return mesh_size * static_cast<godot::real_t>(0.5); }
 	[[nodiscard]] int get_image_size() const { return image_size; }
+	[[nodiscard]] HeightPrecision get_height_precision() const { return height_precision; }
+	[[nodiscard]] godot::Vector2 get_height_range() const { return height_range; }
+	[[nodiscard]] godot::Image::Format get_height_format() const;
+	[[nodiscard]] SimpleHeightmapSampler get_height_sampler() const { return SimpleHeightmapSampler(heightmap, height_range); }
+	[[nodiscard]] int get_chunk_size() const { return chunk_size; }
+	[[nodiscard]] RenderMode get_render_mode() const { return render_mode; }
+	[[nodiscard]] bool get_splatmap_texture() const { return splatmap_texture; }
+	[[nodiscard]] SplatEncoding get_splat_encoding() const { return splat_encoding; }
+	[[nodiscard]] int get_lod_levels() const { return lod_levels; }
+	[[nodiscard]] godot::real_t get_lod_distance() const { return lod_distance; }
+	[[nodiscard]] int get_rebuild_band_rows() const { return rebuild_band_rows; }
+	[[nodiscard]] int get_rebuild_thread_limit() const { return rebuild_thread_limit; }
+	[[nodiscard]] bool get_async_rebuild() const { return async_rebuild; }
 	[[nodiscard]] godot::real_t get_texture_size() const { return texture_size; }
+	[[nodiscard]] godot::Ref<SimpleHeightmapData> get_data() const { return heightmap_data; }
 	[[nodiscard]] godot::Ref<godot::Image> get_heightmap_image() const { return heightmap; }
 	[[nodiscard]] godot::Ref<godot::Image> get_splatmap_image() const { return splatmap; }
 	[[nodiscard]] godot::Ref<godot::Texture2D> get_texture_1() const { return texture_1; }
 	[[nodiscard]] godot::Ref<godot::Texture2D> get_texture_2() const { return texture_2; }
 	[[nodiscard]] godot::Ref<godot::Texture2D> get_texture_3() const { return texture_3; }
 	[[nodiscard]] godot::Ref<godot::Texture2D> get_texture_4() const { return texture_4; }
+	[[nodiscard]] godot::TypedArray<godot::Texture2D> get_texture_layers() const { return texture_layers; }
 	[[nodiscard]] uint32_t get_collider_layer() const { return collider_layer; }
 	[[nodiscard]] uint32_t get_collider_mask() const { return collider_mask; }
 	[[nodiscard]] float get_collider_priority() const { return collider_priority; }
+	[[nodiscard]] int get_collider_downsample() const { return collider_downsample; }
+	[[nodiscard]] godot::String get_stream_path() const { return stream_path; }
+	[[nodiscard]] godot::real_t get_stream_distance() const { return stream_distance; }
+	[[nodiscard]] int get_stream_memory_budget() const { return stream_memory_budget; }
+	[[nodiscard]] bool is_streaming() const { return stream.is_open(); }
 	
 	godot::Vector2 local_position_to_image_position(const godot::Vector3& local_position) const;
 	godot::Vector2 global_position_to_image_position(const godot::Vector3& global_position) const;
@@ -61,58 +133,295 @@ public:
 	godot::Vector3 image_position_to_local_position(const godot::Vector2& image_position) const;
 	godot::Vector3 image_position_to_global_position(const godot::Vector2& image_position) const;
 
+	// First point where a ray in global space hits the heightmap surface, null if it misses
+	godot::Variant intersect_ray(const godot::Vector3& from, const godot::Vector3& direction) const;
+	bool get_ray_intersection(const godot::Vector3& from, const godot::Vector3& direction, godot::Vector3& out_position) const;
+
+	// Global height of the surface above or below each point, and its global normal there
+	// Safe to call from any thread, they read a snapshot taken by the last rebuild or transform change
+	godot::PackedFloat32Array get_heights_at(const godot::PackedVector3Array& global_points) const;
+	godot::PackedVector3Array get_normals_at(const godot::PackedVector3Array& global_points) const;
+
+	// Vertex data held by the chunk meshes and sent by the last rebuild, for comparing render modes
+	godot::Dictionary get_mesh_stats() const;
+
 #ifdef TOOLS_ENABLED
-	uint32_t get_collider_shape_data_size() const { return get_vertices_per_side(); }
-	const godot::PackedRealArray& get_collider_shape_data() const { return collider_shape_data; }
-	godot::real_t get_collider_size() const { return static_cast<godot::real_t>(get_quads_per_side()); } // Each quad is 1 unit wide/deep, total size is all quads
+	uint32_t get_chunk_count() const { return chunks.size(); }
+	godot::Rect2i get_chunk_region(uint32_t index) const { return chunks[index].region; } // In quads, each quad is 1 unit wide/deep in collider space
+	const godot::PackedRealArray& get_chunk_collider_shape_data(uint32_t index) const { return chunks[index].collider_shape_data; }
+	godot::Vector2i get_chunk_collider_size(uint32_t index) const { return chunks[index].collider_size; } // Samples per side
+	godot::Vector2 get_chunk_collider_spacing(uint32_t index) const { return chunks[index].collider_step * get_quad_size(); } // Distance between samples
+	uint32_t get_chunk_collider_version(uint32_t index) const { return chunks[index].collider_version; } // Changes whenever the collider heights do
+	godot::real_t get_collider_scale() const { return get_quad_size(); }
 #endif // TOOLS_ENABLED
 
 private:
-	static void initialize_image(const godot::Ref<godot::Image>& image, godot::Image::Format format, int32_t size, godot::Color default_color = godot::Color());
-	static godot::Color bilinear_sample(const godot::Ref<godot::Image>& image, const godot::Vector2& point);
+	// A rectangular tile of the heightmap with its own mesh and collider shape
+	// When chunking is disabled there is a single chunk, rendered by the SimpleHeightmap itself
+	struct Chunk
+	{
+		godot::Rect2i region; // Quads covered by this chunk, in image coordinates
+
+		godot::RID mesh_id; // Shared between heightmaps in RENDER_MODE_GPU_DISPLACEMENT
+		godot::RID instance_id; // Only valid when chunking is enabled or the mesh is shared
+		godot::AABB aabb;
+		bool shared_mesh = false;
+		bool compact_vertices = false; // Surface uses the RENDER_MODE_CPU_COMPACT layout
+		bool vertex_colors = true; // Surface carries the splat weights, unless they're sampled from the splat tiles
+
+		// Level of detail of the current index buffer, and which sides are stitched to a coarser neighbour
+		uint8_t lod = 0;
+		uint8_t stitch_mask = 0;
+		uint64_t indices_key = 0; // Shared index data held by the surface, 0 when there is none
+
+		uint32_t cached_vertex_count = 0;
+
+		godot::Vector<uint32_t> surface_offsets;
+		godot::PackedByteArray surface_vertex_buffer;
+		godot::PackedByteArray surface_attribute_buffer;
+		uint32_t surface_vertex_stride = 0;
+		uint32_t surface_normal_tangent_stride = 0;
+		uint32_t surface_attribute_stride = 0;
+
+		godot::RID collider_shape_id;
+		godot::PackedRealArray collider_shape_data;
+		godot::Dictionary collider_shape_dict; // Reused for every shape_set_data call
+		godot::Vector2i collider_size; // Samples per side
+		godot::Vector2 collider_step; // Quads between samples
+		uint32_t collider_version = 0;
+		godot::real_t collider_shape_min_height = 0.0;
+		godot::real_t collider_shape_max_height = 0.0;
+
+		bool streamed = false; // Built from the stream since the last change to it, only used while streaming
+
+		uint32_t get_vertices_per_row() const { return region.size.x + 1; }
+		uint64_t get_resident_bytes() const { return surface_vertex_buffer.size() + surface_attribute_buffer.size() + collider_shape_data.size() * sizeof(godot::real_t); }
+		uint32_t get_vertex_count() const { return (region.size.x + 1) * (region.size.y + 1); }
+		uint8_t get_max_lod(int lod_levels) const
+		{
+			// Every level must divide the chunk evenly
+			uint8_t lod = 0;
+			while (lod < lod_levels && region.size.x % (2 << lod) == 0 && region.size.y % (2 << lod) == 0)
+				++lod;
+			return lod;
+		}
+	};
+
+	// A chunk being rebuilt on the CPU, its rows are split into bands that can be written in parallel
+	struct ChunkRebuild
+	{
+		uint32_t chunk_index = 0;
+		RebuildFlags flags = REBUILD_NONE;
+		bool full_rebuild = false;
+		godot::Vector2i first; // Affected vertices in chunk space, inclusive
+		godot::Vector2i last;
+		uint32_t first_band = 0;
+		uint32_t band_count = 0;
+
+		// Back buffers, bands write disjoint rows of them
+		godot::PackedByteArray vertex_buffer;
+		godot::PackedByteArray attribute_buffer;
+		uint8_t* vertex_p = nullptr;
+		uint8_t* attribute_p = nullptr;
+	};
+
+	// A chunk collider being refreshed, only the samples near the changed vertices are resampled
+	struct ColliderRebuild
+	{
+		uint32_t chunk_index = 0;
+		bool full_rebuild = false;
+		godot::Vector2i first; // Affected samples, inclusive
+		godot::Vector2i last;
+		godot::PackedRealArray data; // Back buffer
+		godot::real_t* data_p = nullptr;
+		godot::real_t min_height = 0.0;
+		godot::real_t max_height = 0.0;
+		bool changed = false; // Nothing is sent to the physics server unless a sample changed
+	};
+
+	struct RebuildBand
+	{
+		uint32_t chunk_rebuild = 0;
+		int32_t first_row = 0;
+		int32_t last_row = 0;
+		godot::real_t min_height = 0.0; // Merged into the chunk's bounds once every band is done
+		godot::real_t max_height = 0.0;
+	};
+
+	struct RebuildJob
+	{
+		RebuildFlags flags = REBUILD_NONE;
+		bool layout_changed = false;
+		SimpleHeightmapSampler height_sampler;
+		SimpleHeightmapSampler splat_sampler;
+		godot::Vector2i image_origin; // Image position of the samplers' first pixel, streamed chunks sample a window around themselves
+
+		// Settings the job started with, setters may change the node's while it runs
+		godot::real_t quad_size = 1.0;
+		godot::real_t uv_scale = 1.0;
+		float image_step = 1.0f;
+
+		godot::LocalVector<ChunkRebuild> chunks;
+		godot::LocalVector<RebuildBand> bands;
+		godot::LocalVector<ColliderRebuild> colliders;
+
+		uint32_t get_item_count() const { return bands.size() + colliders.size(); }
+	};
+
+	static void initialize_image(const godot::Ref<godot::Image>& image, godot::Image::Format format, int32_t size, godot::Color default_color = godot::Color(), godot::Image::Interpolation interpolation = godot::Image::INTERPOLATE_BILINEAR);
+	void initialize_heightmap();
+	void resize_heightmap();
+	void initialize_splatmap();
 	
-	void update_material_texture_parameter(const char* parameter_name, const godot::Ref<godot::Texture2D>& texture);
+	// The physics body, shader and material only exist while in the tree, chunks and textures are built after them
+	void create_server_resources();
+	void release_server_resources();
+
+	void update_shader_code(); // Picks the shader variant for the current render mode, splat encoding and textures
+	void update_material(); // Shares a material with other heightmaps when nothing in it is specific to this one
+	void release_material();
+	void set_material_parameters() const;
+	void apply_material_to_chunks();
+	void update_layer_texture();
+
+	RenderMode get_chunk_render_mode() const { return is_streaming() && render_mode == RENDER_MODE_GPU_DISPLACEMENT ? RENDER_MODE_CPU : render_mode; } // Streamed chunks are always built on the CPU
+	bool uses_texture_layers() const { return splat_encoding == SPLAT_ENCODING_LAYERS && !is_streaming(); }
+	bool uses_splat_texture() const { return (splatmap_texture || splat_encoding == SPLAT_ENCODING_LAYERS) && !is_streaming(); } // There is no splatmap image to upload while streaming
+	void run_rebuild(const godot::Rect2i& region, RebuildFlags flags);
+	void update_splat_tiles(const godot::Rect2i& region);
+	void clear_splat_tiles();
+	bool update_chunk_layout();
+	void clear_chunks();
+	void update_chunk_instances();
+	bool begin_chunk_rebuild(Chunk& chunk, uint32_t chunk_index, const godot::Rect2i& vertex_region, RebuildFlags flags, ChunkRebuild& chunk_rebuild);
+	void add_chunk_rebuild(uint32_t chunk_index, const godot::Rect2i& vertex_region, RebuildFlags flags);
+	void add_collider_rebuild(uint32_t chunk_index, const godot::Rect2i& vertex_region);
+	void rebuild_band(uint32_t band_index);
+	void end_chunk_rebuild(const ChunkRebuild& chunk_rebuild);
+	bool begin_collider_rebuild(Chunk& chunk, uint32_t chunk_index, const godot::Rect2i& vertex_region, ColliderRebuild& collider_rebuild);
+	void rebuild_collider(uint32_t collider_index);
+	void end_collider_rebuild(const ColliderRebuild& collider_rebuild);
+	void rebuild_job_item(uint32_t item_index);
+	void run_rebuild_job();
+	void finish_rebuild();
+	void update_rebuild_task();
+	void cancel_rebuild_task();
+	void update_internal_processing();
+	void queue_gizmo_update();
+	void rebuild_chunk_displacement(Chunk& chunk, uint32_t chunk_index, const godot::Rect2i& vertex_region, RebuildFlags flags, const SimpleHeightmapSampler& height_sampler, const SimpleHeightmapSampler& splat_sampler);
+	void add_chunk_surface(Chunk& chunk, const godot::PackedByteArray& vertex_data, const godot::PackedByteArray& attribute_data);
+	void set_chunk_lod(Chunk& chunk, uint8_t lod, uint8_t stitch_mask);
+	godot::Camera3D* get_active_camera() const;
+	void update_lod();
+	void update_stream();
+	bool build_streamed_chunk(uint32_t chunk_index);
+	void release_streamed_chunk(uint32_t chunk_index);
+	godot::Ref<godot::Image> create_height_layer(Chunk& chunk, const SimpleHeightmapSampler& height_sampler);
+	godot::Ref<godot::Image> create_splat_layer(const Chunk& chunk, const SimpleHeightmapSampler& splat_sampler) const;
 
 	uint32_t get_quads_per_side() const { return image_size; }
 	uint32_t get_vertices_per_side() const { return get_quads_per_side() + 1; }
 	uint32_t get_vertex_count() const { const auto n = get_vertices_per_side(); return n * n; }
 	uint32_t get_index_count() const { const auto n = get_quads_per_side(); return n * n * 6; }
 	godot::real_t get_quad_size() const { return mesh_size / static_cast<godot::real_t>(get_quads_per_side()); }
+	uint32_t get_displacement_layer_size() const { return get_quads_per_chunk() + 3; } // Chunk vertices plus a border for normals
+	uint32_t get_quads_per_chunk() const;
+
+	static constexpr uint32_t max_displacement_chunk_size = 128; // An edit re-samples and uploads each displacement layer it touches whole
 
 	godot::real_t mesh_size = 4.0; // Mesh size
 	
 	int image_size = 16; // Size of the heightmap image (e.g., 64x64)
+	HeightPrecision height_precision = HEIGHT_PRECISION_FLOAT;
+	godot::Vector2 height_range = godot::Vector2(-256.0, 256.0); // Lowest and highest height HEIGHT_PRECISION_QUANTIZED can store
+	int chunk_size = 0; // Quads per chunk side, 0 builds the whole heightmap as one mesh, capped at max_displacement_chunk_size in RENDER_MODE_GPU_DISPLACEMENT
+	RenderMode render_mode = RENDER_MODE_CPU;
+	bool splatmap_texture = false; // Sample splat weights per pixel from a tiled texture, rather than per vertex from COLOR
+	SplatEncoding splat_encoding = SPLAT_ENCODING_WEIGHTS;
+	int lod_levels = 0; // Number of coarser levels chunks may switch to, 0 disables level of detail
+	godot::real_t lod_distance = 32.0; // Distance at which chunks drop to the first coarser level, doubling for each level after that
+	int rebuild_band_rows = 64; // Rows of vertices written by each worker thread task
+	int rebuild_thread_limit = 0; // Most worker threads a rebuild may use, 0 uses the whole pool
+	bool async_rebuild = false; // Rebuild on a background task, uploading the result on a later frame
+	godot::Ref<SimpleHeightmapData> heightmap_data; // When set, heightmap and splatmap are its images and are saved with it
 	godot::Ref<godot::Image> heightmap;
+	SimpleHeightmapPyramid height_pyramid; // Kept up to date with the heightmap by every rebuild
+
+	// Everything the batched height queries read, copied under query_mutex so worker threads never touch the node
+	struct QueryState
+	{
+		SimpleHeightmapSampler heights;
+		godot::Transform3D transform;
+		godot::Transform3D inverse_transform;
+		godot::Basis normal_basis;
+		godot::real_t image_scale = 0.0; // Pixels per local unit
+		godot::real_t image_size = 0.0;
+	};
+	[[nodiscard]] QueryState get_query_state() const;
+	void update_query_state(const godot::Rect2i& changed_region = godot::Rect2i()); // Region of the heightmap edited since the last update
+	void clear_query_state();
+	void transform_query_points(const QueryState& state, const godot::PackedVector3Array& global_points, godot::LocalVector<float>& xs, godot::LocalVector<float>& zs) const;
+	mutable std::mutex query_mutex;
+	QueryState query_state;
+
+	// Heightmap pixels the queries sample, copied rather than shared so the brushes never write into a buffer with two owners
+	godot::PackedByteArray query_heights;
+	godot::Image::Format query_heights_format = godot::Image::FORMAT_MAX;
+	godot::Vector2i query_heights_size;
 
 	godot::real_t texture_size = 1.0;
 	godot::Ref<godot::Image> splatmap;
 
-	godot::RID shader_id;
+	bool server_resources = false;
+	godot::RID shader_id; // Shared by every heightmap drawing the same variant
+	godot::String shader_code; // Current variant, which is also its key among the shared shaders
 	godot::RID material_id;
+	godot::String material_key; // Key among the shared materials, empty while material_id belongs to this heightmap alone
 	godot::Ref<godot::Texture2D> texture_1;
 	godot::Ref<godot::Texture2D> texture_2;
 	godot::Ref<godot::Texture2D> texture_3;
 	godot::Ref<godot::Texture2D> texture_4;
+	godot::TypedArray<godot::Texture2D> texture_layers;
+	godot::RID layer_texture_id; // texture_layers packed into one Texture2DArray
+
+	godot::LocalVector<Chunk> chunks;
+	uint32_t cached_quads_per_chunk = 0;
+	uint32_t cached_chunk_image_size = 0;
+	RebuildJob rebuild_job;
+	int64_t rebuild_task_id = -1; // Background task of an asynchronous rebuild, -1 when none is running
+	godot::Rect2i pending_rebuild_region;
+	RebuildFlags pending_rebuild_flags = REBUILD_NONE;
+	bool rebuild_queued = false; // Requested since the last flush, flags alone don't tell as a request may only change the layout
+	godot::Rect2i queued_rebuild_region;
+	RebuildFlags queued_rebuild_flags = REBUILD_NONE;
+	uint64_t rebuild_upload_bytes = 0; // Vertex and layer data sent to the RenderingServer by the last rebuild
 
-	godot::RID mesh_id;
-	uint32_t cached_vertex_count = 0;
-	uint32_t cached_index_count = 0;
+	// One layer per chunk, so an edit only uploads the chunks it touched
+	godot::RID height_texture_id;
+	godot::RID splat_texture_id;
 
-	godot::Vector<uint32_t> surface_offsets;
-	godot::PackedByteArray surface_vertex_buffer;
-	godot::PackedByteArray surface_attribute_buffer;
-	uint32_t surface_vertex_stride;
-	uint32_t surface_normal_tangent_stride;
-	uint32_t surface_attribute_stride;
+	// The splatmap in tiles, one layer each, so a brush stroke only uploads the tiles it touched
+	godot::RID splat_tiles_texture_id;
+	godot::Vector2i splat_tiles_image_size; // Size of the splatmap the tiles were made from
 
 	uint32_t collider_layer = 1;
 	uint32_t collider_mask = 1;
 	float collider_priority = 1.0f;
+#ifdef TOOLS_ENABLED
+	uint64_t last_gizmo_update_msec = 0;
+	bool gizmo_update_queued = false;
+#endif // TOOLS_ENABLED
+	int collider_downsample = 1; // Quads per collider cell, larger values give physics a coarser grid than rendering
 	godot::RID collider_body_id;
-	godot::RID collider_shape_id;
-	godot::PackedRealArray collider_shape_data;
-	godot::real_t collider_shape_min_height;
-	godot::real_t collider_shape_max_height;
+
+	// Chunks near the camera are read from the stream and built, the farthest are dropped to stay within the budget
+	SimpleHeightmapDataStream stream;
+	godot::String stream_path; // .shmap file streamed in place of the heightmap and splatmap images, empty to disable streaming
+	godot::real_t stream_distance = 256.0; // Chunks this close to the camera are loaded and kept
+	int stream_memory_budget = 256; // MiB of chunk buffers and decoded tiles kept resident
 };
 
-VARIANT_ENUM_CAST(SimpleHeightmap::RebuildFlags);
\ No newline at end of file
+VARIANT_ENUM_CAST(SimpleHeightmap::RebuildFlags);
+VARIANT_ENUM_CAST(SimpleHeightmap::RenderMode);
+VARIANT_ENUM_CAST(SimpleHeightmap::HeightPrecision);
+VARIANT_ENUM_CAST(SimpleHeightmap::SplatEncoding);
\ No newline at end of file
@@ -0,0 +1,365 @@
+#ifdef TOOLS_ENABLED
+#include "simple_heightmap_brush.h"
+#include "simple_heightmap_height_codec.h"
+#include "simple_heightmap_splat.h"
+
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMPLE_HEIGHTMAP_SSE2
+#endif
+
+namespace
+{
+	// Same curve as @GlobalScope.ease, kept local so painting does not call into the engine per pixel
+	float ease_curve(float x, float c)
+	{
+		x = godot::Math::clamp(x, 0.0f, 1.0f);
+		if (c > 0.0f)
+		{
+			return c < 1.0f ? 1.0f - godot::Math::pow(1.0f - x, 1.0f / c) : godot::Math::pow(x, c);
+		}
+		if (c < 0.0f)
+		{
+			return x < 0.5f
+				? godot::Math::pow(x * 2.0f, -c) * 0.5f
+				: (1.0f - godot::Math::pow(1.0f - (x - 0.5f) * 2.0f, -c)) * 0.5f + 0.5f;
+		}
+		return 0.0f;
+	}
+
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+	// Math::move_toward for non-negative deltas
+	__m128 move_toward_ps(__m128 from, __m128 to, __m128 delta)
+	{
+		return _mm_min_ps(_mm_max_ps(to, _mm_sub_ps(from, delta)), _mm_add_ps(from, delta));
+	}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+
+	// Height kernels work on float rows, heights stored at a lower precision are decoded into a scratch row
+	// before the kernel runs and encoded back after it
+	struct HeightRows
+	{
+		uint8_t* pixels;
+		int32_t width;
+		SimpleHeightmapHeightCodec codec;
+		mutable godot::LocalVector<float> scratch;
+
+		float* begin(int32_t x, int32_t y, int32_t count) const
+		{
+			const auto index = x + static_cast<int64_t>(y) * width;
+			if (codec.is_float())
+			{
+				return reinterpret_cast<float*>(pixels) + index;
+			}
+			scratch.resize(count);
+			codec.decode_row(pixels, index, count, scratch.ptr());
+			return scratch.ptr();
+		}
+
+		void end(int32_t x, int32_t y, int32_t count) const
+		{
+			if (!codec.is_float())
+			{
+				codec.encode_row(scratch.ptr(), count, pixels, x + static_cast<int64_t>(y) * width);
+			}
+		}
+	};
+
+	// Kernels are called once per brush row with the amount to apply to each pixel of the row
+
+	struct RaiseKernel
+	{
+		const HeightRows& rows;
+		float sign;
+
+		void operator()(int32_t x, int32_t y, int32_t count, const float* amounts) const
+		{
+			const auto row = rows.begin(x, y, count);
+			int32_t i = 0;
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+			const auto signs = _mm_set1_ps(sign);
+			for (; i + 4 <= count; i += 4)
+			{
+				_mm_storeu_ps(&row[i], _mm_add_ps(_mm_loadu_ps(&row[i]), _mm_mul_ps(signs, _mm_loadu_ps(&amounts[i]))));
+			}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+			for (; i < count; ++i)
+			{
+				row[i] += sign * amounts[i];
+			}
+			rows.end(x, y, count);
+		}
+	};
+
+	struct FlattenKernel
+	{
+		const HeightRows& rows;
+		float target;
+
+		void operator()(int32_t x, int32_t y, int32_t count, const float* amounts) const
+		{
+			const auto row = rows.begin(x, y, count);
+			int32_t i = 0;
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+			const auto targets = _mm_set1_ps(target);
+			for (; i + 4 <= count; i += 4)
+			{
+				_mm_storeu_ps(&row[i], move_toward_ps(_mm_loadu_ps(&row[i]), targets, _mm_loadu_ps(&amounts[i])));
+			}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+			for (; i < count; ++i)
+			{
+				row[i] = godot::Math::move_toward(row[i], target, amounts[i]);
+			}
+			rows.end(x, y, count);
+		}
+	};
+
+	// Reads neighbours from a copy of the heights taken before the step, so the result does not depend on row order
+	// The copy has a one pixel border, repeating the edge of the image where the brush touches it
+	struct SmoothKernel
+	{
+		const HeightRows& rows;
+		const float* source;
+		int32_t source_stride;
+		godot::Vector2i source_origin; // Image position of the first pixel inside the border
+
+		void operator()(int32_t x, int32_t y, int32_t count, const float* amounts) const
+		{
+			const auto row = rows.begin(x, y, count);
+			const auto center = source + (x - source_origin.x + 1) + static_cast<int64_t>(y - source_origin.y + 1) * source_stride;
+			const auto above = center - source_stride;
+			const auto below = center + source_stride;
+			int32_t i = 0;
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+			const auto fifth = _mm_set1_ps(0.2f);
+			for (; i + 4 <= count; i += 4)
+			{
+				const auto c = _mm_loadu_ps(&center[i]);
+				auto sum = _mm_add_ps(c, _mm_loadu_ps(&center[i + 1]));
+				sum = _mm_add_ps(sum, _mm_loadu_ps(&below[i]));
+				sum = _mm_add_ps(sum, _mm_loadu_ps(&center[i - 1]));
+				sum = _mm_add_ps(sum, _mm_loadu_ps(&above[i]));
+				_mm_storeu_ps(&row[i], move_toward_ps(c, _mm_mul_ps(sum, fifth), _mm_loadu_ps(&amounts[i])));
+			}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+			for (; i < count; ++i)
+			{
+				const auto average = (center[i] + center[i + 1] + below[i] + center[i - 1] + above[i]) * 0.2f;
+				row[i] = godot::Math::move_toward(center[i], average, amounts[i]);
+			}
+			rows.end(x, y, count);
+		}
+	};
+
+	// Moves every channel towards 0, except Channel which moves towards 1
+	// Works in 0-255 space and rounds, so pixels outside the falloff come back unchanged
+	template <int32_t Channel>
+	struct SplatKernel
+	{
+		uint8_t* pixels;
+		int32_t width;
+
+		void operator()(int32_t x, int32_t y, int32_t count, const float* amounts) const
+		{
+			const auto row = pixels + (x + static_cast<int64_t>(y) * width) * 4;
+			int32_t i = 0;
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+			const auto zero = _mm_setzero_si128();
+			const auto half = _mm_set1_ps(0.5f);
+			const auto scale = _mm_set1_ps(255.0f);
+			const auto target = _mm_setr_ps(Channel == 0 ? 255.0f : 0.0f, Channel == 1 ? 255.0f : 0.0f, Channel == 2 ? 255.0f : 0.0f, Channel == 3 ? 255.0f : 0.0f);
+			for (; i + 4 <= count; i += 4)
+			{
+				// One register per pixel, holding its four channels
+				const auto texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[i * 4]));
+				const auto low = _mm_unpacklo_epi8(texels, zero);
+				const auto high = _mm_unpackhi_epi8(texels, zero);
+				const __m128 colors[4] = {
+					_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)),
+					_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)),
+					_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)),
+					_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero))
+				};
+				__m128i results[4];
+				for (int32_t lane = 0; lane < 4; ++lane)
+				{
+					const auto amount = _mm_mul_ps(_mm_set1_ps(amounts[i + lane]), scale);
+					results[lane] = _mm_cvttps_epi32(_mm_add_ps(move_toward_ps(colors[lane], target, amount), half));
+				}
+				const auto packed = _mm_packus_epi16(_mm_packs_epi32(results[0], results[1]), _mm_packs_epi32(results[2], results[3]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&row[i * 4]), packed);
+			}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+			for (; i < count; ++i)
+			{
+				const auto amount = amounts[i] * 255.0f;
+				for (int32_t channel = 0; channel < 4; ++channel)
+				{
+					auto& value = row[i * 4 + channel];
+					const auto target = channel == Channel ? 255.0f : 0.0f;
+					value = static_cast<uint8_t>(godot::Math::move_toward(static_cast<float>(value), target, amount) + 0.5f);
+				}
+			}
+		}
+	};
+
+	// Same as SplatKernel for splatmaps naming their layers, each pixel is decoded to a weight per layer and re-encoded
+	struct LayerSplatKernel
+	{
+		uint8_t* pixels;
+		int32_t width;
+		int32_t layer;
+
+		void operator()(int32_t x, int32_t y, int32_t count, const float* amounts) const
+		{
+			const auto row = pixels + (x + static_cast<int64_t>(y) * width) * 4;
+			for (int32_t i = 0; i < count; ++i)
+			{
+				float weights[SimpleHeightmapSplat::MAX_LAYERS] = {};
+				SimpleHeightmapSplat::decode_layers(&row[i * 4], weights);
+				for (int32_t index = 0; index < SimpleHeightmapSplat::MAX_LAYERS; ++index)
+				{
+					weights[index] = godot::Math::move_toward(weights[index], index == layer ? 1.0f : 0.0f, amounts[i]);
+				}
+				SimpleHeightmapSplat::encode_layers(weights, &row[i * 4]);
+			}
+		}
+	};
+
+	// Walks the rows of the brush, only visiting pixels inside its circle
+	template <typename Kernel>
+	void paint(const Kernel& kernel, const godot::Rect2i& region, const SimpleHeightmapBrush::Settings& settings, float delta)
+	{
+		godot::LocalVector<float> amounts;
+		amounts.resize(region.size.x);
+
+		const auto scale = settings.strength * delta;
+		const auto radius_squared = settings.radius * settings.radius;
+		for (int32_t y = region.position.y; y < region.get_end().y; ++y)
+		{
+			const auto dy = static_cast<float>(y) - settings.center.y;
+			const auto span_squared = radius_squared - dy * dy;
+			if (span_squared <= 0.0f)
+			{
+				continue;
+			}
+
+			const auto span = godot::Math::sqrt(span_squared);
+			const auto first = godot::Math::max(region.position.x, static_cast<int32_t>(godot::Math::ceil(settings.center.x - span)));
+			const auto last = godot::Math::min(region.get_end().x, static_cast<int32_t>(godot::Math::floor(settings.center.x + span)) + 1);
+			if (first >= last)
+			{
+				continue;
+			}
+
+			for (int32_t x = first; x < last; ++x)
+			{
+				const auto dx = static_cast<float>(x) - settings.center.x;
+				amounts[x - first] = SimpleHeightmapBrush::get_weight(godot::Math::sqrt(dx * dx + dy * dy), settings.radius, settings.ease) * scale;
+			}
+			kernel(first, y, last - first, amounts.ptr());
+		}
+	}
+}
+
+float SimpleHeightmapBrush::get_weight(float distance, float radius, float ease)
+{
+	return ease_curve(godot::Math::max(1.0f - distance / radius, 0.0f), ease);
+}
+
+godot::Rect2i SimpleHeightmapBrush::get_region(const godot::Vector2& center, float radius, int32_t width, int32_t height)
+{
+	const auto min = godot::Vector2i(
+		godot::Math::clamp(static_cast<int32_t>(godot::Math::round(center.x - radius)), 0, width),
+		godot::Math::clamp(static_cast<int32_t>(godot::Math::round(center.y - radius)), 0, height)
+	);
+	const auto max = godot::Vector2i(
+		godot::Math::clamp(static_cast<int32_t>(godot::Math::round(center.x + radius)), 0, width),
+		godot::Math::clamp(static_cast<int32_t>(godot::Math::round(center.y + radius)), 0, height)
+	);
+	return godot::Rect2i(min, max - min);
+}
+
+godot::Rect2i SimpleHeightmapBrush::apply(const godot::Ref<godot::Image>& image, const Settings& settings, float delta)
+{
+	ERR_FAIL_COND_V(image.is_null() || image->is_empty(), godot::Rect2i());
+
+	const auto width = image->get_width();
+	const auto height = image->get_height();
+	const auto region = get_region(settings.center, settings.radius, width, height);
+	if (settings.operation == Operation::None || settings.radius <= 0.0f || !region.has_area())
+	{
+		return godot::Rect2i();
+	}
+
+	if (settings.operation == Operation::Splat)
+	{
+		ERR_FAIL_COND_V_MSG(image->get_format() != godot::Image::FORMAT_RGBA8, godot::Rect2i(), "Splatmap brushes require an RGBA8 image.");
+		ERR_FAIL_INDEX_V(settings.splat_channel, settings.splat_layers ? SimpleHeightmapSplat::MAX_LAYERS : 4, godot::Rect2i());
+
+		const auto pixels = image->ptrw();
+		if (settings.splat_layers)
+		{
+			paint(LayerSplatKernel { pixels, width, settings.splat_channel }, region, settings, delta);
+			return region;
+		}
+		switch (settings.splat_channel)
+		{
+			case 0: paint(SplatKernel<0> { pixels, width }, region, settings, delta); break;
+			case 1: paint(SplatKernel<1> { pixels, width }, region, settings, delta); break;
+			case 2: paint(SplatKernel<2> { pixels, width }, region, settings, delta); break;
+			case 3: paint(SplatKernel<3> { pixels, width }, region, settings, delta); break;
+		}
+		return region;
+	}
+
+	ERR_FAIL_COND_V_MSG(!SimpleHeightmapHeightCodec::is_supported(image->get_format()), godot::Rect2i(), "Heightmap brushes require an RF, RH or RG8 image.");
+	const HeightRows rows { image->ptrw(), width, SimpleHeightmapHeightCodec(image->get_format(), settings.height_range) };
+	switch (settings.operation)
+	{
+		case Operation::Raise:
+		case Operation::Lower:
+		{
+			paint(RaiseKernel { rows, settings.operation == Operation::Raise ? 1.0f : -1.0f }, region, settings, delta);
+			break;
+		}
+		case Operation::Flatten:
+		{
+			paint(FlattenKernel { rows, settings.flatten_target }, region, settings, delta);
+			break;
+		}
+		case Operation::Smooth:
+		{
+			// Copy the heights under the brush with a one pixel border, clamped to the image edge
+			const auto stride = region.size.x + 2;
+			godot::LocalVector<float> source;
+			source.resize(stride * (region.size.y + 2));
+			godot::LocalVector<float> image_row;
+			image_row.resize(region.size.x + 2);
+			for (int32_t y = -1; y <= region.size.y; ++y)
+			{
+				// Only the row's span under the brush is decoded, the border columns are clamped separately
+				const auto image_y = godot::Math::clamp(region.position.y + y, 0, height - 1);
+				const auto first = godot::Math::max(region.position.x - 1, 0);
+				const auto last = godot::Math::min(region.get_end().x, width - 1);
+				rows.codec.decode_row(rows.pixels, first + static_cast<int64_t>(image_y) * width, last - first + 1, image_row.ptr());
+				for (int32_t x = -1; x <= region.size.x; ++x)
+				{
+					source[(x + 1) + (y + 1) * stride] = image_row[godot::Math::clamp(region.position.x + x, 0, width - 1) - first];
+				}
+			}
+			paint(SmoothKernel { rows, source.ptr(), stride, region.position }, region, settings, delta);
+			break;
+		}
+		default:
+			break;
+	}
+	return region;
+}
+
+#endif // TOOLS_ENABLED
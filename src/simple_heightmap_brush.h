@@ -0,0 +1,47 @@
+#pragma once
+
+#ifdef TOOLS_ENABLED
+
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/variant/rect2i.hpp>
+#include <godot_cpp/variant/vector2.hpp>
+
+#include <cstdint>
+
+// Editor brushes, painting straight into the pixel buffer of a heightmap (FORMAT_RF, FORMAT_RH or FORMAT_RG8) or splatmap (FORMAT_RGBA8)
+namespace SimpleHeightmapBrush
+{
+	enum class Operation : uint8_t
+	{
+		None,
+		Raise,
+		Lower,
+		Smooth,
+		Flatten,
+		Splat
+	};
+
+	struct Settings
+	{
+		Operation operation = Operation::None;
+		godot::Vector2 center; // In pixels
+		float radius = 0.0f; // In pixels
+		float strength = 0.0f;
+		float ease = 1.0f;
+		float flatten_target = 0.0f;
+		godot::Vector2 height_range; // Heights FORMAT_RG8 heightmaps are quantized over
+		int32_t splat_channel = 0;
+		bool splat_layers = false; // splat_channel is a texture layer of a SimpleHeightmap::SPLAT_ENCODING_LAYERS splatmap
+	};
+
+	// Falloff of the brush at distance pixels from its center, between 0 and 1
+	float get_weight(float distance, float radius, float ease);
+
+	// Pixels covered by the brush, clamped to the image
+	godot::Rect2i get_region(const godot::Vector2& center, float radius, int32_t width, int32_t height);
+
+	// Applies one step of the brush, returns the region that was modified
+	godot::Rect2i apply(const godot::Ref<godot::Image>& image, const Settings& settings, float delta);
+}
+
+#endif // TOOLS_ENABLED
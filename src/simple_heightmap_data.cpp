@@ -0,0 +1,594 @@
+#include "simple_heightmap_data.h"
+#include "simple_heightmap_height_codec.h"
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+
+namespace
+{
+	// File layout, all values little endian:
+	//   "SHMD", u32 version, u32 tile size
+	//   Heights: u32 width, u32 height, f32 offset, f32 scale, u32 compressed size of each tile, tile data
+	//   Splat: u32 width, u32 height, u32 compressed size of each tile, tile data
+	// Tiles are in row order, each one zstd compressed on its own
+	// Height tiles hold u16 heights with every row delta encoded, splat tiles hold each channel as its own plane
+	constexpr char MAGIC[4] = { 'S', 'H', 'M', 'D' };
+	constexpr uint32_t VERSION = 1;
+	constexpr uint32_t TILE_SIZE = 64;
+	constexpr auto COMPRESSION = godot::FileAccess::COMPRESSION_ZSTD;
+
+	struct ByteWriter
+	{
+		godot::LocalVector<uint8_t> bytes;
+
+		template <typename T>
+		void write(const T& value)
+		{
+			const auto offset = bytes.size();
+			bytes.resize(offset + sizeof(T));
+			memcpy(&bytes[offset], &value, sizeof(T));
+		}
+
+		void write_bytes(const godot::PackedByteArray& data)
+		{
+			const auto offset = bytes.size();
+			bytes.resize(offset + data.size());
+			memcpy(bytes.ptr() + offset, data.ptr(), data.size());
+		}
+	};
+
+	struct ByteReader
+	{
+		const uint8_t* bytes;
+		int64_t size;
+		int64_t offset = 0;
+
+		template <typename T>
+		bool read(T& value)
+		{
+			if (offset + static_cast<int64_t>(sizeof(T)) > size)
+			{
+				return false;
+			}
+			memcpy(&value, bytes + offset, sizeof(T));
+			offset += sizeof(T);
+			return true;
+		}
+	};
+
+	godot::Vector2i get_tile_count(int32_t width, int32_t height)
+	{
+		return godot::Vector2i((width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE);
+	}
+
+	godot::Rect2i get_tile_rect(int32_t width, int32_t height, int32_t x, int32_t y)
+	{
+		return godot::Rect2i(x * TILE_SIZE, y * TILE_SIZE, TILE_SIZE, TILE_SIZE).intersection(godot::Rect2i(0, 0, width, height));
+	}
+
+	// Writes the compressed size of every tile followed by the tiles, encode_tile fills the uncompressed bytes of one tile
+	template <typename EncodeTile>
+	void write_tiles(ByteWriter& writer, int32_t width, int32_t height, EncodeTile encode_tile)
+	{
+		const auto count = get_tile_count(width, height);
+		godot::LocalVector<godot::PackedByteArray> tiles;
+		tiles.resize(count.x * count.y);
+		for (int32_t y = 0; y < count.y; ++y)
+		{
+			for (int32_t x = 0; x < count.x; ++x)
+			{
+				tiles[x + y * count.x] = encode_tile(get_tile_rect(width, height, x, y)).compress(COMPRESSION);
+			}
+		}
+		for (const auto& tile : tiles)
+		{
+			writer.write(static_cast<uint32_t>(tile.size()));
+		}
+		for (const auto& tile : tiles)
+		{
+			writer.write_bytes(tile);
+		}
+	}
+
+	// Tiles decode into a destination with its own row stride, the whole image or a single cached tile
+	void decode_height_tile(const uint8_t* tile, const godot::Vector2i& size, float offset, float scale, float* out, int64_t out_stride)
+	{
+		auto in = reinterpret_cast<const uint16_t*>(tile);
+		for (int32_t y = 0; y < size.y; ++y)
+		{
+			uint16_t quantized = 0;
+			const auto row = out + y * out_stride;
+			for (int32_t x = 0; x < size.x; ++x)
+			{
+				quantized = static_cast<uint16_t>(quantized + *in++);
+				row[x] = offset + static_cast<float>(quantized) * scale;
+			}
+		}
+	}
+
+	void decode_splat_tile(const uint8_t* tile, const godot::Vector2i& size, uint8_t* out, int64_t out_stride)
+	{
+		for (int32_t channel = 0; channel < 4; ++channel)
+		{
+			for (int32_t y = 0; y < size.y; ++y)
+			{
+				const auto row = out + y * out_stride * 4;
+				for (int32_t x = 0; x < size.x; ++x)
+				{
+					row[x * 4 + channel] = *tile++;
+				}
+			}
+		}
+	}
+
+	// Reads the tile table and passes every decompressed tile to decode_tile
+	template <typename DecodeTile>
+	bool read_tiles(ByteReader& reader, int32_t width, int32_t height, int32_t bytes_per_pixel, DecodeTile decode_tile)
+	{
+		const auto count = get_tile_count(width, height);
+		godot::LocalVector<uint32_t> sizes;
+		sizes.resize(count.x * count.y);
+		for (auto& size : sizes)
+		{
+			if (!reader.read(size))
+			{
+				return false;
+			}
+		}
+
+		godot::PackedByteArray compressed;
+		for (int32_t y = 0; y < count.y; ++y)
+		{
+			for (int32_t x = 0; x < count.x; ++x)
+			{
+				const auto size = sizes[x + y * count.x];
+				if (reader.offset + size > reader.size)
+				{
+					return false;
+				}
+				compressed.resize(size);
+				memcpy(compressed.ptrw(), reader.bytes + reader.offset, size);
+				reader.offset += size;
+
+				const auto rect = get_tile_rect(width, height, x, y);
+				const auto expected_size = rect.get_area() * bytes_per_pixel;
+				const auto tile = compressed.decompress(expected_size, COMPRESSION);
+				if (tile.size() != expected_size)
+				{
+					return false;
+				}
+				decode_tile(rect, tile.ptr());
+			}
+		}
+		return true;
+	}
+}
+
+void SimpleHeightmapData::_bind_methods()
+{
+	godot::ClassDB::bind_method(godot::D_METHOD("set_heightmap_image", "image"), &SimpleHeightmapData::set_heightmap_image);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_splatmap_image", "image"), &SimpleHeightmapData::set_splatmap_image);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_heightmap_image"), &SimpleHeightmapData::get_heightmap_image);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_splatmap_image"), &SimpleHeightmapData::get_splatmap_image);
+	godot::ClassDB::bind_method(godot::D_METHOD("set_encoded_data", "bytes"), &SimpleHeightmapData::set_encoded_data);
+	godot::ClassDB::bind_method(godot::D_METHOD("get_encoded_data"), &SimpleHeightmapData::get_encoded_data);
+
+	// Only the encoded form is saved, the images are what the node and the editor work with
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "heightmap_image", godot::PROPERTY_HINT_RESOURCE_TYPE, "Image", godot::PROPERTY_USAGE_EDITOR), "set_heightmap_image", "get_heightmap_image");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::OBJECT, "splatmap_image", godot::PROPERTY_HINT_RESOURCE_TYPE, "Image", godot::PROPERTY_USAGE_EDITOR), "set_splatmap_image", "get_splatmap_image");
+	ADD_PROPERTY(godot::PropertyInfo(godot::Variant::PACKED_BYTE_ARRAY, "encoded_data", godot::PROPERTY_HINT_NONE, "", godot::PROPERTY_USAGE_STORAGE), "set_encoded_data", "get_encoded_data");
+}
+
+godot::PackedByteArray SimpleHeightmapData::encode() const
+{
+	ByteWriter writer;
+	writer.write(MAGIC);
+	writer.write(VERSION);
+	writer.write(TILE_SIZE);
+
+	// Heights
+	const auto has_heights = heightmap.is_valid() && !heightmap->is_empty();
+	ERR_FAIL_COND_V_MSG(has_heights && !SimpleHeightmapHeightCodec::is_supported(heightmap->get_format()), godot::PackedByteArray(), "SimpleHeightmapData heightmap image must be FORMAT_RF, FORMAT_RH or FORMAT_RG8.");
+	const auto height_width = has_heights ? heightmap->get_width() : 0;
+	const auto height_height = has_heights ? heightmap->get_height() : 0;
+
+	// Quantization needs the real heights, whatever precision the image holds them at
+	godot::LocalVector<float> decoded_heights;
+	if (has_heights)
+	{
+		const auto codec = SimpleHeightmapHeightCodec(heightmap->get_format(), height_range);
+		decoded_heights.resize(height_width * height_height);
+		for (int32_t y = 0; y < height_height; ++y)
+		{
+			codec.decode_row(heightmap->ptr(), static_cast<int64_t>(y) * height_width, height_width, decoded_heights.ptr() + static_cast<int64_t>(y) * height_width);
+		}
+	}
+	const auto heights = decoded_heights.ptr();
+
+	auto min_height = std::numeric_limits<float>::max();
+	auto max_height = std::numeric_limits<float>::lowest();
+	for (int64_t i = 0; i < static_cast<int64_t>(height_width) * height_height; ++i)
+	{
+		min_height = godot::Math::min(min_height, heights[i]);
+		max_height = godot::Math::max(max_height, heights[i]);
+	}
+	const auto offset = has_heights ? min_height : 0.0f;
+	const auto scale = has_heights && max_height > min_height ? (max_height - min_height) / 65535.0f : 0.0f;
+	const auto inverse_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+	writer.write(static_cast<uint32_t>(height_width));
+	writer.write(static_cast<uint32_t>(height_height));
+	writer.write(offset);
+	writer.write(scale);
+	write_tiles(writer, height_width, height_height, [&](const godot::Rect2i& rect)
+	{
+		godot::PackedByteArray tile;
+		tile.resize(rect.get_area() * sizeof(uint16_t));
+		auto out = reinterpret_cast<uint16_t*>(tile.ptrw());
+		for (int32_t y = rect.position.y; y < rect.get_end().y; ++y)
+		{
+			uint16_t previous = 0;
+			for (int32_t x = rect.position.x; x < rect.get_end().x; ++x)
+			{
+				const auto quantized = static_cast<uint16_t>(godot::Math::clamp(godot::Math::round((heights[x + static_cast<int64_t>(y) * height_width] - offset) * inverse_scale), 0.0f, 65535.0f));
+				*out++ = static_cast<uint16_t>(quantized - previous);
+				previous = quantized;
+			}
+		}
+		return tile;
+	});
+
+	// Splat weights
+	const auto has_splat = splatmap.is_valid() && !splatmap->is_empty();
+	ERR_FAIL_COND_V_MSG(has_splat && splatmap->get_format() != godot::Image::FORMAT_RGBA8, godot::PackedByteArray(), "SimpleHeightmapData splatmap image must be FORMAT_RGBA8.");
+	const auto splat_width = has_splat ? splatmap->get_width() : 0;
+	const auto splat_height = has_splat ? splatmap->get_height() : 0;
+	const auto splat = has_splat ? splatmap->ptr() : nullptr;
+
+	writer.write(static_cast<uint32_t>(splat_width));
+	writer.write(static_cast<uint32_t>(splat_height));
+	write_tiles(writer, splat_width, splat_height, [&](const godot::Rect2i& rect)
+	{
+		godot::PackedByteArray tile;
+		tile.resize(rect.get_area() * 4);
+		auto out = tile.ptrw();
+		for (int32_t channel = 0; channel < 4; ++channel)
+		{
+			for (int32_t y = rect.position.y; y < rect.get_end().y; ++y)
+			{
+				for (int32_t x = rect.position.x; x < rect.get_end().x; ++x)
+				{
+					*out++ = splat[(x + static_cast<int64_t>(y) * splat_width) * 4 + channel];
+				}
+			}
+		}
+		return tile;
+	});
+
+	godot::PackedByteArray bytes;
+	bytes.resize(writer.bytes.size());
+	memcpy(bytes.ptrw(), writer.bytes.ptr(), writer.bytes.size());
+	return bytes;
+}
+
+godot::Error SimpleHeightmapData::decode(const godot::PackedByteArray& bytes)
+{
+	ByteReader reader { bytes.ptr(), bytes.size() };
+
+	char magic[4];
+	uint32_t version = 0;
+	uint32_t tile_size = 0;
+	ERR_FAIL_COND_V_MSG(!reader.read(magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0, godot::ERR_FILE_UNRECOGNIZED, "Not a SimpleHeightmapData file.");
+	ERR_FAIL_COND_V_MSG(!reader.read(version) || version != VERSION, godot::ERR_FILE_UNRECOGNIZED, "Unsupported SimpleHeightmapData version.");
+	ERR_FAIL_COND_V(!reader.read(tile_size) || tile_size != TILE_SIZE, godot::ERR_FILE_CORRUPT);
+
+	// Heights
+	uint32_t height_width = 0;
+	uint32_t height_height = 0;
+	float offset = 0.0f;
+	float scale = 0.0f;
+	ERR_FAIL_COND_V(!reader.read(height_width) || !reader.read(height_height) || !reader.read(offset) || !reader.read(scale), godot::ERR_FILE_CORRUPT);
+	ERR_FAIL_COND_V(height_width > godot::Image::MAX_WIDTH || height_height > godot::Image::MAX_HEIGHT, godot::ERR_FILE_CORRUPT);
+
+	godot::PackedByteArray height_data;
+	height_data.resize(static_cast<int64_t>(height_width) * height_height * sizeof(float));
+	const auto heights = reinterpret_cast<float*>(height_data.ptrw());
+	const auto heights_read = read_tiles(reader, height_width, height_height, sizeof(uint16_t), [&](const godot::Rect2i& rect, const uint8_t* tile)
+	{
+		decode_height_tile(tile, rect.size, offset, scale, heights + rect.position.x + static_cast<int64_t>(rect.position.y) * height_width, height_width);
+	});
+	ERR_FAIL_COND_V(!heights_read, godot::ERR_FILE_CORRUPT);
+
+	// Splat weights
+	uint32_t splat_width = 0;
+	uint32_t splat_height = 0;
+	ERR_FAIL_COND_V(!reader.read(splat_width) || !reader.read(splat_height), godot::ERR_FILE_CORRUPT);
+	ERR_FAIL_COND_V(splat_width > godot::Image::MAX_WIDTH || splat_height > godot::Image::MAX_HEIGHT, godot::ERR_FILE_CORRUPT);
+
+	godot::PackedByteArray splat_data;
+	splat_data.resize(static_cast<int64_t>(splat_width) * splat_height * 4);
+	const auto splat = splat_data.ptrw();
+	const auto splat_read = read_tiles(reader, splat_width, splat_height, 4, [&](const godot::Rect2i& rect, const uint8_t* tile)
+	{
+		decode_splat_tile(tile, rect.size, splat + (rect.position.x + static_cast<int64_t>(rect.position.y) * splat_width) * 4, splat_width);
+	});
+	ERR_FAIL_COND_V(!splat_read, godot::ERR_FILE_CORRUPT);
+
+	// Images are updated in place, so nodes and editors holding them see the loaded data
+	const auto set_image = [](godot::Ref<godot::Image>& image, int32_t width, int32_t height, godot::Image::Format format, const godot::PackedByteArray& data)
+	{
+		if (width == 0 || height == 0)
+		{
+			image.unref();
+			return;
+		}
+		if (image.is_null())
+		{
+			image.instantiate();
+		}
+		image->set_data(width, height, false, format, data);
+	};
+	set_image(heightmap, height_width, height_height, godot::Image::FORMAT_RF, height_data);
+	set_image(splatmap, splat_width, splat_height, godot::Image::FORMAT_RGBA8, splat_data);
+	emit_changed();
+	return godot::OK;
+}
+
+godot::Error SimpleHeightmapDataSaver::_save(const godot::Ref<godot::Resource>& p_resource, const godot::String& p_path, uint32_t p_flags)
+{
+	const auto data = godot::Ref<SimpleHeightmapData>(p_resource);
+	ERR_FAIL_COND_V(data.is_null(), godot::ERR_INVALID_PARAMETER);
+
+	const auto bytes = data->encode();
+	ERR_FAIL_COND_V(bytes.is_empty(), godot::ERR_INVALID_DATA);
+
+	const auto file = godot::FileAccess::open(p_path, godot::FileAccess::WRITE);
+	ERR_FAIL_COND_V_MSG(file.is_null(), godot::FileAccess::get_open_error(), godot::vformat("Cannot save SimpleHeightmapData to '%s'.", p_path));
+	file->store_buffer(bytes);
+	return file->get_error();
+}
+
+bool SimpleHeightmapDataSaver::_recognize(const godot::Ref<godot::Resource>& p_resource) const
+{
+	return godot::Object::cast_to<SimpleHeightmapData>(p_resource.ptr()) != nullptr;
+}
+
+godot::PackedStringArray SimpleHeightmapDataSaver::_get_recognized_extensions(const godot::Ref<godot::Resource>& p_resource) const
+{
+	godot::PackedStringArray extensions;
+	if (_recognize(p_resource))
+	{
+		extensions.push_back(SimpleHeightmapData::FILE_EXTENSION);
+	}
+	return extensions;
+}
+
+godot::PackedStringArray SimpleHeightmapDataLoader::_get_recognized_extensions() const
+{
+	godot::PackedStringArray extensions;
+	extensions.push_back(SimpleHeightmapData::FILE_EXTENSION);
+	return extensions;
+}
+
+bool SimpleHeightmapDataLoader::_handles_type(const godot::StringName& p_type) const
+{
+	return p_type == godot::StringName("SimpleHeightmapData") || p_type == godot::StringName("Resource");
+}
+
+godot::String SimpleHeightmapDataLoader::_get_resource_type(const godot::String& p_path) const
+{
+	return p_path.get_extension().to_lower() == SimpleHeightmapData::FILE_EXTENSION ? "SimpleHeightmapData" : "";
+}
+
+godot::Variant SimpleHeightmapDataLoader::_load(const godot::String& p_path, const godot::String& p_original_path, bool p_use_sub_threads, int32_t p_cache_mode) const
+{
+	// The whole file is read in one go and decoded from memory
+	const auto bytes = godot::FileAccess::get_file_as_bytes(p_path);
+	ERR_FAIL_COND_V_MSG(bytes.is_empty(), static_cast<int64_t>(godot::ERR_CANT_OPEN), godot::vformat("Cannot open SimpleHeightmapData '%s'.", p_path));
+
+	godot::Ref<SimpleHeightmapData> data;
+	data.instantiate();
+	const auto error = data->decode(bytes);
+	if (error != godot::OK)
+	{
+		return static_cast<int64_t>(error);
+	}
+	return data;
+}
+
+godot::Error SimpleHeightmapDataStream::open(const godot::String& path)
+{
+	close();
+	file = godot::FileAccess::open(path, godot::FileAccess::READ);
+	ERR_FAIL_COND_V_MSG(file.is_null(), godot::FileAccess::get_open_error(), godot::vformat("Cannot open SimpleHeightmapData '%s' for streaming.", path));
+
+	// Only the header and the tile tables are read here, tiles are read when they're first needed
+	const auto magic = file->get_buffer(sizeof(MAGIC));
+	const auto version = file->get_32();
+	const auto tile_size = file->get_32();
+	const auto valid_header = magic.size() == sizeof(MAGIC) && memcmp(magic.ptr(), MAGIC, sizeof(MAGIC)) == 0 && version == VERSION && tile_size == TILE_SIZE;
+	if (!valid_header)
+	{
+		close();
+		ERR_FAIL_V_MSG(godot::ERR_FILE_UNRECOGNIZED, godot::vformat("'%s' is not a supported SimpleHeightmapData file.", path));
+	}
+
+	const auto read_section = [&](Section& section)
+	{
+		const auto width = static_cast<int32_t>(file->get_32());
+		const auto height = static_cast<int32_t>(file->get_32());
+		if (width > godot::Image::MAX_WIDTH || height > godot::Image::MAX_HEIGHT)
+		{
+			return false;
+		}
+		section.size = godot::Vector2i(width, height);
+		section.tile_count = get_tile_count(width, height);
+		if (&section == &heights)
+		{
+			height_offset = file->get_float();
+			height_scale = file->get_float();
+		}
+
+		const auto tile_count = section.tile_count.x * section.tile_count.y;
+		section.sizes.resize(tile_count);
+		section.offsets.resize(tile_count);
+		for (auto& size : section.sizes)
+		{
+			size = file->get_32();
+		}
+		auto offset = file->get_position();
+		for (int32_t i = 0; i < tile_count; ++i)
+		{
+			section.offsets[i] = offset;
+			offset += section.sizes[i];
+		}
+		if (offset > file->get_length())
+		{
+			return false;
+		}
+		file->seek(offset);
+		return !file->eof_reached();
+	};
+	if (!read_section(heights) || !read_section(splat))
+	{
+		close();
+		ERR_FAIL_V_MSG(godot::ERR_FILE_CORRUPT, godot::vformat("SimpleHeightmapData '%s' is corrupt.", path));
+	}
+	return godot::OK;
+}
+
+void SimpleHeightmapDataStream::close()
+{
+	file.unref();
+	heights = Section();
+	splat = Section();
+	cached_bytes = 0;
+	use_count = 0;
+}
+
+const godot::PackedByteArray* SimpleHeightmapDataStream::get_tile(Section& section, int32_t x, int32_t y, int32_t bytes_per_pixel)
+{
+	const auto index = static_cast<uint32_t>(x + y * section.tile_count.x);
+	if (auto cached = section.cache.getptr(index))
+	{
+		cached->last_used = ++use_count;
+		return &cached->pixels;
+	}
+
+	// Positional read of just this tile
+	file->seek(section.offsets[index]);
+	const auto compressed = file->get_buffer(section.sizes[index]);
+	const auto rect = get_tile_rect(section.size.x, section.size.y, x, y);
+	const auto packed_size = rect.get_area() * (&section == &heights ? static_cast<int64_t>(sizeof(uint16_t)) : 4);
+	const auto tile = compressed.decompress(packed_size, COMPRESSION);
+	ERR_FAIL_COND_V_MSG(tile.size() != packed_size, nullptr, "SimpleHeightmapData tile is corrupt.");
+
+	CachedTile cached;
+	cached.pixels.resize(rect.get_area() * bytes_per_pixel);
+	if (&section == &heights)
+	{
+		decode_height_tile(tile.ptr(), rect.size, height_offset, height_scale, reinterpret_cast<float*>(cached.pixels.ptrw()), rect.size.x);
+	}
+	else
+	{
+		decode_splat_tile(tile.ptr(), rect.size, cached.pixels.ptrw(), rect.size.x);
+	}
+	cached.last_used = ++use_count;
+	cached_bytes += cached.pixels.size();
+	return &section.cache.insert(index, cached)->value.pixels;
+}
+
+godot::Ref<godot::Image> SimpleHeightmapDataStream::read_rect(Section& section, const godot::Rect2i& rect, godot::Image::Format format, int32_t bytes_per_pixel)
+{
+	ERR_FAIL_COND_V(!is_open() || section.size.x == 0 || section.size.y == 0 || !rect.has_area(), godot::Ref<godot::Image>());
+
+	godot::PackedByteArray data;
+	data.resize(static_cast<int64_t>(rect.get_area()) * bytes_per_pixel);
+	const auto out = data.ptrw();
+	for (int32_t y = 0; y < rect.size.y; ++y)
+	{
+		const auto source_y = godot::Math::clamp(rect.position.y + y, 0, section.size.y - 1);
+		const auto tile_y = source_y / static_cast<int32_t>(TILE_SIZE);
+		const auto row = out + static_cast<int64_t>(y) * rect.size.x * bytes_per_pixel;
+
+		// Runs of pixels that come from the same tile are copied together
+		int32_t x = 0;
+		while (x < rect.size.x)
+		{
+			const auto source_x = godot::Math::clamp(rect.position.x + x, 0, section.size.x - 1);
+			const auto tile_x = source_x / static_cast<int32_t>(TILE_SIZE);
+			const auto tile_rect = get_tile_rect(section.size.x, section.size.y, tile_x, tile_y);
+			const auto tile = get_tile(section, tile_x, tile_y, bytes_per_pixel);
+			const auto tile_row = tile != nullptr ? tile->ptr() + static_cast<int64_t>(source_y - tile_rect.position.y) * tile_rect.size.x * bytes_per_pixel : nullptr;
+			do
+			{
+				// Pixels outside the file repeat its edge, the same as the samplers' clamping
+				const auto pixel_x = godot::Math::clamp(rect.position.x + x, 0, section.size.x - 1) - tile_rect.position.x;
+				if (tile_row != nullptr)
+				{
+					memcpy(row + x * bytes_per_pixel, tile_row + pixel_x * bytes_per_pixel, bytes_per_pixel);
+				}
+				else
+				{
+					memset(row + x * bytes_per_pixel, 0, bytes_per_pixel);
+				}
+				++x;
+			} while (x < rect.size.x && godot::Math::clamp(rect.position.x + x, 0, section.size.x - 1) / static_cast<int32_t>(TILE_SIZE) == tile_x);
+		}
+	}
+	return godot::Image::create_from_data(rect.size.x, rect.size.y, false, format, data);
+}
+
+godot::Ref<godot::Image> SimpleHeightmapDataStream::read_heights(const godot::Rect2i& rect)
+{
+	return read_rect(heights, rect, godot::Image::FORMAT_RF, sizeof(float));
+}
+
+godot::Ref<godot::Image> SimpleHeightmapDataStream::read_splat(const godot::Rect2i& rect)
+{
+	return read_rect(splat, rect, godot::Image::FORMAT_RGBA8, 4);
+}
+
+void SimpleHeightmapDataStream::trim_cache(uint64_t budget)
+{
+	if (cached_bytes <= budget)
+	{
+		return;
+	}
+
+	// Every tile is listed once and the oldest are dropped first, across both sections
+	struct Entry
+	{
+		uint64_t last_used;
+		Section* section;
+		uint32_t index;
+	};
+	godot::LocalVector<Entry> entries;
+	entries.reserve(heights.cache.size() + splat.cache.size());
+	for (auto section : { &heights, &splat })
+	{
+		for (const auto& entry : section->cache)
+		{
+			entries.push_back({ entry.value.last_used, section, entry.key });
+		}
+	}
+	std::sort(entries.ptr(), entries.ptr() + entries.size(), [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+
+	for (const auto& entry : entries)
+	{
+		if (cached_bytes <= budget)
+		{
+			break;
+		}
+		cached_bytes -= entry.section->cache[entry.index].pixels.size();
+		entry.section->cache.erase(entry.index);
+	}
+}
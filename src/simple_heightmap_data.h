@@ -0,0 +1,115 @@
+#pragma once
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/classes/resource.hpp>
+#include <godot_cpp/classes/resource_format_loader.hpp>
+#include <godot_cpp/classes/resource_format_saver.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+// Heightmap and splatmap of a SimpleHeightmap, saved in a compact binary layout rather than as raw Images
+// Heights are quantized to 16 bits between the lowest and highest point, both images are split into tiles
+// that are compressed independently. Heightmaps in any SimpleHeightmapHeightCodec format can be saved, they load as FORMAT_RF
+class SimpleHeightmapData : public godot::Resource
+{
+	GDCLASS(SimpleHeightmapData, godot::Resource)
+
+protected:
+	static void _bind_methods();
+
+public:
+	static constexpr auto FILE_EXTENSION = "shmap";
+
+	void set_heightmap_image(const godot::Ref<godot::Image>& image) { heightmap = image; }
+	void set_splatmap_image(const godot::Ref<godot::Image>& image) { splatmap = image; }
+	[[nodiscard]] godot::Ref<godot::Image> get_heightmap_image() const { return heightmap; }
+	[[nodiscard]] godot::Ref<godot::Image> get_splatmap_image() const { return splatmap; }
+	void set_height_range(const godot::Vector2& range) { height_range = range; } // Needed to read FORMAT_RG8 heightmaps, which are relative to it
+
+	// Whole resource in the binary layout, as written to .shmap files and stored when embedded in a scene
+	[[nodiscard]] godot::PackedByteArray encode() const;
+	godot::Error decode(const godot::PackedByteArray& bytes);
+
+private:
+	void set_encoded_data(const godot::PackedByteArray& bytes) { decode(bytes); }
+	[[nodiscard]] godot::PackedByteArray get_encoded_data() const { return encode(); }
+
+	godot::Ref<godot::Image> heightmap;
+	godot::Ref<godot::Image> splatmap;
+	godot::Vector2 height_range;
+};
+
+// Reads a .shmap file a few tiles at a time, for heightmaps too large to hold in memory
+// Only the header and tile tables are read up front, tiles are read with positional reads when first needed
+// Decoded tiles are cached until trim_cache drops them
+class SimpleHeightmapDataStream
+{
+public:
+	godot::Error open(const godot::String& path);
+	void close();
+	[[nodiscard]] bool is_open() const { return file.is_valid(); }
+	[[nodiscard]] godot::Vector2i get_heightmap_size() const { return heights.size; }
+	[[nodiscard]] godot::Vector2i get_splatmap_size() const { return splat.size; }
+
+	// Pixels inside rect, pixels outside the file repeat its edge
+	godot::Ref<godot::Image> read_heights(const godot::Rect2i& rect);
+	godot::Ref<godot::Image> read_splat(const godot::Rect2i& rect);
+
+	[[nodiscard]] uint64_t get_cached_bytes() const { return cached_bytes; }
+	void trim_cache(uint64_t budget); // Drops the least recently used tiles until the cache fits in budget bytes
+
+private:
+	struct CachedTile
+	{
+		godot::PackedByteArray pixels; // Decoded, in the image's format
+		uint64_t last_used = 0;
+	};
+
+	struct Section
+	{
+		godot::Vector2i size;
+		godot::Vector2i tile_count;
+		godot::LocalVector<uint64_t> offsets; // File position of each tile
+		godot::LocalVector<uint32_t> sizes; // Compressed size of each tile
+		godot::HashMap<uint32_t, CachedTile> cache;
+	};
+
+	const godot::PackedByteArray* get_tile(Section& section, int32_t x, int32_t y, int32_t bytes_per_pixel);
+	godot::Ref<godot::Image> read_rect(Section& section, const godot::Rect2i& rect, godot::Image::Format format, int32_t bytes_per_pixel);
+
+	godot::Ref<godot::FileAccess> file;
+	Section heights;
+	Section splat;
+	float height_offset = 0.0f;
+	float height_scale = 0.0f;
+	uint64_t cached_bytes = 0;
+	uint64_t use_count = 0;
+};
+
+class SimpleHeightmapDataSaver : public godot::ResourceFormatSaver
+{
+	GDCLASS(SimpleHeightmapDataSaver, godot::ResourceFormatSaver)
+
+protected:
+	static void _bind_methods() { }
+
+public:
+	godot::Error _save(const godot::Ref<godot::Resource>& p_resource, const godot::String& p_path, uint32_t p_flags) override;
+	bool _recognize(const godot::Ref<godot::Resource>& p_resource) const override;
+	godot::PackedStringArray _get_recognized_extensions(const godot::Ref<godot::Resource>& p_resource) const override;
+};
+
+class SimpleHeightmapDataLoader : public godot::ResourceFormatLoader
+{
+	GDCLASS(SimpleHeightmapDataLoader, godot::ResourceFormatLoader)
+
+protected:
+	static void _bind_methods() { }
+
+public:
+	godot::PackedStringArray _get_recognized_extensions() const override;
+	bool _handles_type(const godot::StringName& p_type) const override;
+	godot::String _get_resource_type(const godot::String& p_path) const override;
+	godot::Variant _load(const godot::String& p_path, const godot::String& p_original_path, bool p_use_sub_threads, int32_t p_cache_mode) const override;
+};
@@ -1,9 +1,13 @@
 #ifdef TOOLS_ENABLED
 #include "simple_heightmap_editor_plugin.h"
 #include "simple_heightmap.h"
+#include "simple_heightmap_sampler.h"
+#include "simple_heightmap_splat.h"
 
 #include <godot_cpp/classes/box_mesh.hpp>
 #include <godot_cpp/classes/button.hpp>
+#include <godot_cpp/classes/editor_interface.hpp>
+#include <godot_cpp/classes/editor_settings.hpp>
 #include <godot_cpp/classes/editor_spin_slider.hpp>
 #include <godot_cpp/classes/editor_undo_redo_manager.hpp>
 #include <godot_cpp/classes/h_box_container.hpp>
@@ -13,12 +17,11 @@
 #include <godot_cpp/classes/input_event_mouse_button.hpp>
 #include <godot_cpp/classes/input_event_mouse_motion.hpp>
 #include <godot_cpp/classes/label.hpp>
-#include <godot_cpp/classes/physics_direct_space_state3d.hpp>
-#include <godot_cpp/classes/physics_ray_query_parameters3d.hpp>
-#include <godot_cpp/classes/physics_server3d.hpp>
 #include <godot_cpp/classes/rendering_server.hpp>
+#include <godot_cpp/classes/resource_saver.hpp>
 #include <godot_cpp/classes/v_box_container.hpp>
-#include <godot_cpp/classes/world3d.hpp>
+
+#include <cstring>
 
 void SimpleHeightmapEditorPlugin::_bind_methods()
 { }
@@ -36,7 +39,7 @@ void SimpleHeightmapEditorPlugin::_enter_tree()
 
 	brush_multimesh = godot::Ref<godot::MultiMesh>(memnew(godot::MultiMesh));
 	brush_multimesh->set_transform_format(godot::MultiMesh::TRANSFORM_3D);
-	brush_multimesh->set_instance_count(64 * 64);
+	brush_multimesh->set_instance_count(BRUSH_PREVIEW_RESOLUTION * BRUSH_PREVIEW_RESOLUTION);
 	brush_multimesh->set_visible_instance_count(0);
 	brush_multimesh->set_mesh(box_mesh);
 
@@ -54,12 +57,37 @@ void SimpleHeightmapEditorPlugin::_enter_tree()
 	gizmo_plugin.instantiate();
 	add_node_3d_gizmo_plugin(gizmo_plugin);
 
+	// Undo history of brush strokes, the oldest strokes are discarded once it uses more than the budget
+	// Discarding a stroke clears the undo history of the scene it was made in, since undo can't step past it
+	const auto editor_settings = godot::EditorInterface::get_singleton()->get_editor_settings();
+	if (editor_settings.is_valid())
+	{
+		if (!editor_settings->has_setting(SETTING_UNDO_MEMORY_BUDGET))
+		{
+			editor_settings->set_setting(SETTING_UNDO_MEMORY_BUDGET, 256);
+		}
+		editor_settings->set_initial_value(SETTING_UNDO_MEMORY_BUDGET, 256, false);
+		godot::Dictionary budget_info;
+		budget_info["name"] = SETTING_UNDO_MEMORY_BUDGET;
+		budget_info["type"] = godot::Variant::INT;
+		budget_info["hint"] = godot::PROPERTY_HINT_RANGE;
+		budget_info["hint_string"] = "1,16384,1,or_greater,suffix:MiB";
+		editor_settings->add_property_info(budget_info);
+
+		if (!editor_settings->has_setting(SETTING_UNDO_COMPRESS))
+		{
+			editor_settings->set_setting(SETTING_UNDO_COMPRESS, true);
+		}
+		editor_settings->set_initial_value(SETTING_UNDO_COMPRESS, true, false);
+	}
+
 	create_ui();
 
 	texture_1_changed_callable = callable_mp(this, &SimpleHeightmapEditorPlugin::refresh_texture_icon).bind(button_texture_1);
 	texture_2_changed_callable = callable_mp(this, &SimpleHeightmapEditorPlugin::refresh_texture_icon).bind(button_texture_2);
 	texture_3_changed_callable = callable_mp(this, &SimpleHeightmapEditorPlugin::refresh_texture_icon).bind(button_texture_3);
 	texture_4_changed_callable = callable_mp(this, &SimpleHeightmapEditorPlugin::refresh_texture_icon).bind(button_texture_4);
+	rebuild_completed_callable = callable_mp(this, &SimpleHeightmapEditorPlugin::invalidate_brush_preview);
 }
 
 namespace UIHelpers
@@ -136,6 +164,7 @@ void SimpleHeightmapEditorPlugin::create_ui()
 		auto radius_slider = UIHelpers::create_editor_spin_slider(brush_radius, 0.0, 25.0, 0.1, true);
 		auto strength_slider = UIHelpers::create_editor_spin_slider(brush_strength, 0.0, 10.0, 0.1, true);
 		auto ease_slider = UIHelpers::create_editor_spin_slider(brush_ease, 0.0, 2.0, 0.01, true);
+		layer_slider = UIHelpers::create_editor_spin_slider(brush_layer, 0.0, SimpleHeightmapSplat::MAX_LAYERS - 1, 1.0, false);
 
 		hbox_a->add_child(button_raise);
 		hbox_a->add_child(button_smooth);
@@ -159,6 +188,9 @@ void SimpleHeightmapEditorPlugin::create_ui()
 		ui->add_child(UIHelpers::create_label("Ease"));
 		ui->add_child(ease_slider);
 
+		ui->add_child(UIHelpers::create_label("Layer"));
+		ui->add_child(layer_slider);
+
 		button_raise->connect(SIGNAL_PRESSED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_tool_selected).bind(static_cast<uint8_t>(Tool::Heightmap_Raise)));
 		button_smooth->connect(SIGNAL_PRESSED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_tool_selected).bind(static_cast<uint8_t>(Tool::Heightmap_Smooth)));
 		button_flatten->connect(SIGNAL_PRESSED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_tool_selected).bind(static_cast<uint8_t>(Tool::Heightmap_Flatten)));
@@ -169,6 +201,7 @@ void SimpleHeightmapEditorPlugin::create_ui()
 		radius_slider->connect(SIGNAL_VALUE_CHANGED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_brush_radius_changed));
 		strength_slider->connect(SIGNAL_VALUE_CHANGED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_brush_strength_changed));
 		ease_slider->connect(SIGNAL_VALUE_CHANGED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_brush_ease_changed));
+		layer_slider->connect(SIGNAL_VALUE_CHANGED, callable_mp(this, &SimpleHeightmapEditorPlugin::on_brush_layer_changed));
 		
 		refresh_texture_icons();
 	}
@@ -185,6 +218,12 @@ void SimpleHeightmapEditorPlugin::on_tool_selected(uint8_t tool_index)
 	button_texture_2->set_pressed(selected_tool == Tool::Splatmap_Texture2);
 	button_texture_3->set_pressed(selected_tool == Tool::Splatmap_Texture3);
 	button_texture_4->set_pressed(selected_tool == Tool::Splatmap_Texture4);
+
+	// The texture buttons pick the first four layers, the slider reaches the rest
+	if (is_splatmap_tool(selected_tool))
+	{
+		layer_slider->set_value(static_cast<int32_t>(selected_tool) - static_cast<int32_t>(Tool::Splatmap_Texture1));
+	}
 }
 
 void SimpleHeightmapEditorPlugin::on_brush_radius_changed(double value)
@@ -202,6 +241,11 @@ void SimpleHeightmapEditorPlugin::on_brush_ease_changed(double value)
 	brush_ease = value;
 }
 
+void SimpleHeightmapEditorPlugin::on_brush_layer_changed(double value)
+{
+	brush_layer = static_cast<int32_t>(value);
+}
+
 void SimpleHeightmapEditorPlugin::_exit_tree()
 {
 	remove_node_3d_gizmo_plugin(gizmo_plugin);
@@ -213,6 +257,7 @@ void SimpleHeightmapEditorPlugin::_exit_tree()
 	brush_node = nullptr;
 
 	brush_multimesh.unref();
+	brush_preview_buffer.clear();
 	empty_texture_icon.unref();
 }
 
@@ -226,6 +271,7 @@ void SimpleHeightmapEditorPlugin::destroy_ui()
 		}
 		ui->queue_free();
 		ui = nullptr;
+		layer_slider = nullptr;
 	}
 }
 
@@ -242,6 +288,7 @@ void SimpleHeightmapEditorPlugin::_edit(godot::Object *p_object)
 		selected_heightmap->disconnect("texture_2_changed", texture_2_changed_callable);
 		selected_heightmap->disconnect("texture_3_changed", texture_3_changed_callable);
 		selected_heightmap->disconnect("texture_4_changed", texture_4_changed_callable);
+		selected_heightmap->disconnect("rebuild_completed", rebuild_completed_callable);
 	}
 
 	selected_heightmap = godot::Object::cast_to<SimpleHeightmap>(p_object);
@@ -252,8 +299,11 @@ void SimpleHeightmapEditorPlugin::_edit(godot::Object *p_object)
 		selected_heightmap->connect("texture_2_changed", texture_2_changed_callable);
 		selected_heightmap->connect("texture_3_changed", texture_3_changed_callable);
 		selected_heightmap->connect("texture_4_changed", texture_4_changed_callable);
+		selected_heightmap->connect("rebuild_completed", rebuild_completed_callable);
 	}
 
+	invalidate_brush_preview();
+
 	refresh_texture_icons();
 
 	// Hide brush when de-selecting
@@ -285,48 +335,14 @@ void SimpleHeightmapEditorPlugin::refresh_texture_icon(const godot::Ref<godot::T
 	}
 }
 
-namespace
-{
-	bool try_pick_heightmap(const godot::Camera3D& camera, const godot::Vector2& mouse_position, const SimpleHeightmap* expected_heightmap, godot::Vector3& out_collision)
-	{
-		out_collision = godot::Vector3();
-
-		const auto pserver = godot::PhysicsServer3D::get_singleton();
-		if (pserver && expected_heightmap != nullptr)
-		{
-			const auto world = camera.get_world_3d();
-			const auto space_state = world.is_valid() ? world->get_direct_space_state() : nullptr;
-			if (space_state != nullptr)
-			{
-				const auto a = camera.project_ray_origin(mouse_position);
-				const auto b = a + camera.project_ray_normal(mouse_position) * 1000.0;
-				const auto raycast_result = space_state->intersect_ray(godot::PhysicsRayQueryParameters3D::create(a, b, expected_heightmap->get_collider_layer()));
-				
-				const auto rid = static_cast<godot::RID>(raycast_result["rid"]);
-				if (rid.is_valid())
-				{
-					const auto object_id = pserver->body_get_object_instance_id(rid);
-					const auto picked_heightmap = godot::Object::cast_to<SimpleHeightmap>(godot::ObjectDB::get_instance(object_id));
-					if (picked_heightmap == expected_heightmap)
-					{
-						out_collision = static_cast<godot::Vector3>(raycast_result["position"]);
-						return true;
-					}
-				}
-			}
-		}
-
-		return false;
-	}
-}
-
 int32_t SimpleHeightmapEditorPlugin::_forward_3d_gui_input(godot::Camera3D* p_viewport_camera, const godot::Ref<godot::InputEvent>& p_event)
 {
 	auto mouse_event = godot::Ref<godot::InputEventMouse>(p_event);
 	if (mouse_event.is_valid() && p_viewport_camera != nullptr && selected_heightmap != nullptr)
 	{
 		godot::Vector3 hit_position;
-		if (try_pick_heightmap(*p_viewport_camera, mouse_event->get_position(), selected_heightmap, hit_position))
+		const auto mouse_position = mouse_event->get_position();
+		if (selected_heightmap->get_ray_intersection(p_viewport_camera->project_ray_origin(mouse_position), p_viewport_camera->project_ray_normal(mouse_position), hit_position))
 		{
 			mouse_over = true;
 			mouse_global_position = hit_position;
@@ -344,16 +360,12 @@ int32_t SimpleHeightmapEditorPlugin::_forward_3d_gui_input(godot::Camera3D* p_vi
 			{
 				if (mouse_button_event->is_pressed() && !mouse_pressed && mouse_over)
 				{
-					// Copy data for undo/redo
+					// Tiles are saved for undo/redo as the stroke reaches them
 					const auto affected_image = get_affected_image(selected_tool, *selected_heightmap);
 					if (affected_image.is_valid())
 					{
-						undo_redo_cache.data = affected_image->get_data(); // Data is always returned as a copy
-						undo_redo_cache.format = affected_image->get_format();
-						undo_redo_cache.height = affected_image->get_height();
-						undo_redo_cache.image = affected_image;
-						undo_redo_cache.mipmaps = affected_image->has_mipmaps();
-						undo_redo_cache.width = affected_image->get_width();
+						stroke_delta.instantiate();
+						stroke_delta->begin(affected_image, selected_heightmap, get_rebuild_flags(selected_tool));
 					}
 
 					flatten_target = mouse_global_position.y;
@@ -363,30 +375,39 @@ int32_t SimpleHeightmapEditorPlugin::_forward_3d_gui_input(godot::Camera3D* p_vi
 				else if (mouse_button_event->is_released() && mouse_pressed)
 				{
 					// Commit undo/redo action
-					if (undo_redo_cache.image.is_valid())
+					if (stroke_delta.is_valid())
 					{
 						const auto undo_redo = get_undo_redo();
-						if (undo_redo != nullptr)
+						const auto editor_settings = godot::EditorInterface::get_singleton()->get_editor_settings();
+						const auto compress = static_cast<bool>(editor_settings->get_setting(SETTING_UNDO_COMPRESS));
+						const auto memory_budget = static_cast<uint64_t>(godot::Math::max(static_cast<int64_t>(editor_settings->get_setting(SETTING_UNDO_MEMORY_BUDGET)), static_cast<int64_t>(1))) << 20; // MiB
+						godot::LocalVector<uint64_t> evicted_heightmaps;
+						if (undo_redo != nullptr && stroke_delta->end(compress, memory_budget, evicted_heightmaps))
 						{
-							const auto affected_image = get_affected_image(selected_tool, *selected_heightmap);
+							// Undo can't skip over a discarded stroke without leaving the image half undone, so the histories holding one are cleared
+							for (const auto heightmap_id : evicted_heightmaps)
+							{
+								const auto heightmap = godot::ObjectDB::get_instance(heightmap_id);
+								if (heightmap != nullptr)
+								{
+									undo_redo->clear_history(undo_redo->get_object_history_id(heightmap), false);
+								}
+							}
+
+							// The image already holds the result of the stroke, so the do method is not run on commit
 							undo_redo->create_action("Modify Heightmap");
-							undo_redo->add_undo_method(undo_redo_cache.image.ptr(), "set_data",
-								undo_redo_cache.width,
-								undo_redo_cache.height,
-								undo_redo_cache.mipmaps,
-								undo_redo_cache.format,
-								undo_redo_cache.data);
-							undo_redo->add_undo_method(selected_heightmap, "rebuild", get_rebuild_flags(selected_tool));
-							undo_redo->add_do_method(affected_image.ptr(), "set_data",
-								affected_image->get_width(),
-								affected_image->get_height(),
-								affected_image->has_mipmaps(),
-								affected_image->get_format(),
-								affected_image->get_data());
-							undo_redo->add_do_method(selected_heightmap, "rebuild", get_rebuild_flags(selected_tool));
-							undo_redo->commit_action();
+							undo_redo->add_undo_method(stroke_delta.ptr(), "apply", false);
+							undo_redo->add_do_method(stroke_delta.ptr(), "apply", true);
+							undo_redo->commit_action(false);
+						}
+
+						// Brushes edit the images in place, which does not mark a data resource as modified
+						const auto data = selected_heightmap->get_data();
+						if (data.is_valid() && !modified_data.has(data))
+						{
+							modified_data.push_back(data);
 						}
-						undo_redo_cache.image.unref();
+						stroke_delta.unref();
 					}
 					mouse_pressed = false;
 					return AFTER_GUI_INPUT_STOP;
@@ -410,64 +431,25 @@ int32_t SimpleHeightmapEditorPlugin::_forward_3d_gui_input(godot::Camera3D* p_vi
 
 void SimpleHeightmapEditorPlugin::_process(double p_delta)
 {
-	if (selected_heightmap != nullptr && selected_tool != Tool::None && mouse_over)
+	auto image = selected_heightmap != nullptr ? get_affected_image(selected_tool, *selected_heightmap) : godot::Ref<godot::Image>();
+	if (image.is_valid() && mouse_over)
 	{
-		auto image = get_affected_image(selected_tool, *selected_heightmap);
-
-		const auto min = godot::Vector2i(
-			godot::Math::clamp(static_cast<int32_t>(godot::Math::round(mouse_image_position.x - brush_radius)), 0, image->get_width()),
-			godot::Math::clamp(static_cast<int32_t>(godot::Math::round(mouse_image_position.y - brush_radius)), 0, image->get_height())
-		);
-		const auto max = godot::Vector2i(
-			godot::Math::clamp(static_cast<int32_t>(godot::Math::round(mouse_image_position.x + brush_radius)), 0, image->get_width()),
-			godot::Math::clamp(static_cast<int32_t>(godot::Math::round(mouse_image_position.y + brush_radius)), 0, image->get_height())
-		);
-		const auto size = max - min;
-		const auto ease = godot::Math::max(brush_ease, UNIT_EPSILON);
-
-		godot::Vector<godot::Color> buffer;
-		buffer.resize(size.x * size.y);
-
-		int32_t gizmo_count = 0;
-
-		// Operate on image, save changes to buffer
-		for (auto x = 0; x < size.x; ++x)
+		const auto settings = get_brush_settings();
+		if (mouse_pressed)
 		{
-			for (auto y = 0; y < size.y; ++y)
+			if (stroke_delta.is_valid() && stroke_delta->get_image() == image)
 			{
-				const auto ix = x + min.x;
-				const auto iy = y + min.y;
-				const auto d = mouse_image_position.distance_to(godot::Vector2(ix, iy));
-				const auto t = godot::UtilityFunctions::ease(godot::Math::max(1.0 - (d / brush_radius), 0.0), ease);
-				if (mouse_pressed)
-				{
-					buffer.set(x + y * size.x, modify_pixel(image, ix, iy, t, p_delta));
-				}
-				if (gizmo_count < brush_multimesh->get_instance_count())
-				{
-					godot::Transform3D transform;
-					transform.set_basis(godot::Basis(godot::Quaternion(), godot::Vector3(t, t, t)));
-					transform.set_origin(selected_heightmap->image_position_to_global_position(godot::Vector2(ix, iy)));
-					brush_multimesh->set_instance_transform(gizmo_count, transform);
-					++gizmo_count;
-				}
+				stroke_delta->capture(SimpleHeightmapBrush::get_region(settings.center, settings.radius, image->get_width(), image->get_height()));
 			}
-		}
-
-		// Write changes to image
-		if (mouse_pressed)
-		{
-			for (auto x = 0; x < size.x; ++x)
+			const auto region = SimpleHeightmapBrush::apply(image, settings, static_cast<float>(p_delta));
+			if (region.has_area())
 			{
-				for (auto y = 0; y < size.y; ++y)
-				{
-					image->set_pixel(x + min.x, y + min.y, buffer[x + y * size.x]);
-				}
+				selected_heightmap->rebuild_region(region, get_rebuild_flags(selected_tool));
+				invalidate_brush_preview();
 			}
-			selected_heightmap->rebuild(get_rebuild_flags(selected_tool));
 		}
 
-		brush_multimesh->set_visible_instance_count(godot::Math::min(gizmo_count, brush_multimesh->get_instance_count()));
+		update_brush_preview(settings, image->get_width(), image->get_height());
 		brush_node->set_visible(true);
 	}
 	else
@@ -476,83 +458,116 @@ void SimpleHeightmapEditorPlugin::_process(double p_delta)
 	}
 }
 
-godot::Color SimpleHeightmapEditorPlugin::modify_pixel(const godot::Ref<godot::Image>& image, int32_t x, int32_t y, double t, double delta)
+void SimpleHeightmapEditorPlugin::update_brush_preview(const SimpleHeightmapBrush::Settings& settings, int32_t width, int32_t height)
 {
-	auto pixel = image->get_pixel(x, y);
-	if (selected_tool == Tool::Heightmap_Raise)
+	const auto transform = selected_heightmap->get_global_transform();
+	if (!brush_preview_dirty
+		&& brush_preview_center == settings.center
+		&& brush_preview_radius == settings.radius
+		&& brush_preview_ease == settings.ease
+		&& brush_preview_transform == transform)
 	{
-		if (alt_pressed)
-		{
-			// Lower
-			pixel -= godot::Color(brush_strength, 0.0, 0.0, 0.0) * t * delta;
-		}
-		else
-		{
-			// Raise
-			pixel += godot::Color(brush_strength, 0.0, 0.0, 0.0) * t * delta;
-		}
+		return;
 	}
-	else if (selected_tool == Tool::Heightmap_Smooth)
+	brush_preview_dirty = false;
+	brush_preview_center = settings.center;
+	brush_preview_radius = settings.radius;
+	brush_preview_ease = settings.ease;
+	brush_preview_transform = transform;
+
+	// Large brushes show every step-th pixel rather than being cut off
+	const auto region = SimpleHeightmapBrush::get_region(settings.center, settings.radius, width, height);
+	const auto step = godot::Math::max((godot::Math::max(region.size.x, region.size.y) + BRUSH_PREVIEW_RESOLUTION - 1) / BRUSH_PREVIEW_RESOLUTION, 1);
+	const auto columns = (region.size.x + step - 1) / step;
+	const auto rows = (region.size.y + step - 1) / step;
+
+	// Buffer must always hold every instance, only the visible ones are written
+	constexpr int32_t FLOATS_PER_INSTANCE = 12;
+	brush_preview_buffer.resize(brush_multimesh->get_instance_count() * FLOATS_PER_INSTANCE);
+	auto out = brush_preview_buffer.ptrw();
+
+	const auto heights = selected_heightmap->get_height_sampler();
+	const auto image_to_local = selected_heightmap->get_mesh_size() / static_cast<godot::real_t>(selected_heightmap->get_image_size());
+	for (int32_t row = 0; row < rows; ++row)
 	{
-		if (alt_pressed)
-		{
-			// Add noise
-		}
-		else
+		const auto y = region.position.y + row * step;
+		for (int32_t column = 0; column < columns; ++column)
 		{
-			// Smooth
-			const auto cr = get_pixel_safe(image, x + 1, y);
-			const auto cu = get_pixel_safe(image, x, y + 1);
-			const auto cl = get_pixel_safe(image, x - 1, y);
-			const auto cd = get_pixel_safe(image, x, y - 1);
-			const auto average = (pixel + cr + cu + cl + cd) * 0.2;
-			pixel = color_move_towards(pixel, average, brush_strength * t * delta);
+			const auto x = region.position.x + column * step;
+			const auto t = SimpleHeightmapBrush::get_weight(settings.center.distance_to(godot::Vector2(x, y)), settings.radius, settings.ease);
+			const auto height = heights.is_valid() ? heights.get_height_at(x, y) : 0.0f;
+			const auto origin = transform.xform(godot::Vector3(x * image_to_local, height, y * image_to_local));
+
+			// Rows of a 3x4 matrix, scaled by the falloff
+			const float instance[FLOATS_PER_INSTANCE] = {
+				t, 0.0f, 0.0f, static_cast<float>(origin.x),
+				0.0f, t, 0.0f, static_cast<float>(origin.y),
+				0.0f, 0.0f, t, static_cast<float>(origin.z)
+			};
+			memcpy(out, instance, sizeof(instance));
+			out += FLOATS_PER_INSTANCE;
 		}
 	}
-	else if (selected_tool == Tool::Heightmap_Flatten)
-	{
-		// Flatten
-		pixel = color_move_towards(pixel, godot::Color(flatten_target, 0.0, 0.0, 0.0), brush_strength * t * delta);
-	}
-	else if (selected_tool == Tool::Splatmap_Texture1)
-	{
-		// Paint texture 1
-		pixel = color_move_towards(pixel, godot::Color(1.0, 0.0, 0.0, 0.0), brush_strength * t * delta);
-	}
-	else if (selected_tool == Tool::Splatmap_Texture2)
-	{
-		// Paint texture 2
-		pixel = color_move_towards(pixel, godot::Color(0.0, 1.0, 0.0, 0.0), brush_strength * t * delta);
-	}
-	else if (selected_tool == Tool::Splatmap_Texture3)
-	{
-		// Paint texture 3
-		pixel = color_move_towards(pixel, godot::Color(0.0, 0.0, 1.0, 0.0), brush_strength * t * delta);
-	}
-	else if (selected_tool == Tool::Splatmap_Texture4)
-	{
-		// Paint texture 4
-		pixel = color_move_towards(pixel, godot::Color(0.0, 0.0, 0.0, 1.0), brush_strength * t * delta);
-	}
-	return pixel;
+
+	brush_multimesh->set_buffer(brush_preview_buffer);
+	brush_multimesh->set_visible_instance_count(columns * rows);
 }
 
-godot::Color SimpleHeightmapEditorPlugin::get_pixel_safe(const godot::Ref<godot::Image>& image, int32_t x, int32_t y)
+void SimpleHeightmapEditorPlugin::_apply_changes()
 {
-	x = godot::Math::clamp(x, 0, image->get_width() - 1);
-	y = godot::Math::clamp(y, 0, image->get_height() - 1);
-	return image->get_pixel(x, y);
+	// Data saved in its own file is written here, data built into the scene is saved with it
+	for (const auto& data : modified_data)
+	{
+		const auto path = data->get_path();
+		if (!path.is_empty() && !path.contains("::"))
+		{
+			const auto error = godot::ResourceSaver::get_singleton()->save(data, path);
+			ERR_CONTINUE_MSG(error != godot::OK, godot::vformat("Cannot save SimpleHeightmapData to '%s'.", path));
+		}
+	}
+	modified_data.clear();
 }
 
-godot::Color SimpleHeightmapEditorPlugin::color_move_towards(const godot::Color& input, const godot::Color& target, double delta)
+SimpleHeightmapBrush::Settings SimpleHeightmapEditorPlugin::get_brush_settings() const
 {
-	const auto deltaf = static_cast<godot::real_t>(delta);
-	godot::Color output;
-	output.r = godot::Math::move_toward(input.r, target.r, deltaf);
-	output.g = godot::Math::move_toward(input.g, target.g, deltaf);
-	output.b = godot::Math::move_toward(input.b, target.b, deltaf);
-	output.a = godot::Math::move_toward(input.a, target.a, deltaf);
-	return output;
+	SimpleHeightmapBrush::Settings settings;
+	settings.center = mouse_image_position;
+	settings.radius = static_cast<float>(brush_radius);
+	settings.strength = static_cast<float>(brush_strength);
+	settings.ease = static_cast<float>(godot::Math::max(brush_ease, UNIT_EPSILON));
+	settings.flatten_target = static_cast<float>(flatten_target);
+	if (selected_heightmap != nullptr)
+	{
+		settings.height_range = selected_heightmap->get_height_range();
+	}
+	switch (selected_tool)
+	{
+		case Tool::Heightmap_Raise:
+			settings.operation = alt_pressed ? SimpleHeightmapBrush::Operation::Lower : SimpleHeightmapBrush::Operation::Raise;
+			break;
+		case Tool::Heightmap_Smooth:
+			// Shift is reserved for adding noise
+			settings.operation = alt_pressed ? SimpleHeightmapBrush::Operation::None : SimpleHeightmapBrush::Operation::Smooth;
+			break;
+		case Tool::Heightmap_Flatten:
+			settings.operation = SimpleHeightmapBrush::Operation::Flatten;
+			break;
+		case Tool::Splatmap_Texture1:
+		case Tool::Splatmap_Texture2:
+		case Tool::Splatmap_Texture3:
+		case Tool::Splatmap_Texture4:
+			settings.operation = SimpleHeightmapBrush::Operation::Splat;
+			settings.splat_channel = static_cast<int32_t>(selected_tool) - static_cast<int32_t>(Tool::Splatmap_Texture1);
+			if (selected_heightmap != nullptr && selected_heightmap->get_splat_encoding() == SimpleHeightmap::SPLAT_ENCODING_LAYERS)
+			{
+				settings.splat_layers = true;
+				settings.splat_channel = brush_layer;
+			}
+			break;
+		default:
+			break;
+	}
+	return settings;
 }
 
 #endif // TOOLS_ENABLED
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <godot_cpp/classes/camera3d.hpp>
 #include <godot_cpp/classes/control.hpp>
+#include <godot_cpp/classes/editor_spin_slider.hpp>
 #include <godot_cpp/classes/editor_plugin.hpp>
 #include <godot_cpp/classes/input_event.hpp>
 #include <godot_cpp/classes/multi_mesh.hpp>
@@ -11,7 +12,9 @@
 #include <godot_cpp/classes/ref.hpp>
 
 #include "simple_heightmap.h"
+#include "simple_heightmap_brush.h"
 #include "simple_heightmap_gizmo_plugin.h"
+#include "simple_heightmap_image_delta.h"
 
 class SimpleHeightmapEditorPlugin : public godot::EditorPlugin
 {
@@ -26,6 +29,7 @@ public:
 	godot::String _get_plugin_name() const override { return "SimpleHeightmapEditor"; }
 
 	void _process(double p_delta) override;
+	void _apply_changes() override;
 	bool _handles(godot::Object *p_object) const override;
 	void _edit(godot::Object *p_object) override;
 
@@ -95,11 +99,13 @@ private:
 	void on_brush_radius_changed(double value);
 	void on_brush_strength_changed(double value);
 	void on_brush_ease_changed(double value);
+	void on_brush_layer_changed(double value);
 
-	static godot::Color get_pixel_safe(const godot::Ref<godot::Image>& image, int32_t x, int32_t y);
-	static godot::Color color_move_towards(const godot::Color& input, const godot::Color& target, double delta);
+	SimpleHeightmapBrush::Settings get_brush_settings() const;
 
-	godot::Color modify_pixel(const godot::Ref<godot::Image>& image, int32_t x, int32_t y, double t, double delta);
+	// Refills the brush preview, only when the brush or the terrain under it changed since the last call
+	void update_brush_preview(const SimpleHeightmapBrush::Settings& settings, int32_t width, int32_t height);
+	void invalidate_brush_preview() { brush_preview_dirty = true; }
 
 	godot::Vector3 mouse_global_position;
 	godot::Vector2 mouse_image_position;
@@ -109,16 +115,10 @@ private:
 	SimpleHeightmap* selected_heightmap = nullptr;
 	Tool selected_tool = Tool::None;
 
-	struct UndoRedoCache
-	{
-		godot::Ref<godot::Image> image;
-		int32_t width;
-		int32_t height;
-		bool mipmaps;
-		godot::Image::Format format;
-		godot::PackedByteArray data;
-	};
-	UndoRedoCache undo_redo_cache;
+	static constexpr auto SETTING_UNDO_MEMORY_BUDGET = "simple_heightmap/undo/memory_budget";
+	static constexpr auto SETTING_UNDO_COMPRESS = "simple_heightmap/undo/compress";
+	godot::Ref<SimpleHeightmapImageDelta> stroke_delta; // Stroke in progress
+	godot::LocalVector<godot::Ref<SimpleHeightmapData>> modified_data; // Painted data resources, saved along with the scene
 
 	godot::Control* ui = nullptr;
 	godot::Button* button_raise = nullptr;
@@ -128,6 +128,7 @@ private:
 	godot::Button* button_texture_2 = nullptr;
 	godot::Button* button_texture_3 = nullptr;
 	godot::Button* button_texture_4 = nullptr;
+	godot::EditorSpinSlider* layer_slider = nullptr;
 	godot::Callable texture_1_changed_callable;
 	godot::Callable texture_2_changed_callable;
 	godot::Callable texture_3_changed_callable;
@@ -135,9 +136,18 @@ private:
 
 	godot::MultiMeshInstance3D* brush_node = nullptr;
 	godot::Ref<godot::MultiMesh> brush_multimesh = nullptr;
+	godot::PackedFloat32Array brush_preview_buffer;
+	godot::Vector2 brush_preview_center;
+	float brush_preview_radius = 0.0f;
+	float brush_preview_ease = 0.0f;
+	godot::Transform3D brush_preview_transform;
+	bool brush_preview_dirty = true;
+	godot::Callable rebuild_completed_callable;
+	static constexpr int32_t BRUSH_PREVIEW_RESOLUTION = 64; // Instances per side
 	double brush_radius;
 	double brush_strength;
 	double brush_ease;
+	int32_t brush_layer = 0; // Texture layer the splat tools paint, in SimpleHeightmap::SPLAT_ENCODING_LAYERS
 
 	godot::real_t flatten_target;
 
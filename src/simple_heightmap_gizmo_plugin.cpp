@@ -6,6 +6,8 @@
 #include <godot_cpp/classes/standard_material3d.hpp>
 #include <godot_cpp/classes/physics_server3d_extension.hpp>
 #include <godot_cpp/classes/project_settings.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/core/object.hpp>
 
 void SimpleHeightmapGizmoPlugin::_bind_methods()
 { }
@@ -26,37 +28,146 @@ bool SimpleHeightmapGizmoPlugin::_has_gizmo(godot::Node3D *p_for_node_3d) const
 	return godot::Object::cast_to<SimpleHeightmap>(p_for_node_3d) != nullptr;
 }
 
+namespace
+{
+	// Past this many lines per side the wireframe is decimated
+	constexpr int32_t max_lines_per_side = 256;
+
+	// Samples drawn along one side, every stride-th sample plus the last one so chunk edges still meet
+	int32_t get_line_count(int32_t samples, int32_t stride)
+	{
+		return samples > 1 ? (samples - 1 + stride - 1) / stride + 1 : samples;
+	}
+
+	int32_t get_line_sample(int32_t line, int32_t samples, int32_t stride)
+	{
+		return godot::Math::min(line * stride, samples - 1);
+	}
+}
+
+bool SimpleHeightmapGizmoPlugin::update_line_layout(LineCache& cache, const SimpleHeightmap& heightmap)
+{
+	const auto chunk_count = heightmap.get_chunk_count();
+	auto layout_changed = !cache.valid || cache.chunk_sizes.size() != chunk_count || cache.scale != heightmap.get_collider_scale();
+	uint64_t total_samples = 0;
+	for (uint32_t chunk_index = 0; chunk_index < chunk_count; ++chunk_index)
+	{
+		const auto size = heightmap.get_chunk_collider_size(chunk_index);
+		layout_changed = layout_changed || cache.chunk_sizes[chunk_index] != size;
+		total_samples += static_cast<uint64_t>(size.x) * size.y;
+	}
+	if (!layout_changed)
+	{
+		return false;
+	}
+
+	cache.valid = true;
+	cache.scale = heightmap.get_collider_scale();
+	cache.stride = godot::Math::max(static_cast<int32_t>(godot::Math::ceil(godot::Math::sqrt(static_cast<double>(total_samples)) / max_lines_per_side)), 1);
+	cache.chunk_sizes.resize(chunk_count);
+	cache.chunk_offsets.resize(chunk_count);
+	cache.chunk_versions.resize(chunk_count);
+
+	// Every chunk keeps a fixed slice of one preallocated buffer
+	uint32_t point_count = 0;
+	for (uint32_t chunk_index = 0; chunk_index < chunk_count; ++chunk_index)
+	{
+		const auto size = heightmap.get_chunk_collider_size(chunk_index);
+		const auto lines_x = get_line_count(size.x, cache.stride);
+		const auto lines_z = get_line_count(size.y, cache.stride);
+		cache.chunk_sizes[chunk_index] = size;
+		cache.chunk_offsets[chunk_index] = point_count;
+		if (lines_x > 0 && lines_z > 0)
+		{
+			point_count += 2 * (lines_z * (lines_x - 1) + lines_x * (lines_z - 1));
+		}
+	}
+	cache.lines.resize(point_count);
+	return true;
+}
+
+void SimpleHeightmapGizmoPlugin::write_chunk_lines(LineCache& cache, const SimpleHeightmap& heightmap, uint32_t chunk_index, godot::Vector3* lines_p)
+{
+	const auto region = heightmap.get_chunk_region(chunk_index);
+	const auto& data = heightmap.get_chunk_collider_shape_data(chunk_index);
+	const auto size = cache.chunk_sizes[chunk_index];
+	const auto spacing = heightmap.get_chunk_collider_spacing(chunk_index);
+	const auto origin = godot::Vector2(region.position) * cache.scale;
+	if (data.size() != size.x * size.y)
+	{
+		return;
+	}
+
+	const auto stride = cache.stride;
+	const auto lines_x = get_line_count(size.x, stride);
+	const auto lines_z = get_line_count(size.y, stride);
+	const auto data_p = data.ptr();
+	const auto point = [&](int32_t x, int32_t z)
+	{
+		return godot::Vector3(origin.x + static_cast<godot::real_t>(x) * spacing.x, data_p[x + z * size.x], origin.y + static_cast<godot::real_t>(z) * spacing.y);
+	};
+
+	auto out = lines_p + cache.chunk_offsets[chunk_index];
+	for (int32_t lz = 0; lz < lines_z; ++lz)
+	{
+		const auto z = get_line_sample(lz, size.y, stride);
+		for (int32_t lx = 0; lx < lines_x; ++lx)
+		{
+			const auto x = get_line_sample(lx, size.x, stride);
+			const auto a = point(x, z);
+			if (lx + 1 < lines_x)
+			{
+				*out++ = a;
+				*out++ = point(get_line_sample(lx + 1, size.x, stride), z);
+			}
+			if (lz + 1 < lines_z)
+			{
+				*out++ = a;
+				*out++ = point(x, get_line_sample(lz + 1, size.y, stride));
+			}
+		}
+	}
+}
+
 void SimpleHeightmapGizmoPlugin::_redraw(const godot::Ref<godot::EditorNode3DGizmo> &p_gizmo)
 {
 	const auto heightmap = godot::Object::cast_to<SimpleHeightmap>(p_gizmo->get_node_3d());
 	if (heightmap != nullptr)
-	{		
-		godot::PackedVector3Array lines;
+	{
+		// Forget heightmaps that have been freed
+		godot::LocalVector<uint64_t> stale;
+		for (const auto& entry : line_caches)
+		{
+			if (godot::ObjectDB::get_instance(entry.key) == nullptr)
+			{
+				stale.push_back(entry.key);
+			}
+		}
+		for (const auto id : stale)
+		{
+			line_caches.erase(id);
+		}
+
+		auto& cache = line_caches[heightmap->get_instance_id()];
+		const auto layout_changed = update_line_layout(cache, *heightmap);
 
-		const auto data = heightmap->get_collider_shape_data();
-		const auto data_size = heightmap->get_collider_shape_data_size();
-		const auto scale = heightmap->get_mesh_size() / heightmap->get_collider_size();
-		for (int x = 0; x < data_size - 1; ++x)
+		godot::Vector3* lines_p = nullptr;
+		for (uint32_t chunk_index = 0; chunk_index < heightmap->get_chunk_count(); ++chunk_index)
 		{
-			for (int z = 0; z < data_size - 1; ++z)
+			const auto version = heightmap->get_chunk_collider_version(chunk_index);
+			if (layout_changed || cache.chunk_versions[chunk_index] != version)
 			{
-				const auto a = (x + 0) + ((z + 0) * data_size);
-				const auto b = (x + 1) + ((z + 0) * data_size);
-				const auto c = (x + 0) + ((z + 1) * data_size);
-				const auto pa = godot::Vector3(static_cast<godot::real_t>(x + 0) * scale, data[a], static_cast<godot::real_t>(z + 0) * scale);
-				const auto pb = godot::Vector3(static_cast<godot::real_t>(x + 1) * scale, data[b], static_cast<godot::real_t>(z + 0) * scale);
-				const auto pc = godot::Vector3(static_cast<godot::real_t>(x + 0) * scale, data[c], static_cast<godot::real_t>(z + 1) * scale);
-
-				lines.push_back(pa);
-				lines.push_back(pb);
-
-				lines.push_back(pa);
-				lines.push_back(pc);
+				if (lines_p == nullptr)
+				{
+					lines_p = cache.lines.ptrw();
+				}
+				write_chunk_lines(cache, *heightmap, chunk_index, lines_p);
+				cache.chunk_versions[chunk_index] = version;
 			}
 		}
 
 		p_gizmo->clear();
-		p_gizmo->add_lines(lines, get_material("collider_lines", p_gizmo), false);
+		p_gizmo->add_lines(cache.lines, get_material("collider_lines", p_gizmo), false);
 	}
 }
 
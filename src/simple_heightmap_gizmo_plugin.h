@@ -3,6 +3,10 @@
 #ifdef TOOLS_ENABLED
 
 #include <godot_cpp/classes/editor_node3d_gizmo_plugin.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+class SimpleHeightmap;
 
 class SimpleHeightmapGizmoPlugin : public godot::EditorNode3DGizmoPlugin
 {
@@ -14,6 +18,24 @@ public:
 	godot::String _get_gizmo_name() const override;
 	bool _has_gizmo(godot::Node3D *p_for_node_3d) const override;
 	void _redraw(const godot::Ref<godot::EditorNode3DGizmo> &p_gizmo) override;
+
+private:
+	// Collider lines of one heightmap, only the chunks whose collider changed are rewritten
+	struct LineCache
+	{
+		godot::PackedVector3Array lines;
+		godot::LocalVector<godot::Vector2i> chunk_sizes;
+		godot::LocalVector<uint32_t> chunk_offsets; // First point of each chunk's lines
+		godot::LocalVector<uint32_t> chunk_versions;
+		godot::real_t scale = 0.0;
+		int32_t stride = 1; // Collider samples skipped between lines, to keep large colliders readable
+		bool valid = false;
+	};
+
+	static bool update_line_layout(LineCache& cache, const SimpleHeightmap& heightmap);
+	static void write_chunk_lines(LineCache& cache, const SimpleHeightmap& heightmap, uint32_t chunk_index, godot::Vector3* lines_p);
+
+	godot::HashMap<uint64_t, LineCache> line_caches;
 };
 
-#endif // TOOLS_ENABLED
\ No newline at end of file
+#endif // TOOLS_ENABLED
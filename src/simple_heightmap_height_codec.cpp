@@ -0,0 +1,156 @@
+#include "simple_heightmap_height_codec.h"
+
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include <cstring>
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__)) // MSVC has no __F16C__, /arch:AVX2 implies it
+#include <immintrin.h>
+#define SIMPLE_HEIGHTMAP_F16C
+#endif
+
+SimpleHeightmapHeightCodec::SimpleHeightmapHeightCodec(godot::Image::Format p_format, const godot::Vector2& range)
+	: format(p_format)
+{
+	if (format == godot::Image::FORMAT_RG8)
+	{
+		offset = static_cast<float>(range.x);
+		scale = godot::Math::max(static_cast<float>(range.y - range.x), static_cast<float>(CMP_EPSILON)) / 65535.0f;
+		inverse_scale = 1.0f / scale;
+	}
+}
+
+bool SimpleHeightmapHeightCodec::is_supported(godot::Image::Format format)
+{
+	return get_pixel_size(format) != 0;
+}
+
+int32_t SimpleHeightmapHeightCodec::get_pixel_size(godot::Image::Format format)
+{
+	switch (format)
+	{
+		case godot::Image::FORMAT_RF: return sizeof(float);
+		case godot::Image::FORMAT_RH: return sizeof(uint16_t);
+		case godot::Image::FORMAT_RG8: return sizeof(uint16_t);
+		default: return 0;
+	}
+}
+
+float SimpleHeightmapHeightCodec::decode(const uint8_t* pixels, int64_t index) const
+{
+	switch (format)
+	{
+		case godot::Image::FORMAT_RH:
+		{
+			uint16_t half;
+			memcpy(&half, pixels + index * sizeof(uint16_t), sizeof(uint16_t));
+			return godot::Math::half_to_float(half);
+		}
+		case godot::Image::FORMAT_RG8:
+		{
+			const auto quantized = pixels + index * 2;
+			return offset + static_cast<float>(quantized[0] | (quantized[1] << 8)) * scale;
+		}
+		default:
+		{
+			float value;
+			memcpy(&value, pixels + index * sizeof(float), sizeof(float));
+			return value;
+		}
+	}
+}
+
+void SimpleHeightmapHeightCodec::decode_row(const uint8_t* pixels, int64_t index, int32_t count, float* out) const
+{
+	switch (format)
+	{
+		case godot::Image::FORMAT_RH:
+		{
+			const auto halves = reinterpret_cast<const uint16_t*>(pixels) + index;
+			int32_t i = 0;
+#if defined(SIMPLE_HEIGHTMAP_F16C)
+			for (; i + 8 <= count; i += 8)
+			{
+				_mm256_storeu_ps(&out[i], _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&halves[i]))));
+			}
+#endif // SIMPLE_HEIGHTMAP_F16C
+			for (; i < count; ++i)
+			{
+				out[i] = godot::Math::half_to_float(halves[i]);
+			}
+			break;
+		}
+		case godot::Image::FORMAT_RG8:
+		{
+			// Simple enough for the compiler to vectorise
+			const auto quantized = pixels + index * 2;
+			for (int32_t i = 0; i < count; ++i)
+			{
+				out[i] = offset + static_cast<float>(quantized[i * 2] | (quantized[i * 2 + 1] << 8)) * scale;
+			}
+			break;
+		}
+		default:
+			memcpy(out, pixels + index * sizeof(float), count * sizeof(float));
+			break;
+	}
+}
+
+void SimpleHeightmapHeightCodec::encode_row(const float* heights, int32_t count, uint8_t* pixels, int64_t index) const
+{
+	switch (format)
+	{
+		case godot::Image::FORMAT_RH:
+		{
+			const auto halves = reinterpret_cast<uint16_t*>(pixels) + index;
+			int32_t i = 0;
+#if defined(SIMPLE_HEIGHTMAP_F16C)
+			for (; i + 8 <= count; i += 8)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&halves[i]), _mm256_cvtps_ph(_mm256_loadu_ps(&heights[i]), _MM_FROUND_TO_NEAREST_INT));
+			}
+#endif // SIMPLE_HEIGHTMAP_F16C
+			for (; i < count; ++i)
+			{
+				halves[i] = godot::Math::make_half_float(heights[i]);
+			}
+			break;
+		}
+		case godot::Image::FORMAT_RG8:
+		{
+			const auto quantized = pixels + index * 2;
+			for (int32_t i = 0; i < count; ++i)
+			{
+				const auto value = static_cast<uint16_t>(godot::Math::clamp((heights[i] - offset) * inverse_scale + 0.5f, 0.0f, 65535.0f));
+				quantized[i * 2] = static_cast<uint8_t>(value & 0xFF);
+				quantized[i * 2 + 1] = static_cast<uint8_t>(value >> 8);
+			}
+			break;
+		}
+		default:
+			memcpy(pixels + index * sizeof(float), heights, count * sizeof(float));
+			break;
+	}
+}
+
+godot::PackedByteArray SimpleHeightmapHeightCodec::convert(const godot::PackedByteArray& data, int32_t width, int32_t height, const SimpleHeightmapHeightCodec& from, const SimpleHeightmapHeightCodec& to)
+{
+	const auto pixel_count = static_cast<int64_t>(width) * height;
+	ERR_FAIL_COND_V(data.size() != pixel_count * get_pixel_size(from.format), godot::PackedByteArray());
+
+	godot::PackedByteArray converted;
+	converted.resize(pixel_count * get_pixel_size(to.format));
+	godot::LocalVector<float> row;
+	row.resize(width);
+	const auto in = data.ptr();
+	const auto out = converted.ptrw();
+	for (int32_t y = 0; y < height; ++y)
+	{
+		const auto index = static_cast<int64_t>(y) * width;
+		from.decode_row(in, index, width, row.ptr());
+		to.encode_row(row.ptr(), width, out, index);
+	}
+	return converted;
+}
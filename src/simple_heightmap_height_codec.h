@@ -0,0 +1,38 @@
+#pragma once
+
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/variant/vector2.hpp>
+
+#include <cstdint>
+
+// Reads and writes heights in the formats a heightmap image may be stored in
+// FORMAT_RF holds the heights as they are, FORMAT_RH as half floats, and FORMAT_RG8 quantizes them to 16 bits over a fixed range
+// Quantized heights keep their low byte in R and high byte in G, Godot 4.4 has no single channel 16 bit integer format
+// Heights are floats everywhere outside the image, only whole rows are decoded or encoded at a time
+class SimpleHeightmapHeightCodec
+{
+public:
+	SimpleHeightmapHeightCodec() = default;
+	SimpleHeightmapHeightCodec(godot::Image::Format format, const godot::Vector2& range);
+
+	[[nodiscard]] static bool is_supported(godot::Image::Format format);
+	[[nodiscard]] static int32_t get_pixel_size(godot::Image::Format format);
+
+	[[nodiscard]] godot::Image::Format get_format() const { return format; }
+	[[nodiscard]] bool is_float() const { return format == godot::Image::FORMAT_RF; }
+	[[nodiscard]] float get_offset() const { return offset; }
+	[[nodiscard]] float get_scale() const { return scale; }
+
+	[[nodiscard]] float decode(const uint8_t* pixels, int64_t index) const;
+	void decode_row(const uint8_t* pixels, int64_t index, int32_t count, float* out) const;
+	void encode_row(const float* heights, int32_t count, uint8_t* pixels, int64_t index) const; // Heights outside a quantized range are clamped to it
+
+	// Pixels of an image re-encoded from one codec to another, a row at a time
+	[[nodiscard]] static godot::PackedByteArray convert(const godot::PackedByteArray& data, int32_t width, int32_t height, const SimpleHeightmapHeightCodec& from, const SimpleHeightmapHeightCodec& to);
+
+private:
+	godot::Image::Format format = godot::Image::FORMAT_RF;
+	float offset = 0.0f; // Quantized heights are offset + value * scale
+	float scale = 1.0f;
+	float inverse_scale = 1.0f;
+};
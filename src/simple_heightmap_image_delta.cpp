@@ -0,0 +1,195 @@
+#ifdef TOOLS_ENABLED
+#include "simple_heightmap_image_delta.h"
+#include "simple_heightmap.h"
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/object.hpp>
+
+#include <cstring>
+
+godot::LocalVector<SimpleHeightmapImageDelta*> SimpleHeightmapImageDelta::history;
+uint64_t SimpleHeightmapImageDelta::history_memory_usage = 0;
+
+namespace
+{
+	int32_t get_pixel_size(godot::Image::Format format)
+	{
+		switch (format)
+		{
+			case godot::Image::FORMAT_RF: return 4;
+			case godot::Image::FORMAT_RH: return 2;
+			case godot::Image::FORMAT_RG8: return 2;
+			case godot::Image::FORMAT_RGBA8: return 4;
+			default: return 0;
+		}
+	}
+
+	uint32_t get_tile_key(const godot::Vector2i& position)
+	{
+		return static_cast<uint32_t>(position.x) | (static_cast<uint32_t>(position.y) << 16);
+	}
+}
+
+void SimpleHeightmapImageDelta::_bind_methods()
+{
+	godot::ClassDB::bind_method(godot::D_METHOD("apply", "after"), &SimpleHeightmapImageDelta::apply);
+}
+
+SimpleHeightmapImageDelta::~SimpleHeightmapImageDelta()
+{
+	evict();
+}
+
+void SimpleHeightmapImageDelta::begin(const godot::Ref<godot::Image>& p_image, SimpleHeightmap* heightmap, int32_t p_rebuild_flags)
+{
+	ERR_FAIL_COND(p_image.is_null() || p_image->is_empty());
+	ERR_FAIL_COND_MSG(get_pixel_size(p_image->get_format()) == 0, "Unsupported image format for undo/redo.");
+
+	image = p_image;
+	heightmap_id = heightmap != nullptr ? heightmap->get_instance_id() : 0;
+	rebuild_flags = p_rebuild_flags;
+	width = image->get_width();
+	height = image->get_height();
+	format = image->get_format();
+	pixel_size = get_pixel_size(format);
+}
+
+godot::Rect2i SimpleHeightmapImageDelta::get_tile_rect(const godot::Vector2i& position) const
+{
+	return godot::Rect2i(position * TILE_SIZE, godot::Vector2i(TILE_SIZE, TILE_SIZE)).intersection(godot::Rect2i(0, 0, width, height));
+}
+
+godot::PackedByteArray SimpleHeightmapImageDelta::read_tile(const godot::Vector2i& position) const
+{
+	const auto rect = get_tile_rect(position);
+	const auto row_size = rect.size.x * pixel_size;
+	const auto pixels = image->ptr();
+
+	godot::PackedByteArray data;
+	data.resize(row_size * rect.size.y);
+	auto out = data.ptrw();
+	for (int32_t y = 0; y < rect.size.y; ++y)
+	{
+		memcpy(out + y * row_size, pixels + (rect.position.x + static_cast<int64_t>(rect.position.y + y) * width) * pixel_size, row_size);
+	}
+	return data;
+}
+
+void SimpleHeightmapImageDelta::write_tile(const godot::Vector2i& position, const godot::PackedByteArray& data)
+{
+	const auto rect = get_tile_rect(position);
+	const auto row_size = rect.size.x * pixel_size;
+	const auto uncompressed = compressed ? data.decompress(row_size * rect.size.y, godot::FileAccess::COMPRESSION_ZSTD) : data;
+	ERR_FAIL_COND(uncompressed.size() != row_size * rect.size.y);
+
+	const auto pixels = image->ptrw();
+	const auto in = uncompressed.ptr();
+	for (int32_t y = 0; y < rect.size.y; ++y)
+	{
+		memcpy(pixels + (rect.position.x + static_cast<int64_t>(rect.position.y + y) * width) * pixel_size, in + y * row_size, row_size);
+	}
+}
+
+void SimpleHeightmapImageDelta::capture(const godot::Rect2i& region)
+{
+	const auto clipped = region.intersection(godot::Rect2i(0, 0, width, height));
+	if (image.is_null() || !clipped.has_area())
+	{
+		return;
+	}
+	ERR_FAIL_COND_MSG(image->get_width() != width || image->get_height() != height || image->get_format() != format, "Image was resized during a stroke.");
+
+	const auto first = clipped.position / TILE_SIZE;
+	const auto last = (clipped.get_end() - godot::Vector2i(1, 1)) / TILE_SIZE;
+	for (int32_t y = first.y; y <= last.y; ++y)
+	{
+		for (int32_t x = first.x; x <= last.x; ++x)
+		{
+			const auto position = godot::Vector2i(x, y);
+			const auto key = get_tile_key(position);
+			if (!tile_indices.has(key))
+			{
+				tile_indices.insert(key, tiles.size());
+				tiles.push_back(Tile { position, read_tile(position), godot::PackedByteArray() });
+				bounds = bounds.has_area() ? bounds.merge(get_tile_rect(position)) : get_tile_rect(position);
+			}
+		}
+	}
+}
+
+bool SimpleHeightmapImageDelta::end(bool compress, uint64_t memory_budget, godot::LocalVector<uint64_t>& evicted_heightmaps)
+{
+	if (image.is_null() || tiles.is_empty())
+	{
+		return false;
+	}
+	ERR_FAIL_COND_V_MSG(image->get_width() != width || image->get_height() != height || image->get_format() != format, false, "Image was resized during a stroke.");
+
+	compressed = compress;
+	for (auto& tile : tiles)
+	{
+		tile.after = read_tile(tile.position);
+		if (compressed)
+		{
+			tile.before = tile.before.compress(godot::FileAccess::COMPRESSION_ZSTD);
+			tile.after = tile.after.compress(godot::FileAccess::COMPRESSION_ZSTD);
+		}
+	}
+	tile_indices.clear();
+
+	// Drop the oldest strokes until the history fits, the newest one is always kept
+	history.push_back(this);
+	history_memory_usage += get_memory_usage();
+	while (history_memory_usage > memory_budget && history.size() > 1)
+	{
+		if (!evicted_heightmaps.has(history[0]->heightmap_id))
+		{
+			evicted_heightmaps.push_back(history[0]->heightmap_id);
+		}
+		history[0]->evict();
+	}
+	return true;
+}
+
+uint64_t SimpleHeightmapImageDelta::get_memory_usage() const
+{
+	uint64_t usage = 0;
+	for (const auto& tile : tiles)
+	{
+		usage += tile.before.size() + tile.after.size();
+	}
+	return usage;
+}
+
+void SimpleHeightmapImageDelta::evict()
+{
+	const auto index = history.find(this);
+	if (index >= 0)
+	{
+		history_memory_usage -= get_memory_usage();
+		history.remove_at(index);
+		tiles.clear();
+		evicted = true;
+	}
+}
+
+void SimpleHeightmapImageDelta::apply(bool after)
+{
+	ERR_FAIL_COND_MSG(evicted, "Undo data for this stroke was discarded to stay within the undo memory budget.");
+	ERR_FAIL_COND(image.is_null());
+	ERR_FAIL_COND_MSG(image->get_width() != width || image->get_height() != height || image->get_format() != format, "Image was resized since the stroke, it can no longer be undone.");
+
+	for (const auto& tile : tiles)
+	{
+		write_tile(tile.position, after ? tile.after : tile.before);
+	}
+
+	const auto heightmap = godot::Object::cast_to<SimpleHeightmap>(godot::ObjectDB::get_instance(heightmap_id));
+	if (heightmap != nullptr)
+	{
+		heightmap->rebuild_region(bounds, static_cast<SimpleHeightmap::RebuildFlags>(rebuild_flags));
+	}
+}
+
+#endif // TOOLS_ENABLED
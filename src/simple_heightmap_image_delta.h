@@ -0,0 +1,74 @@
+#pragma once
+
+#ifdef TOOLS_ENABLED
+
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/rect2i.hpp>
+
+class SimpleHeightmap;
+
+// Undo/redo record of one brush stroke, keeping only the tiles of the image the stroke touched
+// Tiles are captured lazily as the stroke reaches them, so starting a stroke copies nothing
+class SimpleHeightmapImageDelta : public godot::RefCounted
+{
+	GDCLASS(SimpleHeightmapImageDelta, godot::RefCounted);
+public:
+	static void _bind_methods();
+
+	~SimpleHeightmapImageDelta() override;
+
+	void begin(const godot::Ref<godot::Image>& image, SimpleHeightmap* heightmap, int32_t rebuild_flags);
+
+	// Saves the current contents of every tile overlapping region that has not been saved yet
+	// Must be called before the region is modified
+	void capture(const godot::Rect2i& region);
+
+	// Saves the final contents of the captured tiles and adds the delta to the undo memory budget
+	// Returns false if the stroke did not modify anything
+	// Older strokes dropped to fit the budget add the instance ID of their heightmap to evicted_heightmaps, their undo actions can no longer be applied
+	bool end(bool compress, uint64_t memory_budget, godot::LocalVector<uint64_t>& evicted_heightmaps);
+
+	// Writes the tiles from before or after the stroke back into the image
+	void apply(bool after);
+
+	[[nodiscard]] const godot::Ref<godot::Image>& get_image() const { return image; }
+
+private:
+	static constexpr int32_t TILE_SIZE = 64; // In pixels
+
+	struct Tile
+	{
+		godot::Vector2i position; // In tiles
+		godot::PackedByteArray before;
+		godot::PackedByteArray after;
+	};
+
+	[[nodiscard]] godot::Rect2i get_tile_rect(const godot::Vector2i& position) const;
+	[[nodiscard]] godot::PackedByteArray read_tile(const godot::Vector2i& position) const;
+	void write_tile(const godot::Vector2i& position, const godot::PackedByteArray& data);
+	[[nodiscard]] uint64_t get_memory_usage() const;
+	void evict();
+
+	godot::Ref<godot::Image> image;
+	uint64_t heightmap_id = 0;
+	int32_t rebuild_flags = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t pixel_size = 0;
+	godot::Image::Format format = godot::Image::FORMAT_MAX;
+
+	godot::HashMap<uint32_t, uint32_t> tile_indices; // Tile key to index in tiles
+	godot::LocalVector<Tile> tiles;
+	godot::Rect2i bounds; // In pixels, covers every captured tile
+	bool compressed = false;
+	bool evicted = false;
+
+	// Finished deltas, oldest first, sharing one memory budget
+	static godot::LocalVector<SimpleHeightmapImageDelta*> history;
+	static uint64_t history_memory_usage;
+};
+
+#endif // TOOLS_ENABLED
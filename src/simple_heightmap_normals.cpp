@@ -0,0 +1,171 @@
+#include "simple_heightmap_normals.h"
+
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/math.hpp>
+
+#include <cstdlib>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMPLE_HEIGHTMAP_SSE2
+#endif
+
+namespace
+{
+	constexpr int32_t MAX_UINT_16 = std::numeric_limits<uint16_t>::max();
+
+	godot::Vector3 generate_tangent_from_normal(const godot::Vector3& normal)
+	{
+		return godot::Vector3(normal.z, -normal.x, normal.y).cross(normal.normalized()).normalized();
+	}
+
+	CompressedNormalTangent pack(int32_t na, int32_t nb, int32_t ta, int32_t tb)
+	{
+		CompressedNormalTangent output;
+		output.na = static_cast<uint16_t>(godot::Math::clamp(na, 0, MAX_UINT_16));
+		output.nb = static_cast<uint16_t>(godot::Math::clamp(nb, 0, MAX_UINT_16));
+		output.ta = static_cast<uint16_t>(godot::Math::clamp(ta, 0, MAX_UINT_16));
+		output.tb = static_cast<uint16_t>(godot::Math::clamp(tb, 0, MAX_UINT_16));
+		if (output.ta == 0 && output.tb == MAX_UINT_16)
+		{
+			output.ta = MAX_UINT_16;
+		}
+		return output;
+	}
+
+	godot::Vector3 central_difference_normal(const float* above, const float* center, const float* below, int32_t i, float spacing)
+	{
+		// Offsets by one because the rows start one vertex before the first output
+		const auto dx = center[i + 2] - center[i];
+		const auto dz = below[i + 1] - above[i + 1];
+		return godot::Vector3(-dx, 2.0f * spacing, -dz).normalized();
+	}
+
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+	struct Float4x3
+	{
+		__m128 x;
+		__m128 y;
+		__m128 z;
+	};
+
+	__m128 abs_ps(__m128 v)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+	}
+
+	__m128 select_ps(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	Float4x3 normalize(const Float4x3& v)
+	{
+		const auto inv_length = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, v.x), _mm_mul_ps(v.y, v.y)), _mm_mul_ps(v.z, v.z))));
+		return Float4x3 { _mm_mul_ps(v.x, inv_length), _mm_mul_ps(v.y, inv_length), _mm_mul_ps(v.z, inv_length) };
+	}
+
+	// Same as Vector3::octahedron_encode, four vectors at a time
+	void octahedron_encode(const Float4x3& v, __m128& out_x, __m128& out_y)
+	{
+		const auto zero = _mm_setzero_ps();
+		const auto one = _mm_set1_ps(1.0f);
+		const auto minus_one = _mm_set1_ps(-1.0f);
+		const auto half = _mm_set1_ps(0.5f);
+
+		const auto inv_sum = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(abs_ps(v.x), abs_ps(v.y)), abs_ps(v.z)));
+		const auto x = _mm_mul_ps(v.x, inv_sum);
+		const auto y = _mm_mul_ps(v.y, inv_sum);
+		const auto z = _mm_mul_ps(v.z, inv_sum);
+
+		const auto wrapped_x = _mm_mul_ps(_mm_sub_ps(one, abs_ps(y)), select_ps(_mm_cmpge_ps(x, zero), one, minus_one));
+		const auto wrapped_y = _mm_mul_ps(_mm_sub_ps(one, abs_ps(x)), select_ps(_mm_cmpge_ps(y, zero), one, minus_one));
+		const auto upper = _mm_cmpge_ps(z, zero);
+
+		out_x = _mm_add_ps(_mm_mul_ps(select_ps(upper, x, wrapped_x), half), half);
+		out_y = _mm_add_ps(_mm_mul_ps(select_ps(upper, y, wrapped_y), half), half);
+	}
+
+	__m128i quantize(__m128 v)
+	{
+		const auto scaled = _mm_mul_ps(v, _mm_set1_ps(static_cast<float>(MAX_UINT_16)));
+		return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(scaled, _mm_setzero_ps()), _mm_set1_ps(static_cast<float>(MAX_UINT_16))));
+	}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+}
+
+CompressedNormalTangent SimpleHeightmapNormals::compress_normal(const godot::Vector3& normal)
+{
+	const auto normal_encoded = normal.octahedron_encode();
+	const auto tangent_encoded = generate_tangent_from_normal(normal).octahedron_tangent_encode(1.f);
+	return pack(
+		static_cast<int32_t>(normal_encoded.x * MAX_UINT_16),
+		static_cast<int32_t>(normal_encoded.y * MAX_UINT_16),
+		static_cast<int32_t>(tangent_encoded.x * MAX_UINT_16),
+		static_cast<int32_t>(tangent_encoded.y * MAX_UINT_16));
+}
+
+void SimpleHeightmapNormals::compute_row(const float* above, const float* center, const float* below, int32_t count, float spacing, CompressedNormalTangent* out)
+{
+	int32_t i = 0;
+
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+	{
+		const auto up = _mm_set1_ps(2.0f * spacing);
+		const auto half = _mm_set1_ps(0.5f);
+		const auto tangent_bias = _mm_set1_ps(1.0f / 32767.0f);
+		alignas(16) int32_t na[4], nb[4], ta[4], tb[4];
+		for (; i + 4 <= count; i += 4)
+		{
+			const auto dx = _mm_sub_ps(_mm_loadu_ps(&center[i + 2]), _mm_loadu_ps(&center[i]));
+			const auto dz = _mm_sub_ps(_mm_loadu_ps(&below[i + 1]), _mm_loadu_ps(&above[i + 1]));
+			const auto n = normalize(Float4x3 { _mm_sub_ps(_mm_setzero_ps(), dx), up, _mm_sub_ps(_mm_setzero_ps(), dz) });
+
+			// Tangent is (n.z, -n.x, n.y) x n, as in generate_tangent_from_normal
+			const auto a = Float4x3 { n.z, _mm_sub_ps(_mm_setzero_ps(), n.x), n.y };
+			const auto t = normalize(Float4x3 {
+				_mm_sub_ps(_mm_mul_ps(a.y, n.z), _mm_mul_ps(a.z, n.y)),
+				_mm_sub_ps(_mm_mul_ps(a.z, n.x), _mm_mul_ps(a.x, n.z)),
+				_mm_sub_ps(_mm_mul_ps(a.x, n.y), _mm_mul_ps(a.y, n.x)) });
+
+			__m128 normal_x, normal_y, tangent_x, tangent_y;
+			octahedron_encode(n, normal_x, normal_y);
+			octahedron_encode(t, tangent_x, tangent_y);
+			tangent_y = _mm_add_ps(_mm_mul_ps(_mm_max_ps(tangent_y, tangent_bias), half), half);
+
+			_mm_store_si128(reinterpret_cast<__m128i*>(na), quantize(normal_x));
+			_mm_store_si128(reinterpret_cast<__m128i*>(nb), quantize(normal_y));
+			_mm_store_si128(reinterpret_cast<__m128i*>(ta), quantize(tangent_x));
+			_mm_store_si128(reinterpret_cast<__m128i*>(tb), quantize(tangent_y));
+			for (int32_t lane = 0; lane < 4; ++lane)
+			{
+				out[i + lane] = pack(na[lane], nb[lane], ta[lane], tb[lane]);
+			}
+		}
+	}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+
+	for (; i < count; ++i)
+	{
+		out[i] = compress_normal(central_difference_normal(above, center, below, i, spacing));
+	}
+
+#ifdef DEV_ENABLED
+	// Dev builds check the vectorised result against the reference implementation, allowing for rounding
+	for (int32_t j = 0; j < count; ++j)
+	{
+		const auto expected = compress_normal(central_difference_normal(above, center, below, j, spacing));
+		DEV_ASSERT(std::abs(static_cast<int32_t>(expected.na) - static_cast<int32_t>(out[j].na)) <= 1);
+		DEV_ASSERT(std::abs(static_cast<int32_t>(expected.nb) - static_cast<int32_t>(out[j].nb)) <= 1);
+	}
+#endif // DEV_ENABLED
+}
+
+float SimpleHeightmapNormals::pack_compact_normal(const CompressedNormalTangent& normal_tangent)
+{
+	// Rounded to the nearest of 4096 steps, 24 bits in all is within a float's mantissa
+	const auto a = godot::Math::min((static_cast<uint32_t>(normal_tangent.na) + 8u) >> 4u, 4095u);
+	const auto b = godot::Math::min((static_cast<uint32_t>(normal_tangent.nb) + 8u) >> 4u, 4095u);
+	return static_cast<float>(a | (b << 12u));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <godot_cpp/variant/vector3.hpp>
+
+#include <cstdint>
+
+// Octahedral encoded normal and tangent, as stored in an uncompressed surface
+struct CompressedNormalTangent
+{
+	uint16_t na;
+	uint16_t nb;
+	uint16_t ta;
+	uint16_t tb;
+};
+
+namespace SimpleHeightmapNormals
+{
+	// Reference encoder for a single unit normal, the tangent is derived from the normal
+	CompressedNormalTangent compress_normal(const godot::Vector3& normal);
+
+	// Computes normals for count vertices from central differences of the height grid
+	// above, center and below hold count + 2 heights: one extra vertex on each side of the row
+	// spacing is the distance between neighbouring vertices
+	void compute_row(const float* above, const float* center, const float* below, int32_t count, float spacing, CompressedNormalTangent* out);
+
+	// Octahedral normal reduced to 12 bits per axis, small enough to be held exactly by a float vertex component
+	float pack_compact_normal(const CompressedNormalTangent& normal_tangent);
+}
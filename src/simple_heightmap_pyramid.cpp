@@ -0,0 +1,311 @@
+#include "simple_heightmap_pyramid.h"
+
+#include <godot_cpp/core/math.hpp>
+
+#include <limits>
+#include <utility>
+
+namespace
+{
+	struct Ray
+	{
+		godot::Vector3 origin;
+		godot::Vector3 direction;
+		godot::Vector3 inverse_direction;
+	};
+
+	// Clips the ray against an axis aligned box, directions of zero only pass when the origin is inside the slab
+	bool clip_axis(godot::real_t origin, godot::real_t direction, godot::real_t inverse_direction, godot::real_t min, godot::real_t max, godot::real_t& t0, godot::real_t& t1)
+	{
+		if (direction == 0.0)
+		{
+			return origin >= min && origin <= max;
+		}
+		auto entry = (min - origin) * inverse_direction;
+		auto exit = (max - origin) * inverse_direction;
+		if (entry > exit)
+		{
+			std::swap(entry, exit);
+		}
+		t0 = godot::Math::max(t0, entry);
+		t1 = godot::Math::min(t1, exit);
+		return t0 <= t1;
+	}
+
+	bool clip_columns(const Ray& ray, const godot::Vector2& min, const godot::Vector2& max, godot::real_t& t0, godot::real_t& t1)
+	{
+		return clip_axis(ray.origin.x, ray.direction.x, ray.inverse_direction.x, min.x, max.x, t0, t1)
+			&& clip_axis(ray.origin.z, ray.direction.z, ray.inverse_direction.z, min.y, max.y, t0, t1);
+	}
+
+	// First point in [t0, t1] where the ray meets the bilinear patch of one quad
+	// Along the ray the height of the patch minus the height of the ray is a quadratic in t
+	bool intersect_quad(const SimpleHeightmapSampler& heights, const Ray& ray, int32_t x, int32_t z, godot::real_t t0, godot::real_t t1, godot::real_t& out_t)
+	{
+		const auto h00 = heights.get_height_at(x, z);
+		const auto h10 = heights.get_height_at(x + 1, z);
+		const auto h01 = heights.get_height_at(x, z + 1);
+		const auto h11 = heights.get_height_at(x + 1, z + 1);
+		const auto k1 = h10 - h00;
+		const auto k2 = h01 - h00;
+		const auto k3 = h00 - h10 - h01 + h11;
+
+		const auto u = ray.origin.x - static_cast<godot::real_t>(x);
+		const auto v = ray.origin.z - static_cast<godot::real_t>(z);
+		const auto du = ray.direction.x;
+		const auto dv = ray.direction.z;
+		const auto a = k3 * du * dv;
+		const auto b = k1 * du + k2 * dv + k3 * (u * dv + v * du) - ray.direction.y;
+		const auto c = h00 + k1 * u + k2 * v + k3 * u * v - ray.origin.y;
+
+		auto found = false;
+		const auto consider = [&](godot::real_t t)
+		{
+			if (t >= t0 && t <= t1 && (!found || t < out_t))
+			{
+				out_t = t;
+				found = true;
+			}
+		};
+
+		// Entering the quad already below the surface means the crossing was on the shared edge
+		if (t0 > 0.0 && (a * t0 + b) * t0 + c >= 0.0)
+		{
+			consider(t0);
+		}
+
+		if (godot::Math::abs(a) < CMP_EPSILON)
+		{
+			if (godot::Math::abs(b) > CMP_EPSILON)
+			{
+				consider(-c / b);
+			}
+		}
+		else
+		{
+			const auto discriminant = b * b - 4.0f * a * c;
+			if (discriminant >= 0.0)
+			{
+				const auto q = -0.5f * (b + (b < 0.0 ? -1.0f : 1.0f) * godot::Math::sqrt(discriminant));
+				consider(q / a);
+				if (q != 0.0)
+				{
+					consider(c / q);
+				}
+			}
+		}
+		return found;
+	}
+
+	struct Node
+	{
+		uint32_t level;
+		int32_t x;
+		int32_t y;
+	};
+}
+
+void SimpleHeightmapPyramid::clear()
+{
+	levels.clear();
+	width = 0;
+	height = 0;
+}
+
+void SimpleHeightmapPyramid::update_block(const SimpleHeightmapSampler& heights, int32_t x, int32_t y)
+{
+	// A block covers the corners of its quads, the quads on the far edge of the image repeat the last pixel
+	const auto first_x = x * BLOCK_SIZE;
+	const auto first_y = y * BLOCK_SIZE;
+	const auto last_x = godot::Math::min(first_x + BLOCK_SIZE, width - 1);
+	const auto last_y = godot::Math::min(first_y + BLOCK_SIZE, height - 1);
+
+	auto range = godot::Vector2(std::numeric_limits<godot::real_t>::max(), std::numeric_limits<godot::real_t>::lowest());
+	for (int32_t py = first_y; py <= last_y; ++py)
+	{
+		for (int32_t px = first_x; px <= last_x; ++px)
+		{
+			const auto h = heights.get_height_at(px, py);
+			range.x = godot::Math::min(range.x, h);
+			range.y = godot::Math::max(range.y, h);
+		}
+	}
+	auto& level = levels[0];
+	level.ranges[x + y * level.size.x] = range;
+}
+
+void SimpleHeightmapPyramid::update_parent(uint32_t level_index, int32_t x, int32_t y)
+{
+	const auto& children = levels[level_index - 1];
+	auto range = godot::Vector2(std::numeric_limits<godot::real_t>::max(), std::numeric_limits<godot::real_t>::lowest());
+	for (int32_t cy = y * 2; cy < godot::Math::min(y * 2 + 2, children.size.y); ++cy)
+	{
+		for (int32_t cx = x * 2; cx < godot::Math::min(x * 2 + 2, children.size.x); ++cx)
+		{
+			const auto& child = children.ranges[cx + cy * children.size.x];
+			range.x = godot::Math::min(range.x, child.x);
+			range.y = godot::Math::max(range.y, child.y);
+		}
+	}
+	auto& level = levels[level_index];
+	level.ranges[x + y * level.size.x] = range;
+}
+
+void SimpleHeightmapPyramid::update(const SimpleHeightmapSampler& heights, const godot::Rect2i& region)
+{
+	if (!heights.is_valid() || !heights.is_height_format())
+	{
+		clear();
+		return;
+	}
+
+	auto changed = region.intersection(godot::Rect2i(0, 0, heights.get_width(), heights.get_height()));
+	if (heights.get_width() != width || heights.get_height() != height || levels.is_empty())
+	{
+		width = heights.get_width();
+		height = heights.get_height();
+		levels.clear();
+		auto size = godot::Vector2i((width + BLOCK_SIZE - 1) / BLOCK_SIZE, (height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+		while (true)
+		{
+			Level level;
+			level.size = size;
+			level.ranges.resize(size.x * size.y);
+			levels.push_back(std::move(level));
+			if (size.x == 1 && size.y == 1)
+			{
+				break;
+			}
+			size = godot::Vector2i((size.x + 1) / 2, (size.y + 1) / 2);
+		}
+		changed = godot::Rect2i(0, 0, width, height);
+	}
+	if (!changed.has_area())
+	{
+		return;
+	}
+
+	// A pixel is a corner of the quads before and after it
+	auto first = (changed.position - godot::Vector2i(1, 1)).maxi(0) / BLOCK_SIZE;
+	auto last = (changed.get_end() - godot::Vector2i(1, 1)) / BLOCK_SIZE;
+	last = last.min(levels[0].size - godot::Vector2i(1, 1));
+	for (int32_t y = first.y; y <= last.y; ++y)
+	{
+		for (int32_t x = first.x; x <= last.x; ++x)
+		{
+			update_block(heights, x, y);
+		}
+	}
+
+	for (uint32_t level_index = 1; level_index < levels.size(); ++level_index)
+	{
+		first = first / 2;
+		last = last / 2;
+		for (int32_t y = first.y; y <= last.y; ++y)
+		{
+			for (int32_t x = first.x; x <= last.x; ++x)
+			{
+				update_parent(level_index, x, y);
+			}
+		}
+	}
+}
+
+bool SimpleHeightmapPyramid::intersect_ray(const SimpleHeightmapSampler& heights, const godot::Vector3& from, const godot::Vector3& direction, godot::real_t& out_distance) const
+{
+	if (levels.is_empty() || !heights.is_valid() || heights.get_width() != width || heights.get_height() != height || direction.is_zero_approx())
+	{
+		return false;
+	}
+
+	Ray ray;
+	ray.origin = from;
+	ray.direction = direction;
+	ray.inverse_direction = godot::Vector3(
+		direction.x != 0.0 ? 1.0f / direction.x : 0.0f,
+		direction.y != 0.0 ? 1.0f / direction.y : 0.0f,
+		direction.z != 0.0 ? 1.0f / direction.z : 0.0f);
+
+	// Blocks are visited depth first, children in the order the ray crosses them
+	// Children never overlap, so the first hit found is the closest one
+	godot::LocalVector<Node> stack;
+	stack.push_back(Node { levels.size() - 1, 0, 0 });
+	while (!stack.is_empty())
+	{
+		const auto node = stack[stack.size() - 1];
+		stack.resize(stack.size() - 1);
+
+		const auto& level = levels[node.level];
+		const auto& range = level.ranges[node.x + node.y * level.size.x];
+		const auto block_size = BLOCK_SIZE << node.level;
+		const auto min = godot::Vector2i(node.x, node.y) * block_size;
+		const auto max = (min + godot::Vector2i(block_size, block_size)).min(godot::Vector2i(width, height));
+
+		godot::real_t t0 = 0.0;
+		godot::real_t t1 = std::numeric_limits<godot::real_t>::max();
+		if (!clip_columns(ray, godot::Vector2(min), godot::Vector2(max), t0, t1)
+			|| !clip_axis(ray.origin.y, ray.direction.y, ray.inverse_direction.y, range.x, range.y, t0, t1))
+		{
+			continue;
+		}
+
+		if (node.level == 0)
+		{
+			auto found = false;
+			for (int32_t z = min.y; z < max.y; ++z)
+			{
+				for (int32_t x = min.x; x < max.x; ++x)
+				{
+					godot::real_t quad_t0 = t0;
+					godot::real_t quad_t1 = t1;
+					godot::real_t t;
+					if (clip_columns(ray, godot::Vector2(x, z), godot::Vector2(x + 1, z + 1), quad_t0, quad_t1)
+						&& intersect_quad(heights, ray, x, z, quad_t0, quad_t1, t)
+						&& (!found || t < out_distance))
+					{
+						out_distance = t;
+						found = true;
+					}
+				}
+			}
+			if (found)
+			{
+				return true;
+			}
+			continue;
+		}
+
+		// Order the children by where the ray enters their columns, pushing the furthest first
+		const auto& children = levels[node.level - 1];
+		Node child_nodes[4];
+		godot::real_t child_entries[4];
+		int32_t child_count = 0;
+		for (int32_t cy = node.y * 2; cy < godot::Math::min(node.y * 2 + 2, children.size.y); ++cy)
+		{
+			for (int32_t cx = node.x * 2; cx < godot::Math::min(node.x * 2 + 2, children.size.x); ++cx)
+			{
+				const auto child_size = block_size / 2;
+				const auto child_min = godot::Vector2i(cx, cy) * child_size;
+				const auto child_max = (child_min + godot::Vector2i(child_size, child_size)).min(godot::Vector2i(width, height));
+				godot::real_t child_t0 = t0;
+				godot::real_t child_t1 = t1;
+				if (clip_columns(ray, godot::Vector2(child_min), godot::Vector2(child_max), child_t0, child_t1))
+				{
+					auto index = child_count++;
+					for (; index > 0 && child_entries[index - 1] < child_t0; --index)
+					{
+						child_nodes[index] = child_nodes[index - 1];
+						child_entries[index] = child_entries[index - 1];
+					}
+					child_nodes[index] = Node { node.level - 1, cx, cy };
+					child_entries[index] = child_t0;
+				}
+			}
+		}
+		for (int32_t index = 0; index < child_count; ++index)
+		{
+			stack.push_back(child_nodes[index]);
+		}
+	}
+	return false;
+}
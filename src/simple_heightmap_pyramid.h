@@ -0,0 +1,42 @@
+#pragma once
+
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/rect2i.hpp>
+#include <godot_cpp/variant/vector2.hpp>
+#include <godot_cpp/variant/vector3.hpp>
+
+#include "simple_heightmap_sampler.h"
+
+// Minimum and maximum heights over square blocks of the heightmap, halving in resolution at every level
+// Lets rays skip every block they pass entirely above or below
+class SimpleHeightmapPyramid
+{
+public:
+	void clear();
+
+	// Recomputes the blocks affected by a change to the pixels in region, or every block when the image size changed
+	void update(const SimpleHeightmapSampler& heights, const godot::Rect2i& region);
+
+	// Ray in image space: x and z are in pixels, y is the height
+	// The surface is the bilinear interpolation of the pixels, matching SimpleHeightmapSampler::sample_height
+	// Returns the distance to the first hit in multiples of direction
+	[[nodiscard]] bool intersect_ray(const SimpleHeightmapSampler& heights, const godot::Vector3& from, const godot::Vector3& direction, godot::real_t& out_distance) const;
+
+	[[nodiscard]] bool is_empty() const { return levels.is_empty(); }
+
+private:
+	static constexpr int32_t BLOCK_SIZE = 8; // Quads per side of a block on the finest level
+
+	struct Level
+	{
+		godot::Vector2i size; // In blocks
+		godot::LocalVector<godot::Vector2> ranges; // Minimum and maximum height of each block
+	};
+
+	void update_block(const SimpleHeightmapSampler& heights, int32_t x, int32_t y);
+	void update_parent(uint32_t level, int32_t x, int32_t y);
+
+	godot::LocalVector<Level> levels;
+	int32_t width = 0;
+	int32_t height = 0;
+};
@@ -0,0 +1,442 @@
+#include "simple_heightmap_sampler.h"
+
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMPLE_HEIGHTMAP_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMPLE_HEIGHTMAP_SSE2
+#endif
+
+SimpleHeightmapSampler::SimpleHeightmapSampler(const godot::Ref<godot::Image>& image, const godot::Vector2& height_range)
+{
+	if (image.is_valid() && !image->is_empty())
+	{
+		// Image data is reference counted, this shares the buffer rather than copying it
+		data = image->get_data();
+		format = image->get_format();
+		width = image->get_width();
+		height = image->get_height();
+		pixels = data.ptr();
+		height_codec = SimpleHeightmapHeightCodec(format, height_range);
+	}
+}
+
+SimpleHeightmapSampler::SimpleHeightmapSampler(const godot::PackedByteArray& pixel_data, godot::Image::Format pixel_format, int32_t pixel_width, int32_t pixel_height, const godot::Vector2& height_range)
+{
+	if (!pixel_data.is_empty())
+	{
+		data = pixel_data;
+		format = pixel_format;
+		width = pixel_width;
+		height = pixel_height;
+		pixels = data.ptr();
+		height_codec = SimpleHeightmapHeightCodec(format, height_range);
+	}
+}
+
+namespace
+{
+	struct HeightRows
+	{
+		const float* row_0;
+		const float* row_1;
+		float ty;
+	};
+
+	HeightRows get_height_rows(const uint8_t* pixels, int32_t width, int32_t height, float y)
+	{
+		const auto y0 = godot::Math::clamp(static_cast<int32_t>(y), 0, height - 1);
+		const auto y1 = godot::Math::clamp(y0 + 1, 0, height - 1);
+		const auto rows = reinterpret_cast<const float*>(pixels);
+		return HeightRows { rows + static_cast<int64_t>(y0) * width, rows + static_cast<int64_t>(y1) * width, y - godot::Math::floor(y) };
+	}
+
+	float sample_height_rows(const HeightRows& rows, int32_t width, float x)
+	{
+		const auto x0 = godot::Math::clamp(static_cast<int32_t>(x), 0, width - 1);
+		const auto x1 = godot::Math::clamp(x0 + 1, 0, width - 1);
+		const auto tx = x - godot::Math::floor(x);
+		const auto a = rows.row_0[x0] + (rows.row_0[x1] - rows.row_0[x0]) * tx;
+		const auto b = rows.row_1[x0] + (rows.row_1[x1] - rows.row_1[x0]) * tx;
+		return a + (b - a) * rows.ty;
+	}
+
+	bool is_integer_aligned(float x, float step, float y)
+	{
+		return step == 1.0f && x == godot::Math::floor(x) && y == godot::Math::floor(y);
+	}
+}
+
+float SimpleHeightmapSampler::get_height_at(int32_t x, int32_t y) const
+{
+	x = godot::Math::clamp(x, 0, width - 1);
+	y = godot::Math::clamp(y, 0, height - 1);
+	if (height_codec.is_float())
+	{
+		return reinterpret_cast<const float*>(pixels)[x + static_cast<int64_t>(y) * width];
+	}
+	return height_codec.decode(pixels, x + static_cast<int64_t>(y) * width);
+}
+
+float SimpleHeightmapSampler::sample_height(const godot::Vector2& point) const
+{
+	if (height_codec.is_float())
+	{
+		return sample_height_rows(get_height_rows(pixels, width, height, point.y), width, point.x);
+	}
+
+	// Same interpolation as sample_height_rows, on decoded texels
+	const auto x0 = godot::Math::clamp(static_cast<int32_t>(point.x), 0, width - 1);
+	const auto y0 = godot::Math::clamp(static_cast<int32_t>(point.y), 0, height - 1);
+	const auto tx = point.x - godot::Math::floor(point.x);
+	const auto ty = point.y - godot::Math::floor(point.y);
+	const auto h00 = get_height_at(x0, y0);
+	const auto h10 = get_height_at(x0 + 1, y0);
+	const auto h01 = get_height_at(x0, y0 + 1);
+	const auto h11 = get_height_at(x0 + 1, y0 + 1);
+	const auto a = h00 + (h10 - h00) * tx;
+	const auto b = h01 + (h11 - h01) * tx;
+	return a + (b - a) * ty;
+}
+
+uint32_t SimpleHeightmapSampler::get_color_at(int32_t x, int32_t y) const
+{
+	x = godot::Math::clamp(x, 0, width - 1);
+	y = godot::Math::clamp(y, 0, height - 1);
+
+	// RGBA8 texels have the same byte order as Color::to_abgr32 on little endian targets
+	uint32_t color;
+	memcpy(&color, &pixels[(x + static_cast<int64_t>(y) * width) * 4], sizeof(uint32_t));
+	return color;
+}
+
+uint32_t SimpleHeightmapSampler::sample_color(const godot::Vector2& point) const
+{
+	const auto x0 = godot::Math::clamp(static_cast<int32_t>(point.x), 0, width - 1);
+	const auto y0 = godot::Math::clamp(static_cast<int32_t>(point.y), 0, height - 1);
+	const auto tx = point.x - godot::Math::floor(point.x);
+	const auto ty = point.y - godot::Math::floor(point.y);
+
+	const uint8_t* v1 = &pixels[(godot::Math::clamp(x0 + 0, 0, width - 1) + static_cast<int64_t>(godot::Math::clamp(y0 + 0, 0, height - 1)) * width) * 4];
+	const uint8_t* v2 = &pixels[(godot::Math::clamp(x0 + 1, 0, width - 1) + static_cast<int64_t>(godot::Math::clamp(y0 + 0, 0, height - 1)) * width) * 4];
+	const uint8_t* v3 = &pixels[(godot::Math::clamp(x0 + 0, 0, width - 1) + static_cast<int64_t>(godot::Math::clamp(y0 + 1, 0, height - 1)) * width) * 4];
+	const uint8_t* v4 = &pixels[(godot::Math::clamp(x0 + 1, 0, width - 1) + static_cast<int64_t>(godot::Math::clamp(y0 + 1, 0, height - 1)) * width) * 4];
+
+	// Same math as Color::lerp followed by Color::to_abgr32
+	uint32_t output = 0;
+	for (int32_t channel = 0; channel < 4; ++channel)
+	{
+		const auto c1 = v1[channel] / 255.0f;
+		const auto c2 = v2[channel] / 255.0f;
+		const auto c3 = v3[channel] / 255.0f;
+		const auto c4 = v4[channel] / 255.0f;
+		const auto a = c1 + (c2 - c1) * tx;
+		const auto b = c3 + (c4 - c3) * tx;
+		const auto value = static_cast<uint32_t>(godot::Math::round((a + (b - a) * ty) * 255.0f));
+		output |= godot::Math::min(value, 255u) << (channel * 8);
+	}
+	return output;
+}
+
+void SimpleHeightmapSampler::sample_height_row(float x, float step, float y, int32_t count, float* out) const
+{
+	if (!height_codec.is_float())
+	{
+		sample_decoded_height_row(x, step, y, count, out);
+		return;
+	}
+
+	const auto rows = get_height_rows(pixels, width, height, y);
+
+	// Mesh vertices land exactly on texels when the mesh and image resolution match
+	if (is_integer_aligned(x, step, y))
+	{
+		const auto first = static_cast<int32_t>(x);
+		int32_t i = 0;
+		for (; i < count && first + i < 0; ++i)
+		{
+			out[i] = rows.row_0[0];
+		}
+		const auto copy_count = godot::Math::max(godot::Math::min(count, width - first) - i, 0);
+		memcpy(&out[i], &rows.row_0[first + i], copy_count * sizeof(float));
+		i += copy_count;
+		for (; i < count; ++i)
+		{
+			out[i] = rows.row_0[width - 1];
+		}
+		return;
+	}
+
+	int32_t i = 0;
+
+#if defined(SIMPLE_HEIGHTMAP_AVX2)
+	{
+		const auto lane_offsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const auto start = _mm256_set1_ps(x);
+		const auto steps = _mm256_set1_ps(step);
+		const auto ty = _mm256_set1_ps(rows.ty);
+		const auto zero = _mm256_setzero_si256();
+		const auto one = _mm256_set1_epi32(1);
+		const auto last = _mm256_set1_epi32(width - 1);
+		for (; i + 8 <= count; i += 8)
+		{
+			const auto px = _mm256_add_ps(start, _mm256_mul_ps(steps, _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lane_offsets)));
+			const auto tx = _mm256_sub_ps(px, _mm256_floor_ps(px));
+			const auto x0 = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(px), zero), last);
+			const auto x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), last);
+			const auto a0 = _mm256_i32gather_ps(rows.row_0, x0, sizeof(float));
+			const auto a1 = _mm256_i32gather_ps(rows.row_0, x1, sizeof(float));
+			const auto b0 = _mm256_i32gather_ps(rows.row_1, x0, sizeof(float));
+			const auto b1 = _mm256_i32gather_ps(rows.row_1, x1, sizeof(float));
+			const auto a = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_sub_ps(a1, a0), tx));
+			const auto b = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_sub_ps(b1, b0), tx));
+			_mm256_storeu_ps(&out[i], _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), ty)));
+		}
+	}
+#endif // SIMPLE_HEIGHTMAP_AVX2
+
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+	{
+		const auto lane_offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		const auto start = _mm_set1_ps(x);
+		const auto steps = _mm_set1_ps(step);
+		const auto ty = _mm_set1_ps(rows.ty);
+		const auto one = _mm_set1_ps(1.0f);
+		alignas(16) int32_t truncated[4];
+		for (; i + 4 <= count; i += 4)
+		{
+			const auto px = _mm_add_ps(start, _mm_mul_ps(steps, _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lane_offsets)));
+
+			// SSE2 has no floor, correct the truncated value for negative positions
+			const auto xi = _mm_cvttps_epi32(px);
+			auto fx = _mm_cvtepi32_ps(xi);
+			fx = _mm_sub_ps(fx, _mm_and_ps(_mm_cmpgt_ps(fx, px), one));
+			const auto tx = _mm_sub_ps(px, fx);
+
+			// No gather before AVX2, clamp and load each lane individually
+			_mm_store_si128(reinterpret_cast<__m128i*>(truncated), xi);
+			alignas(16) float a0[4], a1[4], b0[4], b1[4];
+			for (int32_t lane = 0; lane < 4; ++lane)
+			{
+				const auto x0 = godot::Math::clamp(truncated[lane], 0, width - 1);
+				const auto x1 = godot::Math::clamp(x0 + 1, 0, width - 1);
+				a0[lane] = rows.row_0[x0];
+				a1[lane] = rows.row_0[x1];
+				b0[lane] = rows.row_1[x0];
+				b1[lane] = rows.row_1[x1];
+			}
+			const auto va0 = _mm_load_ps(a0);
+			const auto vb0 = _mm_load_ps(b0);
+			const auto a = _mm_add_ps(va0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(a1), va0), tx));
+			const auto b = _mm_add_ps(vb0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(b1), vb0), tx));
+			_mm_storeu_ps(&out[i], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), ty)));
+		}
+	}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+
+	for (; i < count; ++i)
+	{
+		out[i] = sample_height_rows(rows, width, x + step * static_cast<float>(i));
+	}
+
+#ifdef DEV_ENABLED
+	// Dev builds check the vectorised result against the reference implementation
+	godot::LocalVector<float> expected;
+	expected.resize(count);
+	sample_height_row_scalar(x, step, y, count, expected.ptr());
+	for (int32_t j = 0; j < count; ++j)
+	{
+		DEV_ASSERT(godot::Math::is_equal_approx(out[j], expected[j]));
+	}
+#endif // DEV_ENABLED
+}
+
+void SimpleHeightmapSampler::sample_decoded_height_row(float x, float step, float y, int32_t count, float* out) const
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	// Columns the samples read, the truncated positions only ever increase along the row
+	const auto last_x = x + step * static_cast<float>(count - 1);
+	const auto first = godot::Math::clamp(static_cast<int32_t>(godot::Math::min(x, last_x)), 0, width - 1);
+	const auto end = godot::Math::clamp(static_cast<int32_t>(godot::Math::max(x, last_x)) + 1, 0, width - 1) + 1;
+	const auto span = end - first;
+
+	const auto y0 = godot::Math::clamp(static_cast<int32_t>(y), 0, height - 1);
+	const auto y1 = godot::Math::clamp(y0 + 1, 0, height - 1);
+	godot::LocalVector<float> decoded;
+	decoded.resize(span * 2);
+	const auto row_0 = decoded.ptr();
+	const auto row_1 = decoded.ptr() + span;
+	height_codec.decode_row(pixels, static_cast<int64_t>(y0) * width + first, span, row_0);
+	height_codec.decode_row(pixels, static_cast<int64_t>(y1) * width + first, span, row_1);
+
+	const auto ty = y - godot::Math::floor(y);
+	for (int32_t i = 0; i < count; ++i)
+	{
+		const auto px = x + step * static_cast<float>(i);
+		const auto x0 = godot::Math::clamp(static_cast<int32_t>(px), 0, width - 1);
+		const auto x1 = godot::Math::clamp(x0 + 1, 0, width - 1) - first;
+		const auto tx = px - godot::Math::floor(px);
+		const auto a = row_0[x0 - first] + (row_0[x1] - row_0[x0 - first]) * tx;
+		const auto b = row_1[x0 - first] + (row_1[x1] - row_1[x0 - first]) * tx;
+		out[i] = a + (b - a) * ty;
+	}
+}
+
+void SimpleHeightmapSampler::sample_height_row_scalar(float x, float step, float y, int32_t count, float* out) const
+{
+	if (!height_codec.is_float())
+	{
+		for (int32_t i = 0; i < count; ++i)
+		{
+			out[i] = sample_height(godot::Vector2(x + step * static_cast<float>(i), y));
+		}
+		return;
+	}
+
+	const auto rows = get_height_rows(pixels, width, height, y);
+	for (int32_t i = 0; i < count; ++i)
+	{
+		out[i] = sample_height_rows(rows, width, x + step * static_cast<float>(i));
+	}
+}
+
+void SimpleHeightmapSampler::sample_height_points(const float* xs, const float* ys, int32_t count, float* out) const
+{
+	// Unrelated points share no rows worth decoding together
+	if (!height_codec.is_float())
+	{
+		sample_height_points_scalar(xs, ys, count, out);
+		return;
+	}
+
+	const auto values = reinterpret_cast<const float*>(pixels);
+	int32_t i = 0;
+
+#if defined(SIMPLE_HEIGHTMAP_AVX2)
+	{
+		const auto zero = _mm256_setzero_si256();
+		const auto one = _mm256_set1_epi32(1);
+		const auto last_x = _mm256_set1_epi32(width - 1);
+		const auto last_y = _mm256_set1_epi32(height - 1);
+		const auto stride = _mm256_set1_epi32(width);
+		for (; i + 8 <= count; i += 8)
+		{
+			const auto px = _mm256_loadu_ps(&xs[i]);
+			const auto py = _mm256_loadu_ps(&ys[i]);
+			const auto tx = _mm256_sub_ps(px, _mm256_floor_ps(px));
+			const auto ty = _mm256_sub_ps(py, _mm256_floor_ps(py));
+			const auto x0 = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(px), zero), last_x);
+			const auto y0 = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(py), zero), last_y);
+			const auto x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), last_x);
+			const auto y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), last_y);
+			const auto row_0 = _mm256_mullo_epi32(y0, stride);
+			const auto row_1 = _mm256_mullo_epi32(y1, stride);
+			const auto a0 = _mm256_i32gather_ps(values, _mm256_add_epi32(row_0, x0), sizeof(float));
+			const auto a1 = _mm256_i32gather_ps(values, _mm256_add_epi32(row_0, x1), sizeof(float));
+			const auto b0 = _mm256_i32gather_ps(values, _mm256_add_epi32(row_1, x0), sizeof(float));
+			const auto b1 = _mm256_i32gather_ps(values, _mm256_add_epi32(row_1, x1), sizeof(float));
+			const auto a = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_sub_ps(a1, a0), tx));
+			const auto b = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_sub_ps(b1, b0), tx));
+			_mm256_storeu_ps(&out[i], _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), ty)));
+		}
+	}
+#endif // SIMPLE_HEIGHTMAP_AVX2
+
+#if defined(SIMPLE_HEIGHTMAP_SSE2)
+	{
+		const auto one = _mm_set1_ps(1.0f);
+		alignas(16) int32_t truncated_x[4];
+		alignas(16) int32_t truncated_y[4];
+		for (; i + 4 <= count; i += 4)
+		{
+			const auto px = _mm_loadu_ps(&xs[i]);
+			const auto py = _mm_loadu_ps(&ys[i]);
+
+			// SSE2 has no floor, correct the truncated values for negative positions
+			const auto xi = _mm_cvttps_epi32(px);
+			const auto yi = _mm_cvttps_epi32(py);
+			auto fx = _mm_cvtepi32_ps(xi);
+			auto fy = _mm_cvtepi32_ps(yi);
+			fx = _mm_sub_ps(fx, _mm_and_ps(_mm_cmpgt_ps(fx, px), one));
+			fy = _mm_sub_ps(fy, _mm_and_ps(_mm_cmpgt_ps(fy, py), one));
+			const auto tx = _mm_sub_ps(px, fx);
+			const auto ty = _mm_sub_ps(py, fy);
+
+			// No gather before AVX2, clamp and load each lane individually
+			_mm_store_si128(reinterpret_cast<__m128i*>(truncated_x), xi);
+			_mm_store_si128(reinterpret_cast<__m128i*>(truncated_y), yi);
+			alignas(16) float a0[4], a1[4], b0[4], b1[4];
+			for (int32_t lane = 0; lane < 4; ++lane)
+			{
+				const auto rows = get_height_rows(pixels, width, height, static_cast<float>(godot::Math::clamp(truncated_y[lane], 0, height - 1)));
+				const auto x0 = godot::Math::clamp(truncated_x[lane], 0, width - 1);
+				const auto x1 = godot::Math::clamp(x0 + 1, 0, width - 1);
+				a0[lane] = rows.row_0[x0];
+				a1[lane] = rows.row_0[x1];
+				b0[lane] = rows.row_1[x0];
+				b1[lane] = rows.row_1[x1];
+			}
+			const auto va0 = _mm_load_ps(a0);
+			const auto vb0 = _mm_load_ps(b0);
+			const auto a = _mm_add_ps(va0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(a1), va0), tx));
+			const auto b = _mm_add_ps(vb0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(b1), vb0), tx));
+			_mm_storeu_ps(&out[i], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), ty)));
+		}
+	}
+#endif // SIMPLE_HEIGHTMAP_SSE2
+
+	for (; i < count; ++i)
+	{
+		out[i] = sample_height(godot::Vector2(xs[i], ys[i]));
+	}
+
+#ifdef DEV_ENABLED
+	godot::LocalVector<float> expected;
+	expected.resize(count);
+	sample_height_points_scalar(xs, ys, count, expected.ptr());
+	for (int32_t j = 0; j < count; ++j)
+	{
+		DEV_ASSERT(godot::Math::is_equal_approx(out[j], expected[j]));
+	}
+#endif // DEV_ENABLED
+}
+
+void SimpleHeightmapSampler::sample_height_points_scalar(const float* xs, const float* ys, int32_t count, float* out) const
+{
+	for (int32_t i = 0; i < count; ++i)
+	{
+		out[i] = sample_height(godot::Vector2(xs[i], ys[i]));
+	}
+}
+
+void SimpleHeightmapSampler::sample_color_row(float x, float step, float y, int32_t count, uint32_t* out) const
+{
+	if (is_integer_aligned(x, step, y))
+	{
+		const auto first = static_cast<int32_t>(x);
+		const auto row = static_cast<int32_t>(y);
+		for (int32_t i = 0; i < count; ++i)
+		{
+			out[i] = get_color_at(first + i, row);
+		}
+		return;
+	}
+
+	for (int32_t i = 0; i < count; ++i)
+	{
+		out[i] = sample_color(godot::Vector2(x + step * static_cast<float>(i), y));
+	}
+}
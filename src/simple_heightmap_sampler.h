@@ -0,0 +1,49 @@
+#pragma once
+
+#include <godot_cpp/classes/image.hpp>
+
+#include "simple_heightmap_height_codec.h"
+
+// Reads heightmap and splatmap pixels straight from the image buffer
+// Holds a reference to the copy-on-write image data, so it keeps reading the pixels it started with after the image is modified
+class SimpleHeightmapSampler
+{
+public:
+	SimpleHeightmapSampler() = default;
+	explicit SimpleHeightmapSampler(const godot::Ref<godot::Image>& image, const godot::Vector2& height_range = godot::Vector2()); // Range is only used by FORMAT_RG8 heights
+	SimpleHeightmapSampler(const godot::PackedByteArray& pixel_data, godot::Image::Format pixel_format, int32_t pixel_width, int32_t pixel_height, const godot::Vector2& height_range = godot::Vector2()); // Pixels laid out like the image data
+
+	[[nodiscard]] bool is_valid() const { return pixels != nullptr; }
+	[[nodiscard]] bool is_height_format() const { return SimpleHeightmapHeightCodec::is_supported(format); }
+	[[nodiscard]] bool is_color_format() const { return format == godot::Image::FORMAT_RGBA8; }
+	[[nodiscard]] int32_t get_width() const { return width; }
+	[[nodiscard]] int32_t get_height() const { return height; }
+
+	// Single samples, heights are decoded to floats whatever the image format
+	[[nodiscard]] float get_height_at(int32_t x, int32_t y) const;
+	[[nodiscard]] float sample_height(const godot::Vector2& point) const;
+	[[nodiscard]] uint32_t get_color_at(int32_t x, int32_t y) const; // Packed as Color::to_abgr32
+	[[nodiscard]] uint32_t sample_color(const godot::Vector2& point) const;
+
+	// Samples count points along a row, starting at (x, y) and advancing x by step
+	void sample_height_row(float x, float step, float y, int32_t count, float* out) const;
+	void sample_color_row(float x, float step, float y, int32_t count, uint32_t* out) const;
+
+	// Samples count unrelated points, xs and ys hold their coordinates
+	void sample_height_points(const float* xs, const float* ys, int32_t count, float* out) const;
+
+	// Reference implementations of the batched samplers, used to check the vectorised paths
+	void sample_height_row_scalar(float x, float step, float y, int32_t count, float* out) const;
+	void sample_height_points_scalar(const float* xs, const float* ys, int32_t count, float* out) const;
+
+private:
+	// Heights stored at a lower precision are decoded a span at a time, then sampled like float rows
+	void sample_decoded_height_row(float x, float step, float y, int32_t count, float* out) const;
+
+	godot::PackedByteArray data;
+	const uint8_t* pixels = nullptr;
+	godot::Image::Format format = godot::Image::FORMAT_MAX;
+	int32_t width = 0;
+	int32_t height = 0;
+	SimpleHeightmapHeightCodec height_codec;
+};
@@ -0,0 +1,89 @@
+#include "simple_heightmap_splat.h"
+
+#include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/core/math.hpp>
+
+#include <utility>
+
+namespace
+{
+	uint8_t to_byte(float value)
+	{
+		return static_cast<uint8_t>(godot::Math::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f));
+	}
+}
+
+void SimpleHeightmapSplat::decode_layers(const uint8_t* pixel, float* weights)
+{
+	const auto second = static_cast<float>(pixel[2]) / 255.0f;
+	const auto third = static_cast<float>(pixel[3]) / 255.0f;
+	weights[pixel[0] & 0xF] += godot::Math::max(1.0f - second - third, 0.0f);
+	weights[pixel[0] >> 4] += second;
+	weights[pixel[1] & 0xF] += third;
+}
+
+void SimpleHeightmapSplat::encode_layers(const float* weights, uint8_t* pixel)
+{
+	// Strongest layers first, the lowest index wins a tie
+	int32_t layers[LAYERS_PER_PIXEL] = { 0, 0, 0 };
+	float strongest[LAYERS_PER_PIXEL] = { 0.0f, 0.0f, 0.0f };
+	for (int32_t layer = 0; layer < MAX_LAYERS; ++layer)
+	{
+		auto weight = weights[layer];
+		auto index = layer;
+		for (int32_t slot = 0; slot < LAYERS_PER_PIXEL; ++slot)
+		{
+			if (weight > strongest[slot])
+			{
+				std::swap(weight, strongest[slot]);
+				std::swap(index, layers[slot]);
+			}
+		}
+	}
+
+	const auto total = strongest[0] + strongest[1] + strongest[2];
+	if (total <= 0.0f)
+	{
+		// Nothing painted, which is all of the first layer
+		pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+		return;
+	}
+	pixel[0] = static_cast<uint8_t>(layers[0] | (layers[1] << 4));
+	pixel[1] = static_cast<uint8_t>(layers[2]);
+	pixel[2] = to_byte(strongest[1] / total);
+	pixel[3] = to_byte(strongest[2] / total);
+}
+
+void SimpleHeightmapSplat::convert_weights_to_layers(const godot::Ref<godot::Image>& image)
+{
+	ERR_FAIL_COND(image.is_null() || image->get_format() != godot::Image::FORMAT_RGBA8);
+	const auto pixel_count = static_cast<int64_t>(image->get_width()) * image->get_height();
+	const auto pixels = image->ptrw();
+	for (int64_t i = 0; i < pixel_count; ++i)
+	{
+		const auto pixel = pixels + i * 4;
+		float weights[MAX_LAYERS] = {};
+		for (int32_t channel = 0; channel < 4; ++channel)
+		{
+			weights[channel] = static_cast<float>(pixel[channel]) / 255.0f;
+		}
+		encode_layers(weights, pixel);
+	}
+}
+
+void SimpleHeightmapSplat::convert_layers_to_weights(const godot::Ref<godot::Image>& image)
+{
+	ERR_FAIL_COND(image.is_null() || image->get_format() != godot::Image::FORMAT_RGBA8);
+	const auto pixel_count = static_cast<int64_t>(image->get_width()) * image->get_height();
+	const auto pixels = image->ptrw();
+	for (int64_t i = 0; i < pixel_count; ++i)
+	{
+		const auto pixel = pixels + i * 4;
+		float weights[MAX_LAYERS] = {};
+		decode_layers(pixel, weights);
+		for (int32_t channel = 0; channel < 4; ++channel)
+		{
+			pixel[channel] = to_byte(weights[channel]);
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <godot_cpp/classes/image.hpp>
+
+#include <cstdint>
+
+// Splatmap pixels in SimpleHeightmap::SPLAT_ENCODING_LAYERS name their strongest texture layers, instead of weighing four fixed ones
+// R holds the first two layer indices in its low and high nibble and G the third, B and A weigh the second and third, the first gets the rest
+namespace SimpleHeightmapSplat
+{
+	constexpr int32_t MAX_LAYERS = 16;
+	constexpr int32_t LAYERS_PER_PIXEL = 3;
+
+	// Adds the weight of each layer a pixel names into weights, which holds MAX_LAYERS entries
+	void decode_layers(const uint8_t* pixel, float* weights);
+
+	// Writes the strongest LAYERS_PER_PIXEL of MAX_LAYERS weights, scaled so they sum to one
+	void encode_layers(const float* weights, uint8_t* pixel);
+
+	// Re-encodes every pixel of an RGBA8 splatmap, between weights of four layers and layer indices
+	void convert_weights_to_layers(const godot::Ref<godot::Image>& image);
+	void convert_layers_to_weights(const godot::Ref<godot::Image>& image); // Layers past the fourth are dropped
+}